@@ -0,0 +1,199 @@
+/*
+*	Scaling and fault injection benchmark for distributed rendering (see
+*	util/distributed.h).
+*	compile using: g++ bench/distributed.cpp -std=c++11 -O2 -o distributed_bench
+*	./distributed_bench [--mp1 PATH] [--scene NAME] [--size N] [--spp N]
+*		[--max-workers N]
+*	Renders the scene (spheres10k, 400x400 at 16 spp by default) in one
+*	single threaded process for reference, then on 1, 2, 4 ... up to
+*	--max-workers (the hardware threads by default) worker processes of
+*	one thread each, and reports each render's speedup and efficiency
+*	against one worker. Then it renders on 3 workers, first with one
+*	that crashes halfway through sending a tile and then with one that
+*	hangs in a tile. Every image must be identical to the reference; the
+*	run fails (exit status 1) when one isn't or a render fails.
+*	Workers scale with the cores they get: past the machine's core count
+*	the speedup flattens.
+*/
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+struct bench_options {
+	string mp1 = "./mp1";
+	string scene = "spheres10k";
+	int size = 400;
+	int spp = 16;
+	int max_workers = 0;
+};
+
+/* Runs a command, collecting its standard error.
+*	@argv: the command and its arguments
+*	@err: receives what it wrote to standard error
+*	returns its exit status, or -1 if it could not be run or was killed.
+*/
+int run(const vector<string>& argv, string& err) {
+	int fds[2];
+	if (pipe(fds) != 0) return -1;
+	pid_t pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0) {
+		dup2(fds[1], 2);
+		close(fds[0]);
+		close(fds[1]);
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0) dup2(null, 1);
+		vector<char*> args;
+		for (size_t i = 0; i < argv.size(); i++) args.push_back(const_cast<char*>(argv[i].c_str()));
+		args.push_back(0);
+		execv(args[0], &args[0]);
+		perror(args[0]);
+		_exit(127);
+	}
+	close(fds[1]);
+	err.clear();
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) err.append(buffer, n);
+	close(fds[0]);
+	int status = 0;
+	if (waitpid(pid, &status, 0) < 0) return -1;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* The whole of a file, empty if it can't be read.
+*/
+string read_file(const string& path) {
+	ifstream in(path.c_str(), ios::binary);
+	ostringstream out;
+	out << in.rdbuf();
+	return out.str();
+}
+
+/* Renders with mp1 and returns the seconds on its render: line, or -1 on
+*	failure, printing why.
+*	@opts: the scene and its settings
+*	@image: where the image goes
+*	@extra: further flags
+*	@err: receives mp1's standard error
+*/
+double render(const bench_options& opts, const string& image, const vector<string>& extra, string& err) {
+	vector<string> argv;
+	argv.push_back(opts.mp1);
+	argv.push_back("0");
+	argv.push_back(to_string(opts.size));
+	argv.push_back("1");
+	argv.push_back(to_string(opts.size));
+	argv.push_back("--scene");
+	argv.push_back(opts.scene);
+	argv.push_back("--spp");
+	argv.push_back(to_string(opts.spp));
+	argv.push_back("--format");
+	argv.push_back("p6");
+	argv.push_back("--output");
+	argv.push_back(image);
+	argv.push_back("--threads");
+	argv.push_back("1");
+	argv.insert(argv.end(), extra.begin(), extra.end());
+	int status = run(argv, err);
+	size_t line = err.find("render: ");
+	if (status != 0 || line == string::npos) {
+		cerr << "mp1 failed:\n" << err;
+		return -1;
+	}
+	return atof(err.c_str() + line + 8);
+}
+
+/* The distributed: line of a coordinator's output.
+*/
+string summary(const string& err) {
+	size_t line = err.find("distributed: ");
+	if (line == string::npos) return "";
+	return err.substr(line + 13, err.find('\n', line) - line - 13);
+}
+
+int main(int argc, char** args) {
+	bench_options opts;
+	for (int i = 1; i < argc; i++) {
+		string a = args[i];
+		bool has_value = i + 1 < argc;
+		if (a == "--mp1" && has_value) opts.mp1 = args[++i];
+		else if (a == "--scene" && has_value) opts.scene = args[++i];
+		else if (a == "--size" && has_value) opts.size = atoi(args[++i]);
+		else if (a == "--spp" && has_value) opts.spp = atoi(args[++i]);
+		else if (a == "--max-workers" && has_value) opts.max_workers = atoi(args[++i]);
+		else {
+			cerr << "usage: " << args[0] << " [--mp1 PATH] [--scene NAME] [--size N] [--spp N] [--max-workers N]" << endl;
+			return 1;
+		}
+	}
+	if (opts.max_workers < 1) opts.max_workers = int(thread::hardware_concurrency());
+	if (opts.max_workers < 2) opts.max_workers = 2;
+
+	char dir_template[] = "/tmp/mp1-distributed-XXXXXX";
+	if (!mkdtemp(dir_template)) {
+		cerr << "couldn't make a scratch directory" << endl;
+		return 1;
+	}
+	string dir = dir_template;
+	string err;
+	string reference_image = dir + "/reference.ppm";
+	double single = render(opts, reference_image, vector<string>(), err);
+	if (single < 0) return 1;
+	string reference = read_file(reference_image);
+	cout << opts.scene << " " << opts.size << "x" << opts.size << " at " << opts.spp << " spp, "
+		<< thread::hardware_concurrency() << " hardware threads" << endl;
+	cout << "one process: " << single << " s" << endl;
+
+	bool passed = true;
+	double one_worker = 0;
+	cout << "workers  render s  speedup  efficiency" << endl;
+	vector<int> counts;
+	for (int workers = 1; workers < opts.max_workers; workers *= 2) counts.push_back(workers);
+	counts.push_back(opts.max_workers);
+	for (size_t c = 0; c < counts.size(); c++) {
+		int workers = counts[c];
+		string image = dir + "/workers" + to_string(workers) + ".ppm";
+		vector<string> extra;
+		extra.push_back("--workers");
+		extra.push_back(to_string(workers));
+		double seconds = render(opts, image, extra, err);
+		if (seconds < 0) return 1;
+		if (workers == 1) one_worker = seconds;
+		bool same = read_file(image) == reference;
+		printf("%7d  %8.3f  %7.2f  %9.0f%%%s\n", workers, seconds, one_worker / seconds,
+			100 * one_worker / seconds / workers, same ? "" : "  IMAGE DIFFERS");
+		if (!same) passed = false;
+	}
+
+	const char* faults[] = { "crash:20", "hang:20" };
+	for (int f = 0; f < 2; f++) {
+		string image = dir + "/fault" + to_string(f) + ".ppm";
+		vector<string> extra;
+		extra.push_back("--workers");
+		extra.push_back("3");
+		extra.push_back("--inject-fault");
+		extra.push_back(faults[f]);
+		double seconds = render(opts, image, extra, err);
+		if (seconds < 0) return 1;
+		bool same = read_file(image) == reference;
+		cout << "--inject-fault " << faults[f] << ": " << seconds << " s, " << summary(err)
+			<< (same ? ", image identical" : ", IMAGE DIFFERS") << endl;
+		if (!same) passed = false;
+	}
+
+	string cleanup = "rm -rf " + dir;
+	if (system(cleanup.c_str()) != 0) cerr << "couldn't remove " << dir << endl;
+	return passed ? 0 : 1;
+}
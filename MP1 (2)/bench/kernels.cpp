@@ -0,0 +1,356 @@
+/*
+*	Microbenchmarks for the per-ray kernels on their own.
+*	compile using: g++ bench/kernels.cpp -std=c++11 -O2 -pthread -o kernels_bench
+*	./kernels_bench [--rays N] [--repeat R] [--filter TEXT] [--label TEXT] [--json FILE]
+*	Times sphere, triangle and plane hit() in both precisions and
+*	hittable_list::hit over fixed-seed ray sets:
+*	- hit: rays aimed inside the object
+*	- miss: rays aimed well past it
+*	- grazing: rays that just touch the silhouette or skim the surface,
+*	  where the tests are slowest to decide and least stable
+*	plus camera::get_ray, the sample patterns and phong() per call.
+*	Each test runs --repeat times (5 by default) and the fastest run is
+*	reported as ns per ray, rays per second and cycles per ray. Cycles
+*	are time stamp counter ticks, which run at the nominal clock rather
+*	than the boosted one, and are 0 where there is no counter.
+*	--json writes the results together with the compiler and the
+*	instruction sets it targeted, so runs built with different flags or
+*	on different machines can be compared. --label names the run there
+*	(e.g. the flags used).
+*/
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "../util/hittable.h"
+#include "../util/sphere.cpp"
+#include "../util/triangle.cpp"
+#include "../util/plane.cpp"
+#include "../util/hittable_list.cpp"
+#include "../util/sampler.cpp"
+#include "../util/shading.cpp"
+#include "../util/util.h"
+#include "../util/camera.h"
+
+using namespace std;
+
+/* Reads the time stamp counter, or 0 where there isn't one.
+*/
+inline uint64_t cycles_now() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* Fixed-seed uniform numbers in [0,1): number dim of item i of set seed.
+*	The same on every machine and build.
+*/
+inline double fixed_random(unsigned seed, int i, unsigned dim) {
+	return counter_rng(i, 0, 0, seed).uniform(dim);
+}
+
+inline double fixed_random(unsigned seed, int i, unsigned dim, double lo, double hi) {
+	return lo + (hi - lo) * fixed_random(seed, i, dim);
+}
+
+/* A uniformly distributed unit vector.
+*/
+vec3 fixed_direction(unsigned seed, int i) {
+	double z = fixed_random(seed, i, 10, -1, 1);
+	double a = fixed_random(seed, i, 11, 0, 2*pi);
+	double r = sqrt(1 - z*z);
+	return vec3(r*cos(a), r*sin(a), z);
+}
+
+/* Any unit vector perpendicular to d.
+*/
+vec3 perpendicular(const vec3& d) {
+	vec3 a = (fabs(d.x()) < 0.9) ? vec3(1,0,0) : vec3(0,1,0);
+	return normalize(cross(d, a));
+}
+
+struct result {
+	string name;
+	string set;
+	long long rays;
+	double ns_per_ray;
+	double rays_per_second;
+	double cycles_per_ray;
+	double checksum;	// keeps the work from being optimized away
+};
+
+struct bench_options {
+	int rays = 200000;
+	int repeat = 5;
+	string filter;
+	string label;
+	string json;
+};
+
+/* Runs fn(i) for i in [0,count) repeat times and keeps the fastest run.
+*	@name: test name
+*	@set: ray set name, "-" for tests that aren't ray based
+*	@count: calls per run
+*	@opts: repeat count and filter
+*	@out: receives the result unless the filter skips the test
+*	@fn: returns a value to fold into the checksum
+*/
+template <typename Fn>
+void measure(const string& name, const string& set, int count, const bench_options& opts,
+	vector<result>& out, Fn fn) {
+	string full = name + " " + set;
+	if (!opts.filter.empty() && full.find(opts.filter) == string::npos) return;
+	double best_seconds = 1e300;
+	uint64_t best_cycles = 0;
+	double checksum = 0;
+	for (int run = 0; run < opts.repeat; run++) {
+		double sum = 0;
+		auto start = chrono::steady_clock::now();
+		uint64_t c0 = cycles_now();
+		for (int i = 0; i < count; i++) sum += fn(i);
+		uint64_t c1 = cycles_now();
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (seconds < best_seconds) {
+			best_seconds = seconds;
+			best_cycles = c1 - c0;
+		}
+		checksum = sum;
+	}
+	result r;
+	r.name = name;
+	r.set = set;
+	r.rays = count;
+	r.ns_per_ray = best_seconds * 1e9 / count;
+	r.rays_per_second = count / best_seconds;
+	r.cycles_per_ray = double(best_cycles) / count;
+	r.checksum = checksum;
+	out.push_back(r);
+	printf("%-26s %-8s %10.2f ns/ray %12.0f rays/s %9.1f cycles  (checksum %g)\n", name.c_str(), set.c_str(),
+		r.ns_per_ray, r.rays_per_second, r.cycles_per_ray, r.checksum);
+}
+
+/* Times obj.hit() on the rays of each set.
+*	@name: test name
+*	@obj: the object
+*	@sets: names and rays of the sets
+*/
+void measure_hit(const string& name, const hittable& obj, const vector<pair<string, vector<ray> > >& sets,
+	const bench_options& opts, vector<result>& out) {
+	for (size_t s = 0; s < sets.size(); s++) {
+		const vector<ray>& rays = sets[s].second;
+		measure(name, sets[s].first, int(rays.size()), opts, out, [&](int i) {
+			hit_record rec;
+			return obj.hit(rays[i], 0, infinity, rec) ? rec.t : 0.0;
+		});
+	}
+}
+
+/* Rays from a shell around a sphere of radius r at the origin, aimed
+*	at points at distance [lo,hi)*r from the center across the ray.
+*/
+vector<ray> sphere_rays(unsigned seed, int count, double r, double lo, double hi) {
+	vector<ray> rays;
+	for (int i = 0; i < count; i++) {
+		vec3 o = 10*r * fixed_direction(seed, i);
+		vec3 d = normalize(-o);
+		vec3 side = perpendicular(d);
+		double offset = fixed_random(seed, i, 0, lo, hi) * r;
+		rays.push_back(ray(o, normalize(offset*side - o)));
+	}
+	return rays;
+}
+
+/* Rays at the triangle (-1,-1,0) (1,-1,0) (0,1,0) or the plane z = 0.
+*	hit: from above, at points inside the triangle
+*	miss: from above, at points well outside it
+*	grazing: from the side, almost parallel to z = 0, just above or
+*	  below the surface
+*/
+vector<ray> flat_rays(unsigned seed, int count, const string& kind) {
+	vector<ray> rays;
+	for (int i = 0; i < count; i++) {
+		double a = fixed_random(seed, i, 0);
+		double b = fixed_random(seed, i, 1);
+		if (a + b > 1) { a = 1 - a; b = 1 - b; }
+		vec3 inside = vec3(-1,-1,0) + a*vec3(2,0,0) + b*vec3(1,2,0);
+		if (kind == "hit") {
+			vec3 o = vec3(fixed_random(seed, i, 2, -3, 3), fixed_random(seed, i, 3, -3, 3), 5);
+			rays.push_back(ray(o, normalize(inside - o)));
+		} else if (kind == "miss") {
+			double angle = fixed_random(seed, i, 2, 0, 2*pi);
+			vec3 outside = vec3(4*cos(angle), 4*sin(angle), 0);
+			vec3 o = vec3(fixed_random(seed, i, 3, -3, 3), fixed_random(seed, i, 4, -3, 3), 5);
+			rays.push_back(ray(o, normalize(outside - o)));
+		} else {
+			double height = fixed_random(seed, i, 2, -1e-3, 1e-3);
+			vec3 o = inside + vec3(-50, fixed_random(seed, i, 3, -1, 1), height);
+			rays.push_back(ray(o, normalize(inside - o)));
+		}
+	}
+	return rays;
+}
+
+/* Writes the results as JSON.
+*/
+bool write_json(const string& path, const bench_options& opts, const vector<result>& results) {
+	ofstream out(path.c_str());
+	out << "{\n";
+	out << "  \"label\": \"" << opts.label << "\",\n";
+	out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+	out << "  \"optimized\": " <<
+#ifdef __OPTIMIZE__
+		"true"
+#else
+		"false"
+#endif
+		<< ",\n";
+	out << "  \"isa\": [";
+	const char* sep = "";
+	(void)sep;	// only used when some ISA is enabled
+#ifdef __SSE4_2__
+	out << sep << "\"sse4.2\""; sep = ", ";
+#endif
+#ifdef __AVX2__
+	out << sep << "\"avx2\""; sep = ", ";
+#endif
+#ifdef __FMA__
+	out << sep << "\"fma\""; sep = ", ";
+#endif
+#ifdef __AVX512F__
+	out << sep << "\"avx512f\""; sep = ", ";
+#endif
+	out << "],\n";
+	out << "  \"repeat\": " << opts.repeat << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const result& r = results[i];
+		out << "    {\"name\": \"" << r.name << "\", \"set\": \"" << r.set << "\", \"rays\": " << r.rays
+			<< ", \"ns_per_ray\": " << r.ns_per_ray << ", \"rays_per_second\": " << r.rays_per_second
+			<< ", \"cycles_per_ray\": " << r.cycles_per_ray << ", \"checksum\": " << r.checksum << "}"
+			<< ((i + 1 < results.size()) ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return bool(out);
+}
+
+int main(int argc, char** args) {
+	bench_options opts;
+	for (int i = 1; i < argc; i++) {
+		string a = args[i];
+		bool has_value = i + 1 < argc;
+		if (a == "--rays" && has_value) opts.rays = atoi(args[++i]);
+		else if (a == "--repeat" && has_value) opts.repeat = atoi(args[++i]);
+		else if (a == "--filter" && has_value) opts.filter = args[++i];
+		else if (a == "--label" && has_value) opts.label = args[++i];
+		else if (a == "--json" && has_value) opts.json = args[++i];
+		else {
+			cerr << "usage: " << args[0] << " [--rays N] [--repeat R] [--filter TEXT] [--label TEXT] [--json FILE]" << endl;
+			return 1;
+		}
+	}
+	if (opts.rays < 1) opts.rays = 1;
+	if (opts.repeat < 1) opts.repeat = 1;
+	const int n = opts.rays;
+	vector<result> results;
+
+	// primitives, each over its own hit, miss and grazing sets
+	vector<pair<string, vector<ray> > > round;
+	round.push_back(make_pair(string("hit"), sphere_rays(1, n, 1, 0, 0.9)));
+	round.push_back(make_pair(string("miss"), sphere_rays(2, n, 1, 1.5, 5)));
+	round.push_back(make_pair(string("grazing"), sphere_rays(3, n, 1, 1 - 1e-6, 1 + 1e-6)));
+	vector<pair<string, vector<ray> > > flat;
+	flat.push_back(make_pair(string("hit"), flat_rays(4, n, "hit")));
+	flat.push_back(make_pair(string("miss"), flat_rays(5, n, "miss")));
+	flat.push_back(make_pair(string("grazing"), flat_rays(6, n, "grazing")));
+
+	vec3 kd = vec3(0.5,0.4,0.8);
+	vec3 ld = vec3(1,1,1);
+	sphere s(vec3(0,0,0), 1, kd, ld);
+	spheref sf(vec3f(0,0,0), 1, vec3f(kd), vec3f(ld));
+	triangle t(vec3(-1,-1,0), vec3(1,-1,0), vec3(0,1,0), kd, ld);
+	trianglef tf(vec3f(-1,-1,0), vec3f(1,-1,0), vec3f(0,1,0), vec3f(kd), vec3f(ld));
+	plane p(vec3(0,0,0), vec3(0,0,1), kd, ld);
+	planef pf(vec3f(0,0,0), vec3f(0,0,1), vec3f(kd), vec3f(ld));
+
+	measure_hit("sphere::hit", s, round, opts, results);
+	measure_hit("spheref::hit", sf, round, opts, results);
+	measure_hit("triangle::hit", t, flat, opts, results);
+	measure_hit("trianglef::hit", tf, flat, opts, results);
+
+	// a plane is infinite: rays miss it by pointing away from it
+	vector<pair<string, vector<ray> > > planar = flat;
+	for (size_t i = 0; i < planar[1].second.size(); i++) {
+		ray r = planar[1].second[i];
+		planar[1].second[i] = ray(r.origin(), -r.direction());
+	}
+	measure_hit("plane::hit", p, planar, opts, results);
+	measure_hit("planef::hit", pf, planar, opts, results);
+
+	// the default scene of mp1, seen from its camera
+	hittable_list world;
+	world.add(make_shared<plane>(vec3(0,0,-400), vec3(0,0,1), vec3(0.8,0.5,0.8), vec3(1,0.4,0.6)));
+	world.add(make_shared<triangle>(vec3(50-100,50-100,100), vec3(0-100,-50-100,100), vec3(100-100,-50-100,100), vec3(0.5,0.4,0.8), vec3(0.5,0.5,0.5)));
+	world.add(make_shared<sphere>(vec3(-50,0,0),49.99,vec3(0,0,1),vec3(1,1,1)));
+	world.add(make_shared<sphere>(vec3(0,-100.5,0),100,vec3(66.0/255.0, 221.0/255.0, 245.0/255.0),vec3(1,1,1)));
+	world.compile();
+	camera cam(1, vec3(-250,250,400), vec3(0,0,-1), vec3(0,1,0), 1, false);
+	vector<pair<string, vector<ray> > > scene;
+	{
+		vector<ray> hit, miss, grazing;
+		vec3 eye = vec3(-250,250,400);
+		for (int i = 0; i < n; i++) {
+			// at the spheres; away from the plane; past the big sphere's rim
+			vec3 target = (i % 2) ? vec3(-50,0,0) + 40*fixed_direction(7, i) : vec3(0,-100.5,0) + 80*fixed_direction(7, i);
+			hit.push_back(ray(eye, normalize(target - eye)));
+			miss.push_back(ray(eye, normalize(vec3(fixed_random(8, i, 0, -1, 1), fixed_random(8, i, 1, -1, 1), 1))));
+			vec3 d = normalize(vec3(0,-100.5,0) - eye);
+			vec3 side = perpendicular(d);
+			double angle = fixed_random(9, i, 0, 0, 2*pi);
+			vec3 rim = cos(angle)*side + sin(angle)*normalize(cross(d, side));
+			grazing.push_back(ray(eye, normalize(vec3(0,-100.5,0) + 100*(1 + fixed_random(9, i, 1, -1e-6, 1e-6))*rim - eye)));
+		}
+		scene.push_back(make_pair(string("hit"), hit));
+		scene.push_back(make_pair(string("miss"), miss));
+		scene.push_back(make_pair(string("grazing"), grazing));
+	}
+	measure_hit("hittable_list::hit", world, scene, opts, results);
+
+	measure("camera::get_ray", "-", n, opts, results, [&](int i) {
+		ray r = cam.get_ray(i % 400 - 200, i / 400 % 400 - 200);
+		return r.direction().x();
+	});
+
+	const char* patterns[] = { "mj", "sobol", "random" };
+	for (int k = 0; k < 3; k++) {
+		sampler::pattern pattern;
+		sampler::parse(patterns[k], pattern);
+		sampler samples(pattern, 100);
+		measure(string("sampler::get ") + patterns[k], "-", n, opts, results, [&](int i) {
+			return samples.get(i % 400, i / 400 % 400, i % 100).x();
+		});
+	}
+
+	vector<vec3> points(n), normals(n);
+	for (int i = 0; i < n; i++) {
+		points[i] = 100 * fixed_direction(10, i);
+		normals[i] = fixed_direction(11, i);
+	}
+	measure("phong", "-", n, opts, results, [&](int i) {
+		return phong(points[i], normals[i], kd, ld).x();
+	});
+
+	if (!opts.json.empty() && !write_json(opts.json, opts, results)) {
+		cerr << "couldn't write " << opts.json << endl;
+		return 1;
+	}
+	return 0;
+}
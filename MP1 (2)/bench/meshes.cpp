@@ -0,0 +1,171 @@
+/*
+*	Load time and memory benchmark for indexed triangle meshes.
+*	compile using: g++ bench/meshes.cpp -std=c++11 -O2 -pthread -o meshes_bench
+*	./meshes_bench [grid size] [threads] [obj file]
+*	Writes a grid x grid heightfield (2 triangles per cell, 2237 gives
+*	about 10M triangles) as a Wavefront OBJ file unless the file already
+*	exists, then loads it with one parser thread and with [threads]
+*	(every hardware thread by default), compiles the mesh and reports
+*	load rate, BVH build time, the mesh's memory against the raw vertex
+*	and index size and against one triangle object per face, peak RSS
+*	and closest-hit and occlusion rays/sec.
+*/
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "../util/hittable.h"
+#include "../util/triangle.cpp"
+#include "../util/hittable_list.cpp"
+#include "../util/bvh.cpp"
+#include "../util/triangle_mesh.cpp"
+#include "../util/obj_loader.cpp"
+#include "../util/util.h"
+
+using namespace std;
+
+/* Height of the heightfield at (x,z).
+*/
+double height(double x, double z) {
+	return 4*sin(x*0.05) * cos(z*0.07) + 2*sin((x+z)*0.13);
+}
+
+/* Writes the heightfield over [-100,100]^2 as OBJ, with shared vertices.
+*	@path: where to write
+*	@n: number of cells per side
+*	returns false if the file can't be written.
+*/
+bool write_heightfield(const string& path, int n) {
+	FILE* out = fopen(path.c_str(), "w");
+	if (!out) return false;
+	double cell = 200.0 / n;
+	fprintf(out, "# %d x %d heightfield\no heightfield\n", n, n);
+	for (int k = 0; k <= n; k++) {
+		for (int i = 0; i <= n; i++) {
+			double x = -100 + i*cell, z = -100 + k*cell;
+			fprintf(out, "v %.6f %.6f %.6f\n", x, height(x,z), z);
+		}
+	}
+	for (int k = 0; k < n; k++) {
+		for (int i = 0; i < n; i++) {
+			long a = long(k)*(n+1) + i + 1, b = a + 1, d = a + n + 1, c = d + 1;
+			fprintf(out, "f %ld %ld %ld\nf %ld %ld %ld\n", a, d, c, a, c, b);
+		}
+	}
+	return fclose(out) == 0;
+}
+
+/* Runs fn over every ray and reports the rate.
+*	@name: label to print
+*	@rays: the ray set
+*	@fn: returns true on a hit
+*/
+template <typename Fn>
+void measure(const char* name, const vector<ray>& rays, Fn fn) {
+	auto start = chrono::steady_clock::now();
+	int hits = 0;
+	for (size_t i = 0; i < rays.size(); i++) {
+		if (fn(rays[i])) hits++;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << name << ": " << rays.size() / seconds / 1e6 << " Mrays/s ("
+		<< hits << " hits, " << seconds << " s)" << endl;
+}
+
+/* Loads the file into mesh and reports the rate.
+*	returns the seconds taken, or a negative number on failure.
+*/
+double timed_load(const string& path, triangle_mesh& mesh, int threads, double file_mb) {
+	string error;
+	auto start = chrono::steady_clock::now();
+	if (!load_obj(path, mesh, error, threads)) {
+		cerr << error << endl;
+		return -1;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << "load, " << threads << " threads: " << seconds << " s, " << file_mb / seconds << " MB/s, "
+		<< mesh.triangle_count() / seconds / 1e6 << " Mtriangles/s" << endl;
+	return seconds;
+}
+
+int main(int argc, char** args) {
+	int grid = (argc > 1) ? atoi(args[1]) : 2237;
+	int threads = (argc > 2) ? atoi(args[2]) : 0;
+	string path = (argc > 3) ? args[3] : "heightfield.obj";
+	if (threads <= 0) threads = int(thread::hardware_concurrency());
+	if (threads < 1) threads = 1;
+
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		auto start = chrono::steady_clock::now();
+		if (!write_heightfield(path, grid) || stat(path.c_str(), &st) != 0) {
+			cerr << "can't write " << path << endl;
+			return 1;
+		}
+		cout << "wrote " << path << " in " << chrono::duration<double>(chrono::steady_clock::now() - start).count()
+			<< " s" << endl;
+	}
+	double file_mb = st.st_size / (1024.0 * 1024.0);
+	cout << path << ": " << file_mb << " MB" << endl;
+
+	triangle_mesh mesh(vec3(0.5,0.4,0.8), vec3(1,1,1));
+	if (threads > 1) {
+		// the parallel load has to give the same buffers as the serial one
+		triangle_mesh serial;
+		if (timed_load(path, serial, 1, file_mb) < 0) return 1;
+		if (timed_load(path, mesh, threads, file_mb) < 0) return 1;
+		if (serial.vertices.size() != mesh.vertices.size() || serial.indices != mesh.indices
+			|| memcmp(serial.vertices.data(), mesh.vertices.data(), mesh.vertices.size() * sizeof(vec3)) != 0) {
+			cerr << "parallel load differs from the serial load" << endl;
+			return 1;
+		}
+	} else if (timed_load(path, mesh, 1, file_mb) < 0) {
+		return 1;
+	}
+
+	double raw_mb = (mesh.vertices.size() * sizeof(vec3) + mesh.indices.size() * sizeof(int32_t)) / (1024.0 * 1024.0);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	cout << "vertices and indices " << raw_mb << " MB, peak RSS after loading " << usage.ru_maxrss / 1024.0 << " MB" << endl;
+
+	auto start = chrono::steady_clock::now();
+	mesh.compile();
+	cout << mesh.vertices.size() << " vertices, " << mesh.triangle_count() << " triangles, bvh of "
+		<< mesh.node_count() << " nodes built in "
+		<< chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1000 << " ms" << endl;
+
+	// one triangle object per face costs the object, make_shared's
+	// control block (two counts and a vtable) and the list's shared_ptr
+	double objects_mb = mesh.triangle_count() * (sizeof(triangle) + 2*sizeof(long) + sizeof(void*)
+		+ sizeof(shared_ptr<hittable>)) / (1024.0 * 1024.0);
+	double mesh_mb = mesh.memory_bytes() / (1024.0 * 1024.0);
+	getrusage(RUSAGE_SELF, &usage);
+	cout << "memory: mesh with bvh " << mesh_mb << " MB (" << mesh.memory_bytes() / double(mesh.triangle_count())
+		<< " bytes/triangle), as triangle objects at least " << objects_mb << " MB before their BVH, peak RSS "
+		<< usage.ru_maxrss / 1024.0 << " MB" << endl;
+
+	// fixed seed so every build traces the same rays
+	srand(1234);
+	const int count = 1000000;
+	vector<ray> primary, shadow;
+	vec3 light = vec3(-500, 800, 300);
+	for (int i = 0; i < count; i++) {
+		vec3 o = vec3(random_double(-120,120), 60, random_double(-120,120));
+		vec3 target = vec3(random_double(-100,100), 0, random_double(-100,100));
+		primary.push_back(ray(o, normalize(target - o)));
+		vec3 p = vec3(target.x(), height(target.x(), target.z()) + 1e-3, target.z());
+		shadow.push_back(ray(p, normalize(light - p)));
+	}
+	measure("closest hit", primary, [&](const ray& r) {
+		hit_record rec;
+		return mesh.hit(r, 0, infinity, rec);
+	});
+	measure("occluded", shadow, [&](const ray& r) {
+		return mesh.occluded(r, 0, infinity);
+	});
+	return 0;
+}
@@ -0,0 +1,389 @@
+/*
+*	End-to-end benchmark over the built-in scenes (see util/scenes.h).
+*	compile using: g++ bench/scenes.cpp -std=c++11 -O2 -o scenes_bench
+*	./scenes_bench [--mp1 PATH] [--golden DIR] [--update-golden] [--repeat R]
+*		[--threads N] [--filter TEXT] [--extra FLAG]... [--json FILE]
+*		[--baseline FILE] [--threshold X] [--min-psnr DB]
+*	Renders every scene with mp1 at fixed settings and reports, per scene:
+*	- wall time of the whole process, scene and BVH build included
+*	- render time and primary rays (samples) per second, as printed by
+*	  mp1 on its "render:" line; shadow rays are not counted
+*	- peak resident memory of the process
+*	- a checksum of the image and its PSNR against the golden image in
+*	  --golden (bench/golden by default); identical images show inf
+*	Each scene runs --repeat times (3 by default) and the fastest is kept.
+*	--extra passes a flag to every mp1 run, e.g. --extra --accel --extra soa.
+*	The run fails (exit status 1) when an image is missing its golden
+*	image or is below --min-psnr dB (40 by default) against it, or when
+*	mp1 reports --packet bundles it had to trace ray by ray for want of a
+*	frustum (with --extra --packet --extra 4 --extra --stats --extra
+*	/dev/null, say), or when
+*	--baseline is given and a scene's rays per second fell more than
+*	--threshold (0.1 = 10% by default) below the baseline's. A baseline is
+*	the --json output of an earlier run on the same machine; throughput
+*	is not comparable across machines.
+*	--update-golden replaces the golden images with this run's.
+*/
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/* One benchmark: a scene and the settings it always renders with.
+*/
+struct bench_case {
+	const char* scene;
+	int width;
+	int height;
+	int spp;
+};
+
+// changing these invalidates the golden images and every baseline
+const bench_case cases[] = {
+	{ "default", 400, 400, 16 },
+	{ "shadows", 400, 400, 16 },
+	{ "spheres10k", 400, 400, 4 },
+	{ "triangles1m", 400, 400, 4 },
+	{ "instances10k", 400, 400, 4 },
+};
+
+struct result {
+	string scene;
+	double wall_seconds;
+	double render_seconds;
+	double rays_per_second;
+	long peak_rss_kb;
+	uint64_t checksum;
+	double psnr;			// infinity for an identical image, -1 without a golden image
+	bool passed;
+	string failure;
+};
+
+struct bench_options {
+	string mp1 = "./mp1";
+	string golden = "bench/golden";
+	bool update_golden = false;
+	int repeat = 3;
+	int threads = 0;
+	string filter;
+	vector<string> extra;
+	string json;
+	string baseline;
+	double threshold = 0.1;
+	double min_psnr = 40;
+};
+
+/* Runs a command, collecting its standard error.
+*	@argv: the command and its arguments
+*	@err: receives what it wrote to standard error
+*	@usage: receives its resource usage
+*	@wall: receives the seconds it ran for
+*	returns its exit status, or -1 if it could not be run or was killed.
+*/
+int run(const vector<string>& argv, string& err, struct rusage& usage, double& wall) {
+	int fds[2];
+	if (pipe(fds) != 0) return -1;
+	struct timeval start, end;
+	gettimeofday(&start, 0);
+	pid_t pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0) {
+		dup2(fds[1], 2);
+		close(fds[0]);
+		close(fds[1]);
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0) dup2(null, 1);
+		vector<char*> args;
+		for (size_t i = 0; i < argv.size(); i++) args.push_back(const_cast<char*>(argv[i].c_str()));
+		args.push_back(0);
+		execv(args[0], &args[0]);
+		perror(args[0]);
+		_exit(127);
+	}
+	close(fds[1]);
+	err.clear();
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) err.append(buffer, n);
+	close(fds[0]);
+	int status = 0;
+	if (wait4(pid, &status, 0, &usage) < 0) return -1;
+	gettimeofday(&end, 0);
+	wall = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Reads the pixels of a binary 8 bit ppm.
+*	returns false if the file is missing or not one.
+*/
+bool read_p6(const string& path, int& w, int& h, vector<unsigned char>& pixels) {
+	ifstream in(path.c_str(), ios::binary);
+	string magic;
+	int maxval;
+	if (!(in >> magic >> w >> h >> maxval) || magic != "P6" || maxval != 255) return false;
+	in.get();
+	pixels.resize(size_t(w) * h * 3);
+	in.read(reinterpret_cast<char*>(&pixels[0]), pixels.size());
+	return bool(in);
+}
+
+/* 64 bit FNV-1a hash of the pixels.
+*/
+uint64_t checksum(const vector<unsigned char>& pixels) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < pixels.size(); i++) {
+		hash ^= pixels[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/* Peak signal to noise ratio of an image against a reference of the
+*	same size, in dB.
+*/
+double psnr(const vector<unsigned char>& a, const vector<unsigned char>& reference) {
+	double sum = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		double d = double(a[i]) - double(reference[i]);
+		sum += d * d;
+	}
+	if (sum == 0) return INFINITY;
+	return 10 * log10(255.0 * 255.0 / (sum / a.size()));
+}
+
+/* Reads the rays per second of each scene from an earlier --json output.
+*	returns false if the file can't be read.
+*/
+bool read_baseline(const string& path, map<string, double>& rays_per_second) {
+	ifstream in(path.c_str());
+	if (!in) return false;
+	string line;
+	while (getline(in, line)) {
+		size_t s = line.find("\"scene\": \"");
+		size_t r = line.find("\"rays_per_second\": ");
+		if (s == string::npos || r == string::npos) continue;
+		s += 10;
+		string scene = line.substr(s, line.find('"', s) - s);
+		rays_per_second[scene] = atof(line.c_str() + r + 19);
+	}
+	return true;
+}
+
+/* Renders one scene --repeat times and checks it against its golden
+*	image.
+*	@c: the scene and its settings
+*	@opts: runner options
+*	@dir: scratch directory for the images
+*	returns the result of the fastest run.
+*/
+result bench(const bench_case& c, const bench_options& opts, const string& dir) {
+	result r;
+	r.scene = c.scene;
+	r.wall_seconds = r.render_seconds = r.rays_per_second = 0;
+	r.peak_rss_kb = 0;
+	r.checksum = 0;
+	r.psnr = -1;
+	r.passed = false;
+
+	string image = dir + "/" + c.scene + ".ppm";
+	vector<string> argv;
+	argv.push_back(opts.mp1);
+	argv.push_back("0");
+	argv.push_back(to_string(c.width));
+	argv.push_back("1");
+	argv.push_back(to_string(c.height));
+	argv.push_back("--scene");
+	argv.push_back(c.scene);
+	argv.push_back("--spp");
+	argv.push_back(to_string(c.spp));
+	argv.push_back("--format");
+	argv.push_back("p6");
+	argv.push_back("--output");
+	argv.push_back(image);
+	if (opts.threads > 0) {
+		argv.push_back("--threads");
+		argv.push_back(to_string(opts.threads));
+	}
+	argv.insert(argv.end(), opts.extra.begin(), opts.extra.end());
+
+	string err;
+	for (int k = 0; k < opts.repeat; k++) {
+		struct rusage usage;
+		double wall = 0;
+		int status = run(argv, err, usage, wall);
+		size_t line = err.find("render: ");
+		if (status != 0 || line == string::npos) {
+			r.failure = "mp1 failed:\n" + err;
+			return r;
+		}
+		double seconds = atof(err.c_str() + line + 8);
+		if (k == 0 || seconds < r.render_seconds) {
+			r.render_seconds = seconds;
+			r.wall_seconds = wall;
+			r.rays_per_second = double(c.width) * c.height * c.spp / seconds;
+			r.peak_rss_kb = usage.ru_maxrss;
+		}
+	}
+
+	// --stats: every packet must be bounded, or its culling is lost
+	size_t packets = err.find("  packets: ");
+	if (packets != string::npos) {
+		long long traced = 0, unbounded = 0;
+		if (sscanf(err.c_str() + packets, "  packets: %lld traced, %lld", &traced, &unbounded) == 2 && unbounded > 0) {
+			ostringstream why;
+			why << unbounded << " of " << traced << " packets had no frustum";
+			r.failure = why.str();
+			return r;
+		}
+	}
+
+	int w, h;
+	vector<unsigned char> pixels;
+	if (!read_p6(image, w, h, pixels)) {
+		r.failure = "couldn't read " + image;
+		return r;
+	}
+	r.checksum = checksum(pixels);
+
+	string golden = opts.golden + "/" + c.scene + ".ppm";
+	if (opts.update_golden) {
+		ifstream in(image.c_str(), ios::binary);
+		ofstream out(golden.c_str(), ios::binary);
+		out << in.rdbuf();
+		if (!out) {
+			r.failure = "couldn't write " + golden;
+			return r;
+		}
+	}
+	int gw, gh;
+	vector<unsigned char> reference;
+	if (!read_p6(golden, gw, gh, reference)) {
+		r.failure = "no golden image " + golden + " (make it with --update-golden)";
+		return r;
+	}
+	if (gw != w || gh != h) {
+		r.failure = golden + " is a different size";
+		return r;
+	}
+	r.psnr = psnr(pixels, reference);
+	if (r.psnr < opts.min_psnr) {
+		ostringstream why;
+		why << "PSNR " << r.psnr << " dB against " << golden << " is below " << opts.min_psnr;
+		r.failure = why.str();
+		return r;
+	}
+	r.passed = true;
+	return r;
+}
+
+/* Writes the results as JSON, one scene per line so a later run can read
+*	it back as a baseline.
+*/
+bool write_json(const string& path, const bench_options& opts, const vector<result>& results) {
+	ofstream out(path.c_str());
+	out << "{\n";
+	out << "  \"repeat\": " << opts.repeat << ",\n";
+	out << "  \"threads\": " << opts.threads << ",\n";
+	out << "  \"extra\": \"";
+	for (size_t i = 0; i < opts.extra.size(); i++) out << (i ? " " : "") << opts.extra[i];
+	out << "\",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const result& r = results[i];
+		char hash[32];
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)r.checksum);
+		out << "    {\"scene\": \"" << r.scene << "\", \"wall_seconds\": " << r.wall_seconds
+			<< ", \"render_seconds\": " << r.render_seconds << ", \"rays_per_second\": " << r.rays_per_second
+			<< ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"checksum\": \"" << hash << "\", \"psnr\": ";
+		if (std::isinf(r.psnr) || r.psnr < 0) out << "null"; else out << r.psnr;
+		out << ", \"passed\": " << (r.passed ? "true" : "false") << "}"
+			<< ((i + 1 < results.size()) ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return bool(out);
+}
+
+int main(int argc, char** args) {
+	bench_options opts;
+	for (int i = 1; i < argc; i++) {
+		string a = args[i];
+		bool has_value = i + 1 < argc;
+		if (a == "--mp1" && has_value) opts.mp1 = args[++i];
+		else if (a == "--golden" && has_value) opts.golden = args[++i];
+		else if (a == "--update-golden") opts.update_golden = true;
+		else if (a == "--repeat" && has_value) opts.repeat = atoi(args[++i]);
+		else if (a == "--threads" && has_value) opts.threads = atoi(args[++i]);
+		else if (a == "--filter" && has_value) opts.filter = args[++i];
+		else if (a == "--extra" && has_value) opts.extra.push_back(args[++i]);
+		else if (a == "--json" && has_value) opts.json = args[++i];
+		else if (a == "--baseline" && has_value) opts.baseline = args[++i];
+		else if (a == "--threshold" && has_value) opts.threshold = atof(args[++i]);
+		else if (a == "--min-psnr" && has_value) opts.min_psnr = atof(args[++i]);
+		else {
+			cerr << "usage: " << args[0] << " [--mp1 PATH] [--golden DIR] [--update-golden] [--repeat R]"
+				<< " [--threads N] [--filter TEXT] [--extra FLAG]... [--json FILE]"
+				<< " [--baseline FILE] [--threshold X] [--min-psnr DB]" << endl;
+			return 1;
+		}
+	}
+	if (opts.repeat < 1) opts.repeat = 1;
+
+	map<string, double> baseline;
+	if (!opts.baseline.empty() && !read_baseline(opts.baseline, baseline)) {
+		cerr << "couldn't read baseline " << opts.baseline << endl;
+		return 1;
+	}
+	char dir[] = "/tmp/mp1_scenes_XXXXXX";
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	bool failed = false;
+	vector<result> results;
+	printf("%-12s %8s %8s %12s %9s %16s %8s\n", "scene", "wall s", "render s", "rays/s", "RSS MB", "checksum", "PSNR");
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		if (!opts.filter.empty() && string(cases[i].scene).find(opts.filter) == string::npos) continue;
+		result r = bench(cases[i], opts, dir);
+		if (r.passed && baseline.count(r.scene)) {
+			double before = baseline[r.scene];
+			if (r.rays_per_second < (1 - opts.threshold) * before) {
+				ostringstream why;
+				why << "throughput regressed " << 100 * (1 - r.rays_per_second / before) << "% ("
+					<< r.rays_per_second << " rays/s, baseline " << before << ")";
+				r.failure = why.str();
+				r.passed = false;
+			}
+		}
+		printf("%-12s %8.3f %8.3f %12.0f %9.1f %016llx %8.2f %s\n", r.scene.c_str(), r.wall_seconds, r.render_seconds,
+			r.rays_per_second, r.peak_rss_kb / 1024.0, (unsigned long long)r.checksum, r.psnr, r.passed ? "ok" : "FAIL");
+		if (!r.passed) {
+			cerr << r.scene << ": " << r.failure << endl;
+			failed = true;
+		}
+		results.push_back(r);
+		remove((string(dir) + "/" + r.scene + ".ppm").c_str());
+	}
+	rmdir(dir);
+
+	if (!opts.json.empty() && !write_json(opts.json, opts, results)) {
+		cerr << "couldn't write " << opts.json << endl;
+		return 1;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/*
+*	Throughput benchmark for triangle heavy scenes.
+*	compile using: g++ bench/triangles.cpp -std=c++11 -O2 -pthread -o triangles_bench
+*	./triangles_bench [grid size] [rays]
+*	Builds a grid x grid heightfield (2 triangles per cell), compiles it,
+*	puts it in a BVH and reports closest-hit and occlusion rays/sec for
+*	a fixed set of rays. A 16x16 heightfield is also traced with the
+*	plain hittable_list to show the cost of the triangle test on its own,
+*	and its triangles are tested against the same rays with the edges
+*	baked by compile() and with the edges worked out in every test, as
+*	triangles were before the compile step, to show what baking saves.
+*/
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include "../util/hittable.h"
+#include "../util/sphere.cpp"
+#include "../util/triangle.cpp"
+#include "../util/plane.cpp"
+#include "../util/hittable_list.cpp"
+#include "../util/bvh.cpp"
+#include "../util/util.h"
+
+using namespace std;
+
+/* Height of the heightfield at (x,z).
+*/
+double height(double x, double z) {
+	return 4*sin(x*0.05) * cos(z*0.07) + 2*sin((x+z)*0.13);
+}
+
+/* Builds the heightfield over [-100,100]^2.
+*	@world: list to add the triangles to
+*	@n: number of cells per side
+*/
+void build_heightfield(hittable_list& world, int n) {
+	double cell = 200.0 / n;
+	vec3 kd = vec3(0.5,0.4,0.8);
+	vec3 ld = vec3(1,1,1);
+	for (int i = 0; i < n; i++) {
+		for (int k = 0; k < n; k++) {
+			double x0 = -100 + i*cell, x1 = x0 + cell;
+			double z0 = -100 + k*cell, z1 = z0 + cell;
+			vec3 a = vec3(x0, height(x0,z0), z0);
+			vec3 b = vec3(x1, height(x1,z0), z0);
+			vec3 c = vec3(x1, height(x1,z1), z1);
+			vec3 d = vec3(x0, height(x0,z1), z1);
+			world.add(make_shared<triangle>(a, d, c, kd, ld));
+			world.add(make_shared<triangle>(a, c, b, kd, ld));
+		}
+	}
+}
+
+/* Runs fn over every ray and reports the rate.
+*	@name: label to print
+*	@rays: the ray set
+*	@fn: returns true on a hit
+*/
+template <typename Fn>
+void measure(const char* name, const vector<ray>& rays, Fn fn) {
+	auto start = chrono::steady_clock::now();
+	int hits = 0;
+	for (size_t i = 0; i < rays.size(); i++) {
+		if (fn(rays[i])) hits++;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << name << ": " << rays.size() / seconds / 1e6 << " Mrays/s ("
+		<< hits << " hits, " << seconds << " s)" << endl;
+}
+
+int main(int argc, char** args) {
+	int grid = (argc > 1) ? atoi(args[1]) : 300;
+	int count = (argc > 2) ? atoi(args[2]) : 1000000;
+
+	hittable_list world;
+	build_heightfield(world, grid);
+	world.compile();
+	bvh tree(world);
+	cout << world.objects().size() << " triangles, bvh built in "
+		<< tree.build_seconds*1000 << " ms" << endl;
+
+	// fixed seed so every build traces the same rays
+	srand(1234);
+	vector<ray> primary, shadow;
+	vec3 light = vec3(-500, 800, 300);
+	for (int i = 0; i < count; i++) {
+		vec3 o = vec3(random_double(-120,120), 60, random_double(-120,120));
+		vec3 target = vec3(random_double(-100,100), 0, random_double(-100,100));
+		primary.push_back(ray(o, normalize(target - o)));
+		vec3 p = vec3(target.x(), height(target.x(), target.z()) + 1e-3, target.z());
+		shadow.push_back(ray(p, normalize(light - p)));
+	}
+
+	measure("closest hit", primary, [&](const ray& r) {
+		hit_record rec;
+		return tree.hit(r, 0, infinity, rec);
+	});
+	measure("occluded", shadow, [&](const ray& r) {
+		return tree.occluded(r, 0, infinity);
+	});
+
+	hittable_list small;
+	build_heightfield(small, 16);
+	small.compile();
+	vector<ray> few(primary.begin(), primary.begin() + count/20);
+	cout << small.objects().size() << " triangles, linear list" << endl;
+	measure("list closest hit", few, [&](const ray& r) {
+		hit_record rec;
+		return small.hit(r, 0, infinity, rec);
+	});
+	measure("list occluded", few, [&](const ray& r) {
+		return small.occluded(r, 0, infinity);
+	});
+
+	vector<const triangle*> tris;
+	for (size_t i = 0; i < small.objects().size(); i++) {
+		tris.push_back(dynamic_cast<const triangle*>(small.objects()[i].get()));
+	}
+	measure("triangle tests, baked edges", few, [&](const ray& r) {
+		bool any = false;
+		double t, u, v;
+		for (size_t i = 0; i < tris.size(); i++) {
+			any |= triangle::intersect(tris[i]->v1(), tris[i]->edge1(), tris[i]->edge2(), r, 0, infinity, t, u, v);
+		}
+		return any;
+	});
+	measure("triangle tests, edges per test", few, [&](const ray& r) {
+		bool any = false;
+		double t, u, v;
+		for (size_t i = 0; i < tris.size(); i++) {
+			vec3 v1 = tris[i]->v1();
+			any |= triangle::intersect(v1, tris[i]->v2() - v1, tris[i]->v3() - v1, r, 0, infinity, t, u, v);
+		}
+		return any;
+	});
+	return 0;
+}
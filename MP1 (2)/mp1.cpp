@@ -3,19 +3,48 @@
 *		bhushan3
 */
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <cmath>
 #include <vector>
 #include <stdio.h>
 #include <stdlib.h>
+#include <chrono>
+#include <csignal>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "util/hittable.h"
-#include "util/ray.cpp"
 #include "util/sphere.cpp"
 #include "util/triangle.cpp"
 #include "util/plane.cpp"
 #include "util/hittable_list.cpp"
+#include "util/bvh.cpp"
+#include "util/simd_kernels.cpp"
+#include "util/primitive_pool.cpp"
+#include "util/framebuffer.cpp"
+#include "util/thread_pool.cpp"
+#include "util/sampler.cpp"
+#include "util/shading.cpp"
+#include "util/ray_queue.cpp"
+#include "util/image_file.cpp"
+#include "util/checkpoint.cpp"
+#include "util/scenes.cpp"
+#include "util/triangle_mesh.cpp"
+#include "util/obj_loader.cpp"
+#include "util/instance.cpp"
+#include "util/scene_file.cpp"
+#include "util/distributed.cpp"
+#include "util/render_stats.cpp"
+#include "util/trace.cpp"
 #include "util/util.h"
 #include "util/camera.h"
+#include "util/options.h"
 
 using namespace std;
 using std::string;
@@ -81,189 +110,1049 @@ using std::string;
 * the point lies outside the triangle.
 */
 
-struct interval {
-	double min;
-	double max;
-	bool closed;
+
+/* A rectangular block of pixels rendered as one unit of work.
+*	Covers columns [x0,x1) and rows [y0,y1).
+*/
+struct tile {
+	int x0, y0;
+	int x1, y1;
+};
+
+/* Per pixel state of adaptive sampling, kept between the two passes.
+*/
+struct adaptive_pixel {
+	vec3 sum;					// sum of the sample colors
+	int samples;
+	double mean;				// running mean of the sample luminance
+	double m2;					// and sum of squared deviations from it
+	// what the first sample saw; the first pass leaves these fixed
+	const hittable* object;
+	int prim;
+	bool shadowed;
+	bool edge;					// a later sample saw something else
+};
+
+/* Time spent in each stage of the wavefront pipeline, summed over the
+*	render threads, and the rays that went through it.
+*/
+struct wavefront_stats {
+	enum stage { raygen, closest_hit, resolve, shadow_rays, occlusion, shading, stage_count };
+
+	atomic<long long> ns[stage_count];
+	atomic<long long> rays;
+	atomic<long long> shadow_rays_cast;
+
+	wavefront_stats() : rays(0), shadow_rays_cast(0) {
+		for (int i = 0; i < stage_count; i++) ns[i] = 0;
+	}
+
+	static const char* name(int stage) {
+		static const char* names[stage_count] = { "raygen", "closest-hit", "resolve", "shadow-rays", "occlusion", "shading" };
+		return names[stage];
+	}
 };
 
-// interval vector
-vector<interval> intervals; 
-
-// Phong reflection
-vec3 ka = vec3(0.5,0.3,0.7); 	// ambient material
-vec3 la = vec3(0.4,0.23,0.1);	// ambient colo
-//vec3 ka = vec3(0,0,0); 	// ambient material
-//vec3 la = vec3(0,0,0);	// ambient color
-vec3 lightPos = vec3(-500,-200,1200);
-//vec3 lightPos = vec3(1,1,1);
-//float alpha = 1;	// shininess coefficient;
-
-/* Writes the color to the output stream
-*	@out: The output stream to write the color to
-*	@pixel_color: The color to write
-*/
-void write_color(std::ostream &out, vec3 pixel_color, int samples_per_pixel) {
-    // Write the translated [0,255] value of each color component.
-	auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
-
-    // Divide the color by the number of samples.
-    auto scale = 1.0 / samples_per_pixel;
-    r *= scale;
-    g *= scale;
-    b *= scale;
-
-    out << static_cast<int>(255.999 * r) << ' '
-        << static_cast<int>(255.999 * g) << ' '
-        << static_cast<int>(255.999 * b) << '\n';
-}
-
-/* Clamps the value of components of color.
-*	to the interval [0,1]
-*	@color: The vec3 to clamp
-*	a vec3 with components clamped to [0,1].
-*/
-vec3 clamp(vec3 color) {
-	color[0] = (color[0] > 1) ? 1 : color[0];
-	color[1] = (color[1] > 1) ? 1 : color[1];
-	color[2] = (color[2] > 1) ? 1 : color[2];
-	color[0] = (color[0] < 0) ? 0 : color[0];
-	color[1] = (color[1] < 0) ? 0 : color[1];
-	color[2] = (color[2] < 0) ? 0 : color[2];
-	return color;
-}
-
-/* Does Phong Shading using Blinn-Phong model
-*	@hitpoint: The solution to the ray equation. 
-*			(The point on the ray intersecting the sphere.)
-*	@n: normal to the surface
-*	@kd: diffuse material component
-*	@ld: diffuse light color
-*	returns a vec3 color of the pixel shaded using phong shading
-*/
-vec3 phong(vec3 hitpoint,vec3 n, vec3 kd, vec3 ld) {
-	vec3 L = normalize(lightPos - hitpoint);	// clamp L and N maybe?
-	vec3 N = normalize(n);
-
-	double d = dot(L,N);
-	if (d < 0) d = 0;
-	vec3 color = (ka*la) + (kd*d*ld);
-	return clamp(color);
-}
-
-/* Generates a list of intervals based on n and s
-*	@n: A perfect square, the number of intervals
-*	@s: pixel extent
-*	returns a list of intervals from [si/n,s(i+1)/n]
-*/
-void generateIntervals(int n, int s) {
-	// n must be a perfect square
-	// coarse grid is sqrt(n)*sqrt(n)
-	// fine grid is n*n
-	int course_grid_size = sqrt(n) * sqrt(n);
-	int fine_grid_size = n * n;
-	for (int i = 0; i < n; i++) {
-		interval in;
-		double g = double(i)/double(n);
-		double h = double((i+1))/double(n);
-		in.min = s*g + 1e-6;
-		in.max = s*h;
-		in.closed = true;
-		intervals.push_back(in);
-	}
-}
-
-/* Determines if an int is in a vector of ints
-*	@n: element to search for
-*	@list: vector of ints
-*	returns true if element is in list, false otherwise.
-*/
-bool contains(int n, vector<int>& list) {
-	if (list.size() == 0) return false;
-	for (int i = 0; i < list.size(); i++) {
-		if (n == list[i]) return true;
-	}
-	return false;
-}
-
-
-/*	Gets the dx and dy used for jittering
-*	@intervals: the list of intervals
-*	@n: samples per pixel
-*	returns random dx and dy values based on multi-jittered sampling
-*/
-vector<vec3> getdxdy(int n) {
-	double dx = 0;
-	double dy = 0;
-	int ysize = n;
-	vector<vec3> vecs;
-	vector<int> deleted_fine;
-	int j = 0;
-	int d = 1;
-
-	for (int k = 0; k < int(sqrt(n)); k++) {
-		ysize = n;
-		vector<int> deleted_coarse;
-		for (int i = j; i < (d)*int(sqrt(n)); i++) {
-			interval inx = intervals[i];
-			dx = random_double(inx.min, inx.max);
-			int yi = rand() % ysize;
-			while (contains(yi,deleted_coarse) && contains(yi, deleted_fine)) {
-				yi = rand() % ysize;
+/* Everything a worker needs to render a tile.
+*/
+struct render_context {
+	const hittable* world;
+	const camera* cam;
+	const sampler* samples;		// sub-pixel offsets for antialiasing
+	int image_width;
+	int image_height;
+	int samples_per_pixel;		// the most samples a pixel may take
+	int min_samples;			// adaptive first pass, 0 = always samples_per_pixel
+	double threshold;			// adaptive: standard error at which a pixel stops
+	vector<adaptive_pixel>* adaptive;	// adaptive: state of every pixel
+	int s;						// pixel extent
+	int packet_size;			// trace packet_size^2 pixel bundles, 0 for single rays
+	int wavefront;				// rays per wavefront queue, 0 to trace ray by ray
+	wavefront_stats* stats;		// wavefront: time spent in each stage
+	framebuffer* fb;
+	image_file* output;			// finished tiles are written here, if set
+	render_stats* counters;		// ray, test and time counts, if set
+	uint64_t settings;			// hash of what changes the image, see render_settings
+};
+
+/* Splits the image, or the rows [bottom,height) of it, into tiles of at
+*	most size*size pixels. Tile rows are laid out from the top, so a band
+*	whose top is a multiple of size below the image's gets the same
+*	tiles as the whole image.
+*	@width: image width
+*	@height: image height, or the top of the band
+*	@size: tile edge length
+*	@bottom: first row of the band
+*	returns the tiles in scanline order, top row first.
+*/
+vector<tile> make_tiles(int width, int height, int size, int bottom = 0) {
+	vector<tile> tiles;
+	for (int y1 = height; y1 > bottom; y1 -= size) {
+		int y0 = (y1 - size < bottom) ? bottom : y1 - size;
+		for (int x0 = 0; x0 < width; x0 += size) {
+			tile t;
+			t.x0 = x0;
+			t.x1 = (x0 + size > width) ? width : x0 + size;
+			t.y0 = y0;
+			t.y1 = y1;
+			tiles.push_back(t);
+		}
+	}
+	return tiles;
+}
+
+/* Hands a tile whose pixels are final to the output file, if there is
+*	one.
+*	@ctx: shared render state
+*	@t: the finished tile
+*/
+void finish_tile(const render_context& ctx, const tile& t) {
+	if (!ctx.output) return;
+	TRACE_SCOPE_AT("write tile", t.x0, t.y0);
+	ctx.output->write_tile(*ctx.fb, t.x0, t.y0, t.x1, t.y1);
+}
+
+/* Renders every sample of every pixel in a tile into the framebuffer.
+*	@ctx: shared render state
+*	@t: the tile to render
+*/
+void render_tile(const render_context& ctx, const tile& t) {
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			pixel_cost cost(ctx.counters);
+			// Apply anti-aliasing method-
+			// Multi-jittered sampling by default, see sampler.h
+			double dx,dy = 0;
+			vec3 color = vec3(0,0,0);
+			for (int k = 0; k < ctx.samples_per_pixel; k++) {
+				vec3 dxdy = ctx.s * ctx.samples->get(i, j, k);
+				dx = dxdy.x();
+				dy = dxdy.y();
+				double x = ctx.s*(double(i) - (ctx.image_width/2) + dx);
+				double y = ctx.s*(double(j) - (ctx.image_height/2) + dy);
+				ray r = ctx.cam->get_ray(x,y);
+				color += raycast(r, *ctx.world);
+			}
+			ctx.fb->set(i, j, color, ctx.samples_per_pixel);
+			cost.finish(i, j);
+		}
+	}
+}
+
+/* Adds sample k of every pixel in a tile to the framebuffer.
+*	@ctx: shared render state
+*	@samples: the pattern of the current frame
+*	@t: the tile to render
+*	@k: sample index within the frame
+*/
+void render_tile_pass(const render_context& ctx, const sampler& samples, const tile& t, int k) {
+	TRACE_SCOPE_AT("pass tile", t.x0, t.y0);
+	tile_timer timer(ctx.counters, t.x0, t.y0);
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			pixel_cost cost(ctx.counters);
+			vec3 dxdy = ctx.s * samples.get(i, j, k);
+			double x = ctx.s*(double(i) - (ctx.image_width/2) + dxdy.x());
+			double y = ctx.s*(double(j) - (ctx.image_height/2) + dxdy.y());
+			ray r = ctx.cam->get_ray(x,y);
+			ctx.fb->add_sample(i, j, raycast(r, *ctx.world));
+			cost.finish(i, j);
+		}
+	}
+}
+
+// set from the SIGINT handler to end a progressive render after the
+// current pass
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+	stop_requested = 1;
+}
+
+/* Writes the framebuffer to a file through a temporary file, so readers
+*	never see a half written image.
+*	@fb: the framebuffer
+*	@path: where to write
+*	@format: the encoding
+*	returns false if the file couldn't be written.
+*/
+bool write_image_file(const framebuffer& fb, const string& path, ppm_format format) {
+	TRACE_SCOPE("write image");
+	string tmp = path + ".tmp";
+	{
+		ofstream out(tmp.c_str(), ios::binary);
+		fb.write_ppm(out, format);
+		if (!out) return false;
+	}
+	return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+/* Saves the framebuffer and render settings to the checkpoint file,
+*	reporting failures without stopping the render.
+*	@ctx: shared render state
+*	@opts: the checkpoint file and sampler
+*	@passes: progressive passes done, -1 for a tiled render
+*/
+void save_checkpoint(const render_context& ctx, const render_options& opts, int passes) {
+	TRACE_SCOPE("checkpoint");
+	checkpoint_state state = { ctx.samples_per_pixel, opts.sampler, passes, ctx.settings };
+	if (!write_checkpoint(opts.checkpoint, *ctx.fb, state)) {
+		cerr << "couldn't write checkpoint " << opts.checkpoint << endl;
+	}
+}
+
+/* Returns whether every pixel of a tile has all its samples, as after a
+*	tiled render of it or after resuming one.
+*	@ctx: shared render state
+*	@t: the tile
+*/
+bool tile_complete(const render_context& ctx, const tile& t) {
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			if (ctx.fb->samples(i, j) != ctx.samples_per_pixel) return false;
+		}
+	}
+	return true;
+}
+
+/* Renders in passes that each add one sample to every pixel, so the
+*	framebuffer holds a complete image after every pass. Pass k takes
+*	stratum k % n of the n sample pattern; every n passes start a new
+*	frame of the sampler, with new per-pixel patterns (Sobol continues
+*	its sequence). Stops when target_spp passes are done, when the next
+*	pass would overrun the time budget, or after Ctrl-C or SIGTERM.
+*	With a checkpoint file the state is saved every checkpoint_interval
+*	seconds and when the render stops.
+*	@ctx: shared render state; ctx.samples_per_pixel is the pattern size n
+*	@pattern: the sample pattern
+*	@tiles: the tiles of the image
+*	@pool: the render threads
+*	@opts: target_spp, time_budget, preview, preview_interval and the
+*		checkpoint settings
+*	@first_pass: passes already in the framebuffer, from a checkpoint
+*	returns the number of passes in the framebuffer.
+*/
+int render_progressive(const render_context& ctx, sampler::pattern pattern, const vector<tile>& tiles,
+	thread_pool& pool, const render_options& opts, int first_pass) {
+	typedef chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	clock::time_point last_preview = start;
+	clock::time_point last_checkpoint = start;
+	double longest_pass = 0;
+	const int n = ctx.samples_per_pixel;
+
+	void (*previous_handler)(int) = signal(SIGINT, request_stop);
+	void (*previous_term_handler)(int) = signal(SIGTERM, request_stop);
+	int pass = first_pass;
+	while (!stop_requested && (opts.target_spp <= 0 || pass < opts.target_spp)) {
+		clock::time_point pass_start = clock::now();
+		double elapsed = chrono::duration<double>(pass_start - start).count();
+		if (opts.time_budget > 0 && pass > first_pass && elapsed + longest_pass > opts.time_budget) break;
+
+		{
+			TRACE_SCOPE("pass");
+			// tabulates only sample k of the frame's patterns
+			int k = pass % n;
+			sampler pass_samples(pattern, n, unsigned(pass / n), k, 1);
+			for (size_t t = 0; t < tiles.size(); t++) {
+				tile tl = tiles[t];
+				const sampler* smp = &pass_samples;
+				pool.submit([&ctx, smp, tl, k]() { render_tile_pass(ctx, *smp, tl, k); });
+			}
+			pool.wait();
+		}
+		pass++;
+
+		clock::time_point now = clock::now();
+		double took = chrono::duration<double>(now - pass_start).count();
+		if (took > longest_pass) longest_pass = took;
+		if (!opts.preview.empty() &&
+			chrono::duration<double>(now - last_preview).count() >= opts.preview_interval) {
+			if (!write_image_file(*ctx.fb, opts.preview, opts.format)) {
+				cerr << "couldn't write " << opts.preview << endl;
+			}
+			last_preview = now;
+		}
+		if (!opts.checkpoint.empty() &&
+			chrono::duration<double>(now - last_checkpoint).count() >= opts.checkpoint_interval) {
+			save_checkpoint(ctx, opts, pass);
+			last_checkpoint = now;
+		}
+	}
+	signal(SIGINT, previous_handler);
+	signal(SIGTERM, previous_term_handler);
+	if (!opts.checkpoint.empty()) save_checkpoint(ctx, opts, pass);
+
+	cerr << "progressive: " << pass << " passes in "
+		<< chrono::duration<double>(clock::now() - start).count() << " s"
+		<< (stop_requested ? " (interrupted)" : "") << endl;
+	return pass;
+}
+
+/* Takes samples [px.samples, count) of pixel (i,j). Sample k of a pixel
+*	is the same whichever pass takes it.
+*	@ctx: shared render state
+*	@i, j: the pixel
+*	@count: sample count to reach
+*	@px: the pixel's state
+*/
+void take_adaptive_samples(const render_context& ctx, int i, int j, int count, adaptive_pixel& px) {
+	for (int k = px.samples; k < count; k++) {
+		vec3 dxdy = ctx.s * ctx.samples->get(i, j, k);
+		double x = ctx.s*(double(i) - (ctx.image_width/2) + dxdy.x());
+		double y = ctx.s*(double(j) - (ctx.image_height/2) + dxdy.y());
+		ray r = ctx.cam->get_ray(x,y);
+
+		hit_record rec;
+		bool hit = ctx.world->closest_hit(r,0,infinity,rec);
+		bool shadowed;
+		vec3 c = shade(r, hit, rec, *ctx.world, &shadowed);
+		px.sum += c;
+
+		const hittable* object = hit ? rec.object : 0;
+		int prim = hit ? rec.prim : 0;
+		if (k == 0) {
+			px.object = object;
+			px.prim = prim;
+			px.shadowed = shadowed;
+		} else if (object != px.object || prim != px.prim || shadowed != px.shadowed) {
+			px.edge = true;
+		}
+
+		double lum = 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+		double delta = lum - px.mean;
+		px.mean += delta / (k + 1);
+		px.m2 += delta * (lum - px.mean);
+	}
+	px.samples = count;
+}
+
+/* First adaptive pass: min_samples samples in every pixel of the tile.
+*	@ctx: shared render state
+*	@t: the tile to render
+*/
+void render_tile_adaptive_first(const render_context& ctx, const tile& t) {
+	TRACE_SCOPE_AT("adaptive tile", t.x0, t.y0);
+	tile_timer timer(ctx.counters, t.x0, t.y0);
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			pixel_cost cost(ctx.counters);
+			adaptive_pixel& px = (*ctx.adaptive)[j*ctx.image_width + i];
+			px.sum = vec3(0,0,0);
+			px.samples = 0;
+			px.mean = 0;
+			px.m2 = 0;
+			px.edge = false;
+			take_adaptive_samples(ctx, i, j, ctx.min_samples, px);
+			ctx.fb->set(i, j, px.sum, px.samples);
+			cost.finish(i, j);
+		}
+	}
+}
+
+/* Second adaptive pass. A pixel keeps doubling its sample count, up to
+*	samples_per_pixel, while an edge or shadow boundary crosses it or the
+*	standard error of its luminance is above the threshold. A pixel
+*	crosses a boundary if its own samples disagree on the primitive they
+*	hit or on shadowing, or if its first sample disagrees with that of
+*	one of its 8 neighbours, which catches edges the first pass fell
+*	between. Flat pixels stop after the first pass.
+*	@ctx: shared render state
+*	@t: the tile to render
+*/
+void render_tile_adaptive_refine(const render_context& ctx, const tile& t) {
+	const vector<adaptive_pixel>& pixels = *ctx.adaptive;
+	const double threshold2 = ctx.threshold * ctx.threshold;
+	TRACE_SCOPE_AT("refine tile", t.x0, t.y0);
+	tile_timer timer(ctx.counters, t.x0, t.y0);
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			pixel_cost cost(ctx.counters);
+			adaptive_pixel& px = (*ctx.adaptive)[j*ctx.image_width + i];
+			bool edge = px.edge;
+			for (int nj = j - 1; nj <= j + 1 && !edge; nj++) {
+				for (int ni = i - 1; ni <= i + 1; ni++) {
+					if (ni < 0 || nj < 0 || ni >= ctx.image_width || nj >= ctx.image_height) continue;
+					const adaptive_pixel& q = pixels[nj*ctx.image_width + ni];
+					if (q.object != px.object || q.prim != px.prim || q.shadowed != px.shadowed) {
+						edge = true;
+						break;
+					}
+				}
+			}
+
+			while (px.samples < ctx.samples_per_pixel) {
+				int k = px.samples;
+				// variance of the mean is (m2/(k-1))/k
+				if (!edge && !px.edge && k > 1 && px.m2 <= threshold2 * (k - 1) * k) break;
+				int target = (2*k < ctx.samples_per_pixel) ? 2*k : ctx.samples_per_pixel;
+				take_adaptive_samples(ctx, i, j, target, px);
+			}
+			ctx.fb->set(i, j, px.sum, px.samples);
+			cost.finish(i, j);
+		}
+	}
+}
+
+/* Renders a tile in square bundles of pixels. For each sample the
+*	primary rays of a bundle are traced together as one packet; shading
+*	and shadow rays are still per ray. Bundles whose rays can't be bounded
+*	by a frustum are traced one ray at a time by the world.
+*	@ctx: shared render state
+*	@t: the tile to render
+*/
+void render_tile_packets(const render_context& ctx, const tile& t) {
+	const int n = ctx.packet_size;
+	ray_packet packet;
+	vec3 colors[ray_packet::max_rays];
+
+	for (int by = t.y0; by < t.y1; by += n) {
+		for (int bx = t.x0; bx < t.x1; bx += n) {
+			int w = (bx + n > t.x1) ? t.x1 - bx : n;
+			int h = (by + n > t.y1) ? t.y1 - by : n;
+			packet.count = w*h;
+			for (int p = 0; p < packet.count; p++) colors[p] = vec3(0,0,0);
+
+			// rays through the corners of the bundle's footprint bound every
+			// sample of every pixel in it, wherever the sampler puts them
+			double x0 = ctx.s*(double(bx) - (ctx.image_width/2));
+			double x1 = ctx.s*(double(bx + w - 1) - (ctx.image_width/2) + ctx.s);
+			double y0 = ctx.s*(double(by) - (ctx.image_height/2));
+			double y1 = ctx.s*(double(by + h - 1) - (ctx.image_height/2) + ctx.s);
+			ray corners[4] = { ctx.cam->get_ray(x0,y0), ctx.cam->get_ray(x1,y0),
+							   ctx.cam->get_ray(x1,y1), ctx.cam->get_ray(x0,y1) };
+
+			for (int k = 0; k < ctx.samples_per_pixel; k++) {
+				for (int p = 0; p < packet.count; p++) {
+					int i = bx + p % w;
+					int j = by + p / w;
+					vec3 dxdy = ctx.s * ctx.samples->get(i, j, k);
+					double x = ctx.s*(double(i) - (ctx.image_width/2) + dxdy.x());
+					double y = ctx.s*(double(j) - (ctx.image_height/2) + dxdy.y());
+					packet.rays[p] = ctx.cam->get_ray(x,y);
+				}
+				COUNT_STAT(packets, 1);
+				if (!packet.bounds.build(packet.rays, packet.count, corners)) COUNT_STAT(unbounded_packets, 1);
+				ctx.world->hit_packet(packet, 0, infinity);
+				for (int p = 0; p < packet.count; p++) {
+					if (packet.hits[p]) packet.recs[p].object->resolve(packet.rays[p], packet.recs[p]);
+					colors[p] += shade(packet.rays[p], packet.hits[p], packet.recs[p], *ctx.world);
+				}
+			}
+
+			for (int p = 0; p < packet.count; p++) {
+				ctx.fb->set(bx + p % w, by + p / w, colors[p], ctx.samples_per_pixel);
+			}
+		}
+	}
+}
+
+/* Wavefront stage: fills the queue with camera rays for samples
+*	[first, first + count) of a tile. Samples are numbered pixel by pixel
+*	in render_tile's order with the sample index varying fastest, and
+*	pixel holds the pixel's index within the tile.
+*	@ctx: shared render state
+*	@t: the tile
+*	@first: first sample number
+*	@count: rays to generate, at most the queue's capacity
+*	@q: the queue
+*/
+void wavefront_raygen(const render_context& ctx, const tile& t, long long first, int count, ray_queue& q) {
+	TRACE_SCOPE("raygen");
+	const int w = t.x1 - t.x0;
+	const int spp = ctx.samples_per_pixel;
+	for (int r = 0; r < count; r++) {
+		long long sample = first + r;
+		int local = int(sample / spp);
+		int k = int(sample % spp);
+		int i = t.x0 + local % w;
+		int j = t.y0 + local / w;
+		vec3 dxdy = ctx.s * ctx.samples->get(i, j, k);
+		double x = ctx.s*(double(i) - (ctx.image_width/2) + dxdy.x());
+		double y = ctx.s*(double(j) - (ctx.image_height/2) + dxdy.y());
+		ray r_cam = ctx.cam->get_ray(x,y);
+		q.origin.set(r, r_cam.origin());
+		q.direction.set(r, r_cam.direction());
+		q.pixel[r] = local;
+	}
+	q.count = count;
+	q.shadow_count = 0;
+}
+
+/* Wavefront stage: finds the closest hit of every ray in the queue.
+*	@world: the scene
+*	@q: the queue
+*/
+void wavefront_closest_hit(const hittable& world, ray_queue& q) {
+	TRACE_SCOPE("closest-hit");
+	long long hits = 0;
+	for (size_t r = 0; r < q.count; r++) {
+		hit_record rec;
+		q.hit[r] = world.hit(q.get_ray(r), 0, infinity, rec);
+		if (q.hit[r]) {
+			q.set_hit(r, rec);
+			hits++;
+		}
+	}
+	COUNT_STAT(primary_rays, q.count);
+	COUNT_STAT(hits, hits);
+}
+
+/* Wavefront stage: fills in the position, normal and material of every
+*	hit.
+*	@q: the queue
+*/
+void wavefront_resolve(ray_queue& q) {
+	TRACE_SCOPE("resolve");
+	for (size_t r = 0; r < q.count; r++) {
+		if (!q.hit[r]) continue;
+		hit_record rec = q.get_hit(r);
+		rec.object->resolve(q.get_ray(r), rec);
+		q.p.set(r, rec.p);
+		q.n.set(r, rec.n);
+		q.kd.set(r, rec.kd);
+		q.ld.set(r, rec.ld);
+	}
+}
+
+/* Wavefront stage: makes a shadow ray for every hit, packed at the front
+*	of the shadow arrays.
+*	@q: the queue
+*/
+void wavefront_shadow_rays(ray_queue& q) {
+	TRACE_SCOPE("shadow-rays");
+	size_t n = 0;
+	for (size_t r = 0; r < q.count; r++) {
+		if (!q.hit[r]) continue;
+		double light_distance;
+		ray to_light = shadow_ray(q.p.get(r), light_distance);
+		q.shadow_source[n] = int(r);
+		q.shadow_origin.set(n, to_light.origin());
+		q.shadow_direction.set(n, to_light.direction());
+		q.shadow_tmax[n] = light_distance;
+		n++;
+	}
+	q.shadow_count = n;
+}
+
+/* Wavefront stage: traces the shadow rays.
+*	@world: the scene
+*	@q: the queue
+*/
+void wavefront_occlusion(const hittable& world, ray_queue& q) {
+	TRACE_SCOPE("occlusion");
+	long long blocked = 0;
+	for (size_t s = 0; s < q.shadow_count; s++) {
+		q.occluded[q.shadow_source[s]] = world.occluded(q.get_shadow_ray(s), 0, q.shadow_tmax[s]);
+		blocked += q.occluded[q.shadow_source[s]];
+	}
+	COUNT_STAT(shadow_rays, q.shadow_count);
+	COUNT_STAT(shadowed, blocked);
+}
+
+/* Wavefront stage: colors every ray the way shade() does.
+*	@q: the queue
+*/
+void wavefront_shade(ray_queue& q) {
+	TRACE_SCOPE("shading");
+	for (size_t r = 0; r < q.count; r++) {
+		vec3 c;
+		if (!q.hit[r]) {
+			c = sky(q.get_ray(r));
+		} else if (q.occluded[r]) {
+			c = vec3(0,0,0);
+		} else {
+			c = phong(q.p.get(r), q.n.get(r), q.kd.get(r), q.ld.get(r));
+		}
+		q.color.set(r, c);
+	}
+}
+
+/* Adds the time since a stage started to its total and starts the next.
+*	@total: the stage's total in nanoseconds
+*	@since: when the stage started; set to now
+*/
+void end_stage(atomic<long long>& total, chrono::steady_clock::time_point& since) {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	total += chrono::duration_cast<chrono::nanoseconds>(now - since).count();
+	since = now;
+}
+
+/* Renders a tile as a stream of wavefronts. Each wavefront fills a queue
+*	with up to ctx.wavefront camera rays and runs every stage over the
+*	whole queue before the next stage starts, so each stage is a tight
+*	loop over structure-of-arrays data that can be timed on its own.
+*	Colors are summed per pixel in the same order as render_tile, so the
+*	image is the same.
+*	@ctx: shared render state
+*	@t: the tile to render
+*/
+void render_tile_wavefront(const render_context& ctx, const tile& t) {
+	typedef chrono::steady_clock clock;
+	// one queue per render thread, reused by every tile it renders
+	static thread_local unique_ptr<ray_queue> queue;
+	if (!queue || queue->capacity != size_t(ctx.wavefront)) queue.reset(new ray_queue(ctx.wavefront));
+	ray_queue& q = *queue;
+	wavefront_stats& stats = *ctx.stats;
+
+	const int w = t.x1 - t.x0;
+	const int h = t.y1 - t.y0;
+	vector<vec3> sums(size_t(w) * h, vec3(0,0,0));
+	const long long total = (long long)w * h * ctx.samples_per_pixel;
+	for (long long first = 0; first < total; first += q.capacity) {
+		int count = int((total - first < (long long)q.capacity) ? total - first : q.capacity);
+		clock::time_point since = clock::now();
+		wavefront_raygen(ctx, t, first, count, q);
+		end_stage(stats.ns[wavefront_stats::raygen], since);
+		wavefront_closest_hit(*ctx.world, q);
+		end_stage(stats.ns[wavefront_stats::closest_hit], since);
+		wavefront_resolve(q);
+		end_stage(stats.ns[wavefront_stats::resolve], since);
+		wavefront_shadow_rays(q);
+		end_stage(stats.ns[wavefront_stats::shadow_rays], since);
+		wavefront_occlusion(*ctx.world, q);
+		end_stage(stats.ns[wavefront_stats::occlusion], since);
+		wavefront_shade(q);
+		for (size_t r = 0; r < q.count; r++) sums[q.pixel[r]] += q.color.get(r);
+		end_stage(stats.ns[wavefront_stats::shading], since);
+		stats.rays += q.count;
+		stats.shadow_rays_cast += q.shadow_count;
+	}
+
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			ctx.fb->set(i, j, sums[(j - t.y0)*w + (i - t.x0)], ctx.samples_per_pixel);
+		}
+	}
+}
+
+/* Renders a tile with whichever of the non-adaptive methods ctx asks
+*	for and hands it to the output file.
+*	@ctx: shared render state
+*	@t: the tile to render
+*/
+void render_tile_any(const render_context& ctx, const tile& t) {
+	TRACE_SCOPE_AT("tile", t.x0, t.y0);
+	{
+		tile_timer timer(ctx.counters, t.x0, t.y0);
+		if (ctx.packet_size > 0) {
+			render_tile_packets(ctx, t);
+		} else if (ctx.wavefront > 0) {
+			render_tile_wavefront(ctx, t);
+		} else {
+			render_tile(ctx, t);
+		}
+	}
+	finish_tile(ctx, t);
+}
+
+/* Renders the image band by band into a framebuffer that holds one
+*	band, writing each band to the output before starting the next.
+*	Memory for pixels is the band's, however large the image.
+*	@ctx: shared render state; ctx.fb is a windowed framebuffer
+*	@pool: the render threads
+*	@tile_size: tile edge; the band height is a multiple of it
+*	@format: the encoding
+*	@out: where to write the image
+*	returns the number of bands.
+*/
+int render_streaming(const render_context& ctx, thread_pool& pool, int tile_size, ppm_format format, ostream& out) {
+	framebuffer& fb = *ctx.fb;
+	const int rows = fb.window_end() - fb.window_begin();
+	out << fb.ppm_header(format);
+	// bands are laid out from the top; pfm files store the bottom first
+	vector<int> tops;
+	for (int top = ctx.image_height; top > 0; top -= rows) tops.push_back(top);
+	if (format == pfm) reverse(tops.begin(), tops.end());
+	int bands = 0;
+	for (size_t b = 0; b < tops.size() && out; b++) {
+		int top = tops[b];
+		int bottom = (top - rows < 0) ? 0 : top - rows;
+		fb.set_window(bottom, top);
+		vector<tile> tiles = make_tiles(ctx.image_width, top, tile_size, bottom);
+		{
+			TRACE_SCOPE_AT("band", 0, bottom);
+			for (size_t t = 0; t < tiles.size(); t++) {
+				tile tl = tiles[t];
+				pool.submit([&ctx, tl]() { render_tile_any(ctx, tl); });
 			}
+			pool.wait();
+		}
+		TRACE_SCOPE_AT("write band", 0, bottom);
+		fb.write_rows(out, format);
+		out.flush();
+		bands++;
+	}
+	return bands;
+}
+
+/* Tiled rendering that can be checkpointed. Tiles go to the pool a few
+*	per thread at a time; between batches the framebuffer is quiet, so
+*	it is saved there once checkpoint_interval has passed, and when
+*	Ctrl-C or SIGTERM stops the render. Tiles a resumed checkpoint has
+*	finished are skipped.
+*	@ctx: shared render state
+*	@tiles: the tiles of the image
+*	@pool: the render threads
+*	@opts: the checkpoint settings
+*	returns false if the render was stopped before the last tile.
+*/
+bool render_checkpointed(const render_context& ctx, const vector<tile>& tiles, thread_pool& pool,
+	const render_options& opts) {
+	typedef chrono::steady_clock clock;
+	clock::time_point last_checkpoint = clock::now();
+	const size_t batch = size_t(pool.size()) * 4;
 
-			interval iny = intervals[yi];
-			dy = random_double(iny.min, iny.max);
-			deleted_fine.push_back(yi);
-		
-			int m = yi % int(sqrt(n));
-			int r = int(sqrt(n)) - m;
-			// delete m numbers before and then
-			// sqrt(n) - m intervals after including
-			// current one
-			for (int l = yi-m; l < yi + r; l++) {
-				deleted_coarse.push_back(l);
+	void (*previous_handler)(int) = signal(SIGINT, request_stop);
+	void (*previous_term_handler)(int) = signal(SIGTERM, request_stop);
+	size_t next = 0;
+	int skipped = 0;
+	while (next < tiles.size() && !stop_requested) {
+		size_t end = (next + batch < tiles.size()) ? next + batch : tiles.size();
+		for (; next < end; next++) {
+			tile tl = tiles[next];
+			if (tile_complete(ctx, tl)) {
+				finish_tile(ctx, tl);
+				skipped++;
+				continue;
 			}
-		
-			vecs.push_back(vec3(dx,dy,0));
+			pool.submit([&ctx, tl]() { render_tile_any(ctx, tl); });
+		}
+		pool.wait();
+
+		clock::time_point now = clock::now();
+		if (stop_requested || chrono::duration<double>(now - last_checkpoint).count() >= opts.checkpoint_interval) {
+			save_checkpoint(ctx, opts, -1);
+			last_checkpoint = now;
+		}
+	}
+	signal(SIGINT, previous_handler);
+	signal(SIGTERM, previous_term_handler);
+
+	if (skipped > 0) cerr << "checkpoint: " << skipped << " of " << tiles.size() << " tiles already done" << endl;
+	return next == tiles.size() && !stop_requested;
+}
+
+/* A hash of everything that changes the image, so a coordinator only
+*	takes workers that render the same picture and --resume only
+*	continues a checkpoint of it: the positional arguments, the scene,
+*	the samples and the precision.
+*	@argc: size of args
+*	@args: the positional arguments, as parse_options leaves them
+*	@opts: the options
+*/
+uint64_t render_settings(int argc, char** args, const render_options& opts) {
+	string text;
+	for (int i = 1; i < argc; i++) text += string(args[i]) + "\n";
+	text += opts.scene + "\n" + opts.scene_file + "\n" + opts.sampler + "\n" + opts.precision + "\n"
+		+ to_string(opts.samples_per_pixel);
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < text.size(); i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/* Copies a tile's accumulated pixels out of the framebuffer, bottom row
+*	first.
+*	@fb: the framebuffer
+*	@t: the tile
+*	@out: receives the pixels
+*/
+void tile_pixels(const framebuffer& fb, const tile& t, vector<tile_pixel>& out) {
+	out.clear();
+	for (int j = t.y0; j < t.y1; ++j) {
+		for (int i = t.x0; i < t.x1; ++i) {
+			tile_pixel px = tile_pixel();
+			px.sum = fb.sum(i, j);
+			px.samples = fb.samples(i, j);
+			out.push_back(px);
 		}
-		j += int(sqrt(n));
-		d += 1;
 	}
+}
 
-	return vecs;
+/* Renders tiles for a coordinator until it has none left (see
+*	util/distributed.h). Tiles go to the pool as they arrive and are sent
+*	back as each finishes.
+*	@ctx: shared render state
+*	@pool: the render threads
+*	@opts: the coordinator's address and the fault to inject, if any
+*	@settings: the render_settings hash
+*	returns the exit status.
+*/
+int render_for_coordinator(const render_context& ctx, thread_pool& pool, const render_options& opts, uint64_t settings) {
+	injected_fault fault = { injected_fault::none, 0 };
+	if (!opts.inject_fault.empty()) parse_injected_fault(opts.inject_fault, fault);
+	tile_hello hello = make_tile_hello(ctx.image_width, ctx.image_height, ctx.samples_per_pixel, settings);
+	// two per thread, so the next tile is already here when one finishes
+	hello.slots = 2 * pool.size();
+	tile_worker link;
+	string error;
+	if (!link.connect(opts.connect, hello, error)) {
+		cerr << error << endl;
+		return 1;
+	}
+
+	atomic<int> started(0);
+	atomic<bool> failed(false);
+	int received = 0;
+	tile_job job;
+	while (link.next(job)) {
+		received++;
+		pool.submit([&ctx, &link, &started, &failed, fault, job]() {
+			tile t = { job.x0, job.y0, job.x1, job.y1 };
+			vector<tile_pixel> pixels;
+			int index = started++;
+			if (fault.type != injected_fault::none && index == fault.after) {
+				// die or stall halfway through sending the tile
+				t.y1 = t.y0 + (t.y1 - t.y0) / 2;
+				render_tile_any(ctx, t);
+				tile_pixels(*ctx.fb, t, pixels);
+				link.send(job, pixels.data(), pixels.size());
+				cerr << "worker: injected " << (fault.type == injected_fault::crash ? "crash" : "hang")
+					<< " in tile " << job.x0 << "," << job.y0 << endl;
+				if (fault.type == injected_fault::crash) _exit(3);
+				for (;;) this_thread::sleep_for(chrono::hours(1));
+			}
+			render_tile_any(ctx, t);
+			tile_pixels(*ctx.fb, t, pixels);
+			if (!link.send(job, pixels.data(), pixels.size())) failed = true;
+		});
+	}
+	pool.wait();
+	if (received == 0) {
+		cerr << "worker: no tiles from " << opts.connect << "; it may render other settings" << endl;
+		return 1;
+	}
+	cerr << "worker: " << received << " tiles" << (failed ? ", some not delivered" : "") << endl;
+	return 0;
 }
 
-/* Casts a ray to determine if it hits any objects in the scene.
-*	@r: The ray to cast.
-*	returns the color for a pixel at a point on the viewplane.
+/* The command line of a worker started by the coordinator: the
+*	coordinator's own less what only the coordinator does, pointed back
+*	at it.
+*	@command: the coordinator's command line
+*	@address: where the coordinator listens
+*	@threads: render threads for the worker
+*	@with_fault: keep --inject-fault
 */
-vec3 raycast(ray r, const hittable& world) {
-	hit_record rec;
-	if (world.hit(r,0,infinity,rec)) {
-		// Shadows
-		// create a ray from hitpoint to all light sources
-		vec3 hitpoint = rec.p;
-		vec3 norm_dir = normalize(lightPos - hitpoint);
-		double eps = 1e-5;
-		ray shadow_ray = ray(hitpoint + vec3(eps,eps,eps)*norm_dir, norm_dir);
-		hit_record new_rec;
-		if (world.hit(shadow_ray,0,infinity,new_rec)) {
-			// color at that point is black
-			return vec3(0,0,0);
+vector<string> worker_command(const vector<string>& command, const string& address, int threads, bool with_fault) {
+	static const char* coordinator_only[] = {
+		"--workers", "--listen", "--worker-timeout", "--output", "--format", "--threads", "--inject-fault"
+	};
+	vector<string> out;
+	out.push_back(command[0]);
+	out.push_back("--connect");
+	out.push_back(address);
+	out.push_back("--threads");
+	out.push_back(to_string(threads));
+	for (size_t i = 1; i < command.size(); i++) {
+		bool skip = false;
+		for (size_t k = 0; k < sizeof(coordinator_only) / sizeof(coordinator_only[0]); k++) {
+			if (command[i] == coordinator_only[k]) skip = true;
+		}
+		if (with_fault && command[i] == "--inject-fault") skip = false;
+		if (skip) {
+			i++;	// and its value
+		} else {
+			out.push_back(command[i]);
 		}
-		return phong(rec.p, rec.n, rec.kd, rec.ld);
 	}
+	return out;
+}
 
-	vec3 unit_direction = normalize(r.direction());
-    double t = 0.5*(unit_direction.y() + 1.0);
-    return (1.0-t)*vec3(1.0, 1.0, 1.0) + t*vec3(0.5, 0.7, 1.0);
+/* Starts a worker process running this program. Its standard output
+*	goes nowhere, since the image may be going to ours.
+*	@command: its command line
+*	returns its pid, or -1.
+*/
+pid_t start_worker(const vector<string>& command) {
+	vector<char*> argv;
+	for (size_t i = 0; i < command.size(); i++) argv.push_back(const_cast<char*>(command[i].c_str()));
+	argv.push_back(0);
+	cerr.flush();
+	pid_t pid = fork();
+	if (pid == 0) {
+		int null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd >= 0) dup2(null_fd, 1);
+		execv("/proc/self/exe", argv.data());
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	return pid;
+}
+
+/* Waits a moment for the workers started here to leave, then kills the
+*	ones that haven't, like a hung one.
+*	@children: their pids, -1 for those already reaped
+*/
+void stop_workers(vector<pid_t>& children) {
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(2);
+	for (size_t k = 0; k < children.size(); k++) {
+		if (children[k] < 0) continue;
+		while (waitpid(children[k], 0, WNOHANG) == 0) {
+			if (chrono::steady_clock::now() > deadline) {
+				kill(children[k], SIGKILL);
+				waitpid(children[k], 0, 0);
+				break;
+			}
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+		children[k] = -1;
+	}
+}
+
+/* Renders the image on worker processes (see util/distributed.h) and
+*	writes it as a local render would. --workers of them are started on
+*	this machine; others can join on --listen.
+*	@opts: the options
+*	@command: the command line, for the workers started here
+*	@width: image width
+*	@height: image height
+*	@settings: the render_settings hash
+*	returns the exit status.
+*/
+int render_coordinated(const render_options& opts, const vector<string>& command, int width, int height, uint64_t settings) {
+	chrono::steady_clock::time_point render_start = chrono::steady_clock::now();
+	tile_coordinator coordinator(make_tile_hello(width, height, opts.samples_per_pixel, settings), opts.worker_timeout);
+	string address = opts.listen.empty() ? "unix:/tmp/mp1-" + to_string(getpid()) + ".sock" : opts.listen;
+	string error;
+	if (!coordinator.listen(address, error)) {
+		cerr << error << endl;
+		return 1;
+	}
+	// workers started here reach a TCP coordinator on loopback
+	string local_address = address;
+	size_t colon = address.rfind(':');
+	if (address.compare(0, 5, "unix:") != 0 && colon != string::npos) {
+		string host = address.substr(0, colon);
+		if (host.empty() || host == "*" || host == "0.0.0.0") local_address = "127.0.0.1" + address.substr(colon);
+	}
+
+	int threads = opts.threads;
+	if (threads <= 0) threads = max(1, thread_pool::hardware_threads() / max(1, opts.workers));
+	vector<pid_t> children;
+	for (int k = 0; k < opts.workers; k++) {
+		pid_t pid = start_worker(worker_command(command, local_address, threads, k == 0));
+		if (pid < 0) {
+			cerr << "couldn't start worker " << k << endl;
+			stop_workers(children);
+			return 1;
+		}
+		children.push_back(pid);
+	}
+	cerr << "coordinator: " << opts.workers << " workers started, listening on " << address << endl;
+
+	framebuffer fb(width, height);
+	image_file output;
+	if (!opts.output.empty() && opts.format != p3 && !output.open(opts.output, fb, opts.format, opts.tile_size)) {
+		cerr << "couldn't open " << opts.output << endl;
+		stop_workers(children);
+		return 1;
+	}
+	vector<tile> tiles = make_tiles(width, height, opts.tile_size);
+	vector<tile_job> jobs;
+	for (size_t t = 0; t < tiles.size(); t++) {
+		tile_job job = { int32_t(t), tiles[t].x0, tiles[t].y0, tiles[t].x1, tiles[t].y1 };
+		jobs.push_back(job);
+	}
+	bool ok = coordinator.run(jobs,
+		[&](const tile_job& job, const tile_pixel* pixels) {
+			for (int j = job.y0; j < job.y1; ++j) {
+				for (int i = job.x0; i < job.x1; ++i, ++pixels) fb.set(i, j, pixels->sum, pixels->samples);
+			}
+			if (output.is_open()) output.write_tile(fb, job.x0, job.y0, job.x1, job.y1);
+		},
+		[&]() {
+			// none will come once every worker started here has exited or
+			// has been and gone, unless others may join on --listen
+			bool running = false;
+			for (size_t k = 0; k < children.size(); k++) {
+				if (children[k] >= 0 && waitpid(children[k], 0, WNOHANG) == children[k]) children[k] = -1;
+				if (children[k] >= 0) running = true;
+			}
+			return opts.listen.empty() && (!running || coordinator.connection_count() >= int(children.size()));
+		},
+		error);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - render_start).count();
+	stop_workers(children);
+
+	cerr << "distributed: " << tiles.size() << " tiles, " << coordinator.workers_joined << " workers joined, "
+		<< coordinator.workers_lost << " lost, " << coordinator.tiles_reassigned << " tiles reassigned, "
+		<< coordinator.backup_tiles << " backup tiles (" << coordinator.results_dropped << " results dropped)" << endl;
+	if (!ok) {
+		cerr << error << endl;
+		return 1;
+	}
+	// bench/scenes.cpp reads this line
+	long long total = fb.total_samples();
+	cerr << "render: " << seconds << " s, " << total << " samples, " << total / seconds << " samples/s" << endl;
+
+	if (output.is_open()) {
+		if (!output.close()) {
+			cerr << "couldn't write " << opts.output << endl;
+			return 1;
+		}
+		cerr << "wrote " << output.size() << " bytes to " << opts.output << endl;
+	} else if (!opts.output.empty()) {
+		if (!write_image_file(fb, opts.output, opts.format)) {
+			cerr << "couldn't write " << opts.output << endl;
+			return 1;
+		}
+	} else {
+		fb.write_ppm(cout, opts.format);
+	}
+	return 0;
+}
+
+/* Copies a scene with its spheres, triangles and planes converted to
+*	their float versions. Anything else is shared with the original.
+*	@list: the scene
+*	returns the converted, compiled scene.
+*/
+hittable_list to_float(const hittable_list& list) {
+	hittable_list out;
+	for (size_t i = 0; i < list.objects().size(); i++) {
+		const hittable* h = list.objects()[i].get();
+		if (const sphere* s = dynamic_cast<const sphere*>(h)) {
+			out.add(make_shared<spheref>(vec3f(s->center()), float(s->radius()), vec3f(s->kd), vec3f(s->ld)));
+		} else if (const triangle* t = dynamic_cast<const triangle*>(h)) {
+			out.add(make_shared<trianglef>(vec3f(t->v1()), vec3f(t->v2()), vec3f(t->v3()), vec3f(t->kd), vec3f(t->ld)));
+		} else if (const plane* p = dynamic_cast<const plane*>(h)) {
+			out.add(make_shared<planef>(vec3f(p->p()), vec3f(p->n()), vec3f(p->kd), vec3f(p->ld)));
+		} else {
+			out.add(list.objects()[i]);
+		}
+	}
+	out.compile();
+	return out;
+}
+
+/* Builds the structure-of-arrays pools in precision T and selects their
+*	kernels.
+*	@world: the compiled scene
+*	@isa: kernel instruction set, see --simd
+*	returns the pools, or null if the CPU can't run the kernels.
+*/
+template<class T>
+shared_ptr<hittable> make_pool(const hittable_list& world, const string& isa) {
+	simd_kernels_t<T> kernels;
+	if (!find_kernels(isa, kernels)) {
+		cerr << "--simd " << isa << " is not supported on this CPU" << endl;
+		return shared_ptr<hittable>();
+	}
+	set_active_kernels(kernels);
+	shared_ptr<primitive_pool_t<T> > soa = make_shared<primitive_pool_t<T> >(world);
+	cerr << "soa (" << kernels.isa << ", " << kernels.width << " lanes): " << soa->sphere_count() << " spheres, "
+		<< soa->triangle_count() << " triangles, "
+		<< soa->plane_count() << " planes in "
+		<< soa->memory_bytes() << " bytes" << endl;
+	return soa;
 }
 
 /* The main method to run everything.
-*	compile using: g++ mp1.cpp -std=c++11 -o mp1
+*	compile using: g++ mp1.cpp -std=c++11 -pthread -o mp1
 *	./mp1 0 400 1.7 > output.ppm
 *	@argc: The size of args array
 *	@args: The arguments provided by the command line
@@ -273,26 +1162,124 @@ vec3 raycast(ray r, const hittable& world) {
 *	@args[2] - image width (400 by default)
 *	@args[3] - aspect ratio (resolution of image). (16/9 by default)
 *	@args[4] - image height (optional)(if used, aspect ratio is discarded).
+*	Options (may appear anywhere):
+*	--threads N - number of render threads (all hardware threads by default)
+*	--tile N - tile edge length in pixels (16 by default)
+*	--accel bvh|list|soa - test rays against a BVH (default), every object
+*		in turn, or every object from type-segregated array pools
+*	--packet N - trace primary rays in NxN pixel packets (N <= 8) with
+*		frustum culling; 0 (default) traces single rays
+*	--simd auto|scalar|sse4.2|avx2|avx512 - intersection kernels used by
+*		--accel soa (the widest the CPU supports by default)
+*	--spp N - samples per pixel, any positive count (100 by default)
+*	--sampler mj|sobol|random - sub-pixel sample pattern: multi-jittered
+*		(default), scrambled Sobol or uniform random
+*	--adaptive N - adaptive sampling: take N samples per pixel, then keep
+*		doubling up to --spp only where an edge or shadow boundary
+*		crosses the pixel or its samples are still noisy; 0 (default)
+*		is off
+*	--adaptive-threshold X - standard error of a pixel's luminance at
+*		which it stops refining (0.004, about 1/255, by default)
+*	--spp-image FILE - also write the samples taken per pixel as a
+*		grayscale ppm, white for --spp
+*	--target-spp N - progressive rendering: passes of one sample per pixel
+*		until every pixel has N samples
+*	--time-budget S - progressive rendering: stop before the pass that
+*		would end after S seconds. With both, whichever comes first;
+*		Ctrl-C also ends the render after the current pass. The image
+*		written is always complete.
+*	--preview FILE - progressive: write the image so far to FILE
+*	--preview-interval S - seconds between preview writes (1 by default)
+*	--wavefront N - render in wavefronts of N rays: each stage (ray
+*		generation, closest hit, resolve, shadow rays, occlusion,
+*		shading) runs over a whole queue of rays before the next, and
+*		the time spent in each is reported. 0 (default) traces each
+*		ray from camera to color in turn.
+*	--format p3|p6|p6-16 - image encoding: ASCII (default), binary with
+*		8 bits per channel, or binary with 16. Binary ppm is about a
+*		quarter of the size and much faster to write.
+*	--output FILE - write the image to FILE instead of standard output.
+*		Binary formats are written through a memory map as tiles
+*		finish, and flushed on a background thread while the rest of
+*		the image renders.
+*	--memory-limit MB - streaming render for images too large to hold:
+*		the image is rendered in bands of rows, each written out in
+*		turn, with at most MB megabytes of framebuffer. Peak memory
+*		no longer grows with the image height. Not available with
+*		--adaptive, progressive rendering or --spp-image.
+*	--format pfm also keeps the linear HDR average, as 32 bit floats.
+*	--checkpoint FILE - save the unquantized framebuffer and progress to
+*		FILE every --checkpoint-interval seconds (60 by default) and
+*		when Ctrl-C or SIGTERM stops the render. Progressive renders
+*		then write the image so far; tiled renders exit without one.
+*	--resume FILE - continue the render saved in FILE, skipping the
+*		tiles or passes it has done; keeps checkpointing to FILE unless
+*		--checkpoint says otherwise. The positional arguments, --scene
+*		or --scene-file, --precision, --spp (or --target-spp pattern),
+*		--sampler and progressive or not must match the saved render.
+*	--stats FILE - count primary and shadow rays, hits, intersection
+*		tests by kind (sphere, triangle, plane, BVH node), --packet
+*		bundles and those traced ray by ray for want of a frustum, and
+*		the time of every tile in per-thread counters; print a summary
+*		and write them to FILE as JSON
+*	--heatmap FILE - write the cost of every pixel as a binary ppm,
+*		black (cheap) through blue, red and yellow to white, to find hot
+*		spots and pathological geometry. Not available with --packet,
+*		--wavefront or --memory-limit.
+*	--heatmap-metric tests|time - intersection tests (default) or
+*		nanoseconds per pixel
+*	--trace FILE - record a timeline of scene setup, the sampler, every
+*		tile, wavefront stage (occlusion is the shadow pass), progressive
+*		pass, band, checkpoint and image write, per thread, and write it
+*		to FILE as Chrome Trace Event JSON for Perfetto or
+*		chrome://tracing. Builds with -DMP1_NO_TRACE leave it out.
+*	--trace-events N - events kept per thread (65536 by default); the
+*		oldest are dropped beyond that
+*	--scene NAME - built-in scene to render: default, shadows,
+*		spheres10k, triangles1m or instances10k (see util/scenes.h)
+*	--scene-file FILE - render the scene in FILE instead: a text scene
+*		or a scene cache, told apart by the first bytes (format in
+*		util/scene_file.h). A cache is mapped and traced in place with
+*		the BVH stored in it, so it starts in the time it takes to page
+*		in what the rays touch; --accel and --precision don't apply.
+*	--write-cache FILE - bake the scene (--scene or a text --scene-file)
+*		into a scene cache and exit
+*	--write-scene FILE - save the scene as text and exit
+*	--precision double|float - scalar type the geometry is stored and
+*		intersected in. float halves scene memory and doubles the SIMD
+*		width but loses precision on large or distant objects; double
+*		(default) is the reference.
+*	--workers N - render on N worker processes started on this machine:
+*		this process only deals out tiles and assembles the image, and
+*		each worker loads the scene once and renders the tiles it is
+*		sent (protocol and recovery in util/distributed.h). The image is
+*		the same as a single process renders. Workers get --threads
+*		threads each, or an equal share of the hardware threads.
+*	--listen ADDR - also take workers started elsewhere with --connect;
+*		ADDR is HOST:PORT (* for every interface) or unix:PATH
+*	--connect ADDR - be a worker for the coordinator at ADDR. Give it
+*		the coordinator's positional arguments, scene and sampling
+*		flags; it refuses workers whose settings differ.
+*	--worker-timeout S - drop a worker that keeps a tile longer than S
+*		seconds and reassign its tiles (60 by default, 0 never)
+*	--inject-fault crash:N|hang:N - testing: the first worker renders N
+*		tiles, then dies or hangs halfway through sending the next.
+*		Distributed renders can't be combined with --adaptive,
+*		progressive rendering, --memory-limit, checkpoints,
+*		--spp-image, --stats, --heatmap or --trace.
 *	returns 0 on successful completion.
 */
 int main(int argc, char** args) {
+	render_options opts;
+	const vector<string> command(args, args + argc);
+	argc = parse_options(argc, args, opts);
+	const uint64_t settings = render_settings(argc, args, opts);
+	if (!opts.trace.empty()) {
+		trace_start(size_t(opts.trace_events));
+		TRACE_THREAD_NAME("main");
+	}
 	int ortho = (argc == 1 || args[1][0] == '1') ? 1 : 0;
 
-	// World stuff
-	hittable_list world;
-	world.add(make_shared<plane>(vec3(0,0,-400), vec3(0,0,1), vec3(0.8,0.5,0.8), vec3(1,0.4,0.6)));
-    //world.add(make_shared<sphere>(vec3(0,0,-2), 1.95, vec3(1,0,0), vec3(1,1,1)));
-	//world.add(make_shared<triangle>(vec3(50-100,50-100,-1.5), vec3(0-100,-50-100,-1.5), vec3(100-100,-50-100,-1.5), vec3(0.5,0.4,0.8), vec3(0.5,0.5,0.5)));
-    //world.add(make_shared<sphere>(vec3(0,-100.5,-1), 100, vec3(1,1,1), vec3(1,1,1)));
-
-    //world.add(make_shared<sphere>(vec3(-50,0,-52),49.99,vec3(0,0,1),vec3(1,1,1)));
-    //world.add(make_shared<sphere>(vec3(0,-100.5,-120),100,vec3(66.0/255.0, 221.0/255.0, 245.0/255.0),vec3(1,1,1)));
-
-	// perspective
-	world.add(make_shared<triangle>(vec3(50-100,50-100,100), vec3(0-100,-50-100,100), vec3(100-100,-50-100,100), vec3(0.5,0.4,0.8), vec3(0.5,0.5,0.5)));
-	world.add(make_shared<sphere>(vec3(-50,0,0),49.99,vec3(0,0,1),vec3(1,1,1)));
-	world.add(make_shared<sphere>(vec3(0,-100.5,0),100,vec3(66.0/255.0, 221.0/255.0, 245.0/255.0),vec3(1,1,1)));
-
 	// Image
 	int image_width = 400;
 	float aspect_ratio = 16/9;
@@ -308,44 +1295,332 @@ int main(int argc, char** args) {
 		aspect_ratio = image_width/image_height;
 	}
 
-	//const vec3 eyepoint = vec3(1,1,400); // perspective projection
-	const vec3 eyepoint = vec3(-250,250,400); // perspective projection
+	// a coordinator never loads the scene; its workers do
+	if (opts.workers > 0 || !opts.listen.empty()) {
+		return render_coordinated(opts, command, image_width, image_height, settings);
+	}
+
+	// World stuff
+	hittable_list world;
+	scene_view view;
+	scene_cache cache;
+	const bool cached = !opts.scene_file.empty() && scene_cache::is_cache(opts.scene_file);
+	chrono::steady_clock::time_point build_start = chrono::steady_clock::now();
+	bool built;
+	string scene_error;
+	{
+		TRACE_SCOPE("scene");
+		if (cached) {
+			built = cache.open(opts.scene_file, view, scene_error);
+		} else if (!opts.scene_file.empty()) {
+			built = load_scene_text(opts.scene_file, world, view, scene_error, opts.threads);
+		} else {
+			built = build_scene(opts.scene, world, view);
+		}
+	}
+	if (!built && opts.scene_file.empty()) {
+		cerr << "unknown --scene " << opts.scene << ", one of:";
+		for (size_t i = 0; i < scene_names().size(); i++) cerr << " " << scene_names()[i];
+		cerr << endl;
+		return 1;
+	}
+	if (!built) {
+		cerr << scene_error << endl;
+		return 1;
+	}
+	double build_ms = chrono::duration<double>(chrono::steady_clock::now() - build_start).count() * 1000;
+	if (cached) {
+		cerr << "scene cache " << opts.scene_file << ": " << cache.primitive_count() << " primitives, "
+			<< cache.node_count() << " nodes, " << cache.size() / (1024.0 * 1024.0) << " MB mapped in "
+			<< build_ms << " ms" << endl;
+	} else {
+		cerr << "scene " << (opts.scene_file.empty() ? opts.scene : opts.scene_file) << ": "
+			<< world.objects().size() << " objects, built in " << build_ms << " ms" << endl;
+	}
+
+	if (!opts.write_cache.empty() || !opts.write_scene.empty()) {
+		if (cached) {
+			cerr << "--write-cache and --write-scene need a built-in or text scene" << endl;
+			return 1;
+		}
+		if (!opts.write_cache.empty() && !scene_cache::write(opts.write_cache, world, view, scene_error)) {
+			cerr << scene_error << endl;
+			return 1;
+		}
+		if (!opts.write_scene.empty() && !save_scene_text(opts.write_scene, world, view, scene_error)) {
+			cerr << scene_error << endl;
+			return 1;
+		}
+		return 0;
+	}
+	if (cached && (opts.accel != "bvh" || opts.precision != "double")) {
+		cerr << "a scene cache brings its own BVH in double precision; --accel and --precision don't apply" << endl;
+		return 1;
+	}
+
+	const vec3 eyepoint = view.eyepoint; // perspective projection
 	const int s = 1; // pixel extent
 	const int d = 1; // focal length, viewport/plane is at (0,0,-1)
-	vec3 up = vec3(0,1,0); // Up direction (world space)
+	vec3 up = view.up; // Up direction (world space)
 
 	// orthonormal basis vectors for camera space:
 	const vec3 camera_origin = eyepoint; // camera space
-	vec3 viewdir = vec3(0,0,-1); // viewdir
+	vec3 viewdir = view.viewdir; // viewdir
 	camera cam = camera(aspect_ratio, camera_origin, viewdir, up, d, ortho);
 	//camera cam;
 
-	const int samples_per_pixels = 100;	// 100
-	generateIntervals(samples_per_pixels,s);
-	vector<vec3> vecs = getdxdy(samples_per_pixels);
+	// progressive passes walk through a pattern of target_spp samples, or
+	// of --spp when only a time budget is given
+	const bool progressive = opts.time_budget > 0 || opts.target_spp > 0;
+	const int samples_per_pixels = (opts.target_spp > 0) ? opts.target_spp : opts.samples_per_pixel;	// 100
+	sampler::pattern pattern;
+	sampler::parse(opts.sampler, pattern);
+	sampler samples = [&]() { TRACE_SCOPE("sampler"); return sampler(pattern, samples_per_pixels); }();
+
+	{
+		TRACE_SCOPE("compile");
+		world.compile();
+	}
+
+	// Acceleration structure
+	const hittable* scene = &world;
+	shared_ptr<bvh> tree;
+	shared_ptr<hittable> soa;
+	if (cached) {
+		scene = &cache;
+	} else if (opts.precision == "float") {
+		TRACE_SCOPE("to float");
+		world = to_float(world);
+		shadow_epsilon = 1e-2;
+	}
+	if (cached) {
+		// the tree came with the cache
+	} else if (opts.accel == "bvh") {
+		{
+			TRACE_SCOPE("bvh build");
+			tree = make_shared<bvh>(world);
+		}
+		scene = tree.get();
+		cerr << "bvh: " << tree->primitive_count() << " primitives, "
+			<< tree->node_count() << " nodes, built in "
+			<< tree->build_seconds*1000 << " ms" << endl;
+	} else if (opts.accel == "soa") {
+		TRACE_SCOPE("soa build");
+		if (opts.precision == "float") {
+			soa = make_pool<float>(world, opts.simd);
+		} else {
+			soa = make_pool<double>(world, opts.simd);
+		}
+		if (!soa) return 1;
+		scene = soa.get();
+	}
 
     // Render
+	// streaming keeps only a band of rows in memory: as many whole tile
+	// rows as fit in the limit, at least one
+	const bool streaming = opts.memory_limit > 0;
+	int band_rows = image_height;
+	if (streaming) {
+		double row_bytes = double(image_width) * framebuffer::bytes_per_accumulated_pixel();
+		int tile_rows = int(opts.memory_limit * 1024 * 1024 / row_bytes) / opts.tile_size;
+		if (tile_rows < 1) {
+			tile_rows = 1;
+			cerr << "--memory-limit is below one row of tiles, using "
+				<< row_bytes * opts.tile_size / (1024 * 1024) << " MB" << endl;
+		}
+		if (double(tile_rows) * opts.tile_size < image_height) band_rows = tile_rows * opts.tile_size;
+	}
+	framebuffer fb = streaming ? framebuffer(image_width, image_height, band_rows) : framebuffer(image_width, image_height);
+	render_context ctx;
+	ctx.world = scene;
+	ctx.cam = &cam;
+	ctx.samples = &samples;
+	ctx.image_width = image_width;
+	ctx.image_height = image_height;
+	ctx.samples_per_pixel = samples_per_pixels;
+	ctx.min_samples = opts.adaptive;
+	ctx.threshold = opts.adaptive_threshold;
+	vector<adaptive_pixel> adaptive_pixels;
+	if (opts.adaptive > 0) adaptive_pixels.resize(size_t(image_width) * image_height);
+	ctx.adaptive = &adaptive_pixels;
+	ctx.s = s;
+	ctx.packet_size = opts.packet_size;
+	ctx.wavefront = opts.wavefront;
+	wavefront_stats stats;
+	ctx.stats = &stats;
+	ctx.fb = &fb;
+	ctx.settings = settings;
+	// binary images are written to the file tile by tile as they finish
+	image_file output;
+	if (!opts.output.empty() && opts.format != p3 && !streaming) {
+		if (!output.open(opts.output, fb, opts.format, opts.tile_size)) {
+			cerr << "couldn't open " << opts.output << endl;
+			return 1;
+		}
+	}
+	ctx.output = output.is_open() ? &output : 0;
+	unique_ptr<render_stats> counters;
+	if (!opts.stats.empty() || !opts.heatmap.empty()) {
+		counters.reset(new render_stats(image_width, image_height, !opts.heatmap.empty()));
+	}
+	ctx.counters = counters.get();
 
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+	int first_pass = 0;
+	if (!opts.resume.empty()) {
+		checkpoint_state saved;
+		checkpoint_state wanted = { samples_per_pixels, opts.sampler, progressive ? 0 : -1, settings };
+		if (!read_checkpoint(opts.resume, fb, saved)) {
+			cerr << "couldn't read checkpoint " << opts.resume << " for a " << image_width << "x" << image_height << " image" << endl;
+			return 1;
+		}
+		if (saved.settings != wanted.settings) {
+			cerr << opts.resume << " was saved by a render of another scene, camera, image size or precision" << endl;
+			return 1;
+		}
+		if (!wanted.compatible(saved)) {
+			cerr << opts.resume << " was saved by a " << (saved.passes < 0 ? "tiled" : "progressive") << " render with "
+				<< saved.samples_per_pixel << " samples per pixel (" << saved.sampler << ")" << endl;
+			return 1;
+		}
+		if (progressive) first_pass = saved.passes;
+		cerr << "resumed from " << opts.resume << " (" << fb.total_samples() << " samples)" << endl;
+	}
 
-    for (int j = image_height-1; j >= 0; --j) {
-        for (int i = 0; i < image_width; ++i) {
-			// Apply anti-aliasing method-
-			// Multi-jittered sampling
-			double dx,dy = 0;
-			vec3 color = vec3(0,0,0);
-			for (int k = 0; k < samples_per_pixels; k++) {
-				vec3 dxdy = vecs[k];
-				dx = dxdy.x();
-				dy = dxdy.y();
-				double x = s*(double(i) - (image_width/2) + dx);
-				double y = s*(double(j) - (image_height/2) + dy);
-				ray r = cam.get_ray(x,y);
-				color += raycast(r, world);
+	if (!opts.connect.empty()) {
+		thread_pool pool(opts.threads);
+		return render_for_coordinator(ctx, pool, opts, settings);
+	}
+
+	chrono::steady_clock::time_point render_start = chrono::steady_clock::now();
+	if (streaming) {
+		ofstream file;
+		if (!opts.output.empty()) {
+			file.open(opts.output.c_str(), ios::binary);
+			if (!file) {
+				cerr << "couldn't open " << opts.output << endl;
+				return 1;
+			}
+		}
+		ostream& out = opts.output.empty() ? cout : file;
+		thread_pool pool(opts.threads);
+		int bands = render_streaming(ctx, pool, opts.tile_size, opts.format, out);
+		if (!out) {
+			cerr << "couldn't write " << (opts.output.empty() ? "the image" : opts.output) << endl;
+			return 1;
+		}
+		cerr << "stream: " << bands << " bands of " << band_rows << " rows, "
+			<< double(image_width) * band_rows * framebuffer::bytes_per_accumulated_pixel() / (1024 * 1024)
+			<< " MB framebuffer" << endl;
+	}
+
+	vector<tile> tiles = streaming ? vector<tile>() : make_tiles(image_width, image_height, opts.tile_size);
+	if (!streaming) {
+		thread_pool pool(opts.threads);
+		if (progressive) {
+			render_progressive(ctx, pattern, tiles, pool, opts, first_pass);
+			// tiles are only final once the last pass is done
+			for (size_t t = 0; t < tiles.size() && ctx.output; t++) {
+				tile tl = tiles[t];
+				pool.submit([&ctx, tl]() { finish_tile(ctx, tl); });
+			}
+		}
+		if (!progressive && !opts.checkpoint.empty() && !render_checkpointed(ctx, tiles, pool, opts)) {
+			cerr << "stopped; continue with --resume " << opts.checkpoint << endl;
+			return 1;
+		}
+		for (size_t t = 0; t < tiles.size() && !progressive && opts.checkpoint.empty(); t++) {
+			tile tl = tiles[t];
+			if (ctx.min_samples > 0) {
+				pool.submit([&ctx, tl]() { render_tile_adaptive_first(ctx, tl); });
+			} else {
+				pool.submit([&ctx, tl]() { render_tile_any(ctx, tl); });
 			}
-			write_color(cout,color,samples_per_pixels);
-        }
-    }
+		}
+		pool.wait();
+
+		// the refinement pass looks at neighbours, so it waits for the
+		// whole first pass
+		if (ctx.min_samples > 0) {
+			for (size_t t = 0; t < tiles.size(); t++) {
+				tile tl = tiles[t];
+				pool.submit([&ctx, tl]() { render_tile_adaptive_refine(ctx, tl); finish_tile(ctx, tl); });
+			}
+			pool.wait();
+		}
+	}
+	// bench/scenes.cpp reads this line; a streaming framebuffer only
+	// holds its last band, but every pixel took --spp samples
+	{
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - render_start).count();
+		long long total = streaming ? (long long)image_width * image_height * samples_per_pixels : fb.total_samples();
+		cerr << "render: " << seconds << " s, " << total << " samples, " << total / seconds << " samples/s" << endl;
+		if (counters) counters->print_summary(cerr, seconds);
+		if (!opts.stats.empty() && !counters->write_json(opts.stats, seconds)) {
+			cerr << "couldn't write " << opts.stats << endl;
+			return 1;
+		}
+		render_stats::metric metric;
+		render_stats::parse_metric(opts.heatmap_metric, metric);
+		if (!opts.heatmap.empty() && !counters->write_heatmap(opts.heatmap, metric)) {
+			cerr << "couldn't write " << opts.heatmap << endl;
+			return 1;
+		}
+	}
+
+	if (output.is_open()) {
+		if (!output.close()) {
+			cerr << "couldn't write " << opts.output << endl;
+			return 1;
+		}
+		cerr << "wrote " << output.size() << " bytes to " << opts.output << endl;
+	} else if (streaming) {
+		// already written band by band
+	} else if (!opts.output.empty()) {
+		if (!write_image_file(fb, opts.output, opts.format)) {
+			cerr << "couldn't write " << opts.output << endl;
+			return 1;
+		}
+	} else {
+		TRACE_SCOPE("write image");
+		fb.write_ppm(cout, opts.format);
+	}
+
+	if (opts.adaptive > 0) {
+		long long total = fb.total_samples();
+		long long pixels = (long long)image_width * image_height;
+		cerr << "adaptive: " << total << " samples, " << double(total)/pixels
+			<< " per pixel (" << double(pixels)*samples_per_pixels/total
+			<< "x fewer than " << samples_per_pixels << ")" << endl;
+	}
+	if (opts.wavefront > 0) {
+		ray_queue sizing(opts.wavefront);
+		cerr << "wavefront: " << stats.rays << " rays, " << stats.shadow_rays_cast << " shadow rays, "
+			<< opts.wavefront << " per queue (" << sizing.memory_bytes() << " bytes)" << endl;
+		for (int i = 0; i < wavefront_stats::stage_count; i++) {
+			double ms = stats.ns[i] / 1e6;
+			cerr << "  " << wavefront_stats::name(i) << ": " << ms << " thread-ms, "
+				<< (stats.rays > 0 ? double(stats.ns[i]) / stats.rays : 0) << " ns/ray" << endl;
+		}
+	}
+	if (!opts.spp_image.empty()) {
+		ofstream spp_out(opts.spp_image.c_str());
+		fb.write_sample_counts(spp_out, samples_per_pixels);
+		if (!spp_out) {
+			cerr << "couldn't write " << opts.spp_image << endl;
+			return 1;
+		}
+	}
+	// the render threads are gone, so their buffers are quiet
+	if (!opts.trace.empty()) {
+		long long dropped;
+		if (!trace_write(opts.trace, dropped)) {
+			cerr << "couldn't write " << opts.trace << endl;
+			return 1;
+		}
+		if (dropped > 0) {
+			cerr << "trace: " << dropped << " oldest events dropped, raise --trace-events to keep them" << endl;
+		}
+	}
 
 	
 	return 0;
@@ -0,0 +1,90 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "ray.h"
+#include "util.h"
+
+/* Axis aligned bounding box. A default constructed box is empty and
+*	grows to fit whatever is added to it.
+*/
+class aabb {
+	public:
+		aabb() : minimum(infinity,infinity,infinity), maximum(-infinity,-infinity,-infinity) {}
+		aabb(const vec3& a, const vec3& b) : minimum(a), maximum(b) {}
+
+		vec3 min() const { return minimum; }
+		vec3 max() const { return maximum; }
+
+		/* Grows the box to contain the point p
+		*	@p: the point
+		*/
+		void expand(const vec3& p) {
+			for (int a = 0; a < 3; a++) {
+				if (p[a] < minimum[a]) minimum[a] = p[a];
+				if (p[a] > maximum[a]) maximum[a] = p[a];
+			}
+		}
+
+		/* Grows the box to contain the box b
+		*	@b: the box
+		*/
+		void expand(const aabb& b) {
+			expand(b.minimum);
+			expand(b.maximum);
+		}
+
+		/* Returns the center of the box.
+		*/
+		vec3 centroid() const {
+			return 0.5*(minimum + maximum);
+		}
+
+		/* Returns the index of the longest axis (0,1,2).
+		*/
+		int longest_axis() const {
+			vec3 e = maximum - minimum;
+			if (e[0] > e[1] && e[0] > e[2]) return 0;
+			return (e[1] > e[2]) ? 1 : 2;
+		}
+
+		/* Returns the surface area of the box, 0 if it is empty.
+		*/
+		double area() const {
+			vec3 e = maximum - minimum;
+			if (e[0] < 0 || e[1] < 0 || e[2] < 0) return 0;
+			return 2*(e[0]*e[1] + e[1]*e[2] + e[2]*e[0]);
+		}
+
+		/* Slab test of a ray against the box.
+		*	@o: ray origin
+		*	@inv_d: component-wise reciprocal of the ray direction
+		*	@t_min: min value of t
+		*	@t_max: max value of t
+		*	@t_enter: receives the t where the ray enters the box
+		*	returns true if the ray overlaps the box within [t_min,t_max].
+		*	Comparisons are written so that a NaN from 0*inf leaves the
+		*	interval unchanged instead of rejecting the box.
+		*/
+		bool hit(const vec3& o, const vec3& inv_d, double t_min, double t_max, double& t_enter) const {
+			for (int a = 0; a < 3; a++) {
+				double t0 = (minimum[a] - o[a]) * inv_d[a];
+				double t1 = (maximum[a] - o[a]) * inv_d[a];
+				if (inv_d[a] < 0) {
+					double tmp = t0;
+					t0 = t1;
+					t1 = tmp;
+				}
+				t_min = (t0 > t_min) ? t0 : t_min;
+				t_max = (t1 < t_max) ? t1 : t_max;
+				if (t_max < t_min) return false;
+			}
+			t_enter = t_min;
+			return true;
+		}
+
+	private:
+		vec3 minimum;
+		vec3 maximum;
+};
+
+#endif
@@ -0,0 +1,334 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <thread>
+
+namespace {
+	const int bin_count = 16;
+	const int max_leaf_size = 4;
+	const int median_split_depth = 32;		// keeps the tree within the traversal stack
+	const int parallel_build_min = 32768;	// smaller ranges aren't worth a thread
+}
+
+/* Builds the tree.
+*	@boxes: bounding box of every primitive
+*	@nodes: receives the flattened nodes, root first
+*	@order: receives the primitive indices in leaf order
+*/
+void bvh_builder::build(const std::vector<aabb>& boxes, std::vector<bvh_node>& nodes, std::vector<int>& order) {
+	nodes.clear();
+	order.resize(boxes.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = int(i);
+	if (boxes.empty()) return;
+
+	bvh_builder builder(boxes, order);
+	nodes.reserve(2*boxes.size() / max_leaf_size + 1);
+	builder.build_range(0, int(boxes.size()), 0, nodes);
+}
+
+/* Constructor. Caches the centroids and works out how many levels of
+*	the tree may be built on their own threads.
+*/
+bvh_builder::bvh_builder(const std::vector<aabb>& boxes, std::vector<int>& order) : boxes(boxes), order(order) {
+	centroids.resize(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		centroids[i] = boxes[i].centroid();
+	}
+	int threads = int(std::thread::hardware_concurrency());
+	parallel_depth = 0;
+	while ((1 << parallel_depth) < threads) parallel_depth++;
+}
+
+/* Recursively builds the subtree over order[begin,end) and appends its
+*	nodes to out. Child indices are relative to the start of out.
+*	@begin: first entry in order
+*	@end: one past the last entry
+*	@depth: depth of the subtree root
+*	@out: the node array to append to
+*/
+void bvh_builder::build_range(int begin, int end, int depth, std::vector<bvh_node>& out) {
+	aabb bounds, centroid_bounds;
+	for (int i = begin; i < end; i++) {
+		bounds.expand(boxes[order[i]]);
+		centroid_bounds.expand(centroids[order[i]]);
+	}
+
+	int node_index = int(out.size());
+	bvh_node node;
+	node.box = bounds;
+	node.start = begin;
+	node.count = end - begin;
+	out.push_back(node);
+
+	int mid = split_range(begin, end, depth, bounds, centroid_bounds);
+	if (mid < 0) return;	// stays a leaf
+	out[node_index].count = 0;
+
+	if (end - begin >= parallel_build_min && depth < parallel_depth) {
+		// the halves touch disjoint parts of order, so they can be
+		// built at the same time and spliced together afterwards.
+		std::vector<bvh_node> left_nodes, right_nodes;
+		std::future<void> left = std::async(std::launch::async, [&]() {
+			build_range(begin, mid, depth + 1, left_nodes);
+		});
+		build_range(mid, end, depth + 1, right_nodes);
+		left.wait();
+
+		const std::vector<bvh_node>* parts[2] = { &left_nodes, &right_nodes };
+		for (int p = 0; p < 2; p++) {
+			int base = int(out.size());
+			if (p == 1) out[node_index].start = base;
+			for (size_t i = 0; i < parts[p]->size(); i++) {
+				bvh_node n = (*parts[p])[i];
+				if (n.count == 0) n.start += base;
+				out.push_back(n);
+			}
+		}
+		return;
+	}
+
+	build_range(begin, mid, depth + 1, out);
+	out[node_index].start = int(out.size());
+	build_range(mid, end, depth + 1, out);
+}
+
+/* Picks the split of order[begin,end) with the lowest SAH cost and
+*	partitions order around it.
+*	@begin: first entry in order
+*	@end: one past the last entry
+*	@depth: depth of the node being split
+*	@bounds: box around the primitives
+*	@centroid_bounds: box around their centroids
+*	returns the partition point, or -1 if the range should be a leaf.
+*/
+int bvh_builder::split_range(int begin, int end, int depth, const aabb& bounds, const aabb& centroid_bounds) {
+	int n = end - begin;
+	if (n <= 1) return -1;
+
+	int axis = centroid_bounds.longest_axis();
+	double cmin = centroid_bounds.min()[axis];
+	double cmax = centroid_bounds.max()[axis];
+	if (cmax <= cmin) {
+		// every centroid is in the same place, nothing separates them
+		if (n <= max_leaf_size) return -1;
+		int mid = begin + n/2;
+		return mid;
+	}
+
+	int mid = -1;
+	if (depth < median_split_depth) {
+		int counts[bin_count] = {0};
+		aabb bin_boxes[bin_count];
+		double scale = bin_count / (cmax - cmin);
+		for (int i = begin; i < end; i++) {
+			int b = int((centroids[order[i]][axis] - cmin) * scale);
+			if (b >= bin_count) b = bin_count - 1;
+			counts[b]++;
+			bin_boxes[b].expand(boxes[order[i]]);
+		}
+
+		// sweep from the right to get the cost of every right side
+		double right_cost[bin_count];
+		aabb acc;
+		int acc_count = 0;
+		for (int b = bin_count - 1; b > 0; b--) {
+			acc.expand(bin_boxes[b]);
+			acc_count += counts[b];
+			right_cost[b] = acc_count * acc.area();
+		}
+
+		// sweep from the left and combine
+		int best_split = -1;
+		double best_cost = infinity;
+		acc = aabb();
+		acc_count = 0;
+		for (int b = 0; b < bin_count - 1; b++) {
+			acc.expand(bin_boxes[b]);
+			acc_count += counts[b];
+			double cost = acc_count * acc.area() + right_cost[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+
+		// cost of traversing one node plus the children, against
+		// intersecting everything in a leaf
+		double parent_area = bounds.area();
+		double split_cost = 1.0 + ((parent_area > 0) ? best_cost / parent_area : n);
+		if (n <= max_leaf_size && split_cost >= n) return -1;
+
+		int* first = order.data() + begin;
+		int* last = order.data() + end;
+		const std::vector<vec3>& c = centroids;
+		int* p = std::partition(first, last, [&](int prim) {
+			int b = int((c[prim][axis] - cmin) * scale);
+			if (b >= bin_count) b = bin_count - 1;
+			return b <= best_split;
+		});
+		mid = int(p - order.data());
+	}
+
+	if (mid <= begin || mid >= end) {
+		// SAH failed to separate the range, fall back to a median split
+		mid = begin + n/2;
+		const std::vector<vec3>& c = centroids;
+		std::nth_element(order.data() + begin, order.data() + mid, order.data() + end, [&](int a, int b) {
+			return c[a][axis] < c[b][axis];
+		});
+	}
+	return mid;
+}
+
+/* Constructor. Builds the tree over the bounded objects of list.
+*	@list: the scene objects
+*/
+bvh::bvh(const hittable_list& list) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<shared_ptr<hittable>> bounded;
+	std::vector<aabb> boxes;
+	aabb box;
+	for (const auto& object : list.objects()) {
+		if (object->bounding_box(box)) {
+			bounded.push_back(object);
+			boxes.push_back(box);
+		} else {
+			unbounded.add(object);
+		}
+	}
+
+	std::vector<int> order;
+	bvh_builder::build(boxes, nodes, order);
+	primitives.resize(order.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		primitives[i] = bounded[order[i]];
+	}
+
+	build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Determines if the ray hits any object, using the tree for the bounded
+*	objects and a linear test for the rest.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: hit record to store the info
+*/
+bool bvh::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	double closest_so_far = t_max;
+	bool hit_anything = bvh_traverse(nodes, r, t_min, closest_so_far, false,
+		[&](int first, int count, double& t_limit) {
+			bool hit_leaf = false;
+			for (int i = first; i < first + count; i++) {
+				if (primitives[i]->hit(r, t_min, t_limit, rec)) {
+					hit_leaf = true;
+					t_limit = rec.t;
+				}
+			}
+			return hit_leaf;
+		});
+
+	if (unbounded.hit(r, t_min, closest_so_far, rec)) hit_anything = true;
+	return hit_anything;
+}
+
+/* Determines if the ray hits anything, leaving the tree at the first
+*	primitive found.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+bool bvh::occluded(const ray& r, double t_min, double t_max) const {
+	if (unbounded.occluded(r, t_min, t_max)) return true;
+	return bvh_traverse(nodes, r, t_min, t_max, true,
+		[&](int first, int count, double& t_limit) {
+			for (int i = first; i < first + count; i++) {
+				if (primitives[i]->occluded(r, t_min, t_limit)) return true;
+			}
+			return false;
+		});
+}
+
+/* Traces a packet through the tree. Nodes outside the packet's frustum
+*	are skipped for the whole packet; inside a leaf each ray is tested
+*	against the leaf box and then its primitives. Packets without a
+*	frustum are traced one ray at a time.
+*	@packet: the rays, receives the hits
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+void bvh::hit_packet(ray_packet& packet, double t_min, double t_max) const {
+	if (!packet.bounds.valid() || nodes.empty()) {
+		hittable::hit_packet(packet, t_min, t_max);
+		return;
+	}
+
+	double closest[ray_packet::max_rays];
+	vec3 inv_d[ray_packet::max_rays];
+	for (int i = 0; i < packet.count; i++) {
+		vec3 d = packet.rays[i].direction();
+		inv_d[i] = vec3(1.0/d[0], 1.0/d[1], 1.0/d[2]);
+		closest[i] = t_max;
+		packet.hits[i] = false;
+	}
+
+	// children are visited nearest first along the packet's middle ray
+	const ray& mid = packet.rays[packet.count / 2];
+	vec3 mid_o = mid.origin();
+	vec3 mid_inv = inv_d[packet.count / 2];
+
+	int stack[64];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const bvh_node& node = nodes[stack[--sp]];
+		if (!packet.bounds.overlaps(node.box)) continue;
+
+		if (node.count == 0) {
+			int left = int(&node - &nodes[0]) + 1;
+			int right = node.start;
+			double t_left = infinity, t_right = infinity;
+			COUNT_STAT(tests[render_counters::node_tests], 2);
+			nodes[left].box.hit(mid_o, mid_inv, t_min, infinity, t_left);
+			nodes[right].box.hit(mid_o, mid_inv, t_min, infinity, t_right);
+			if (t_left <= t_right) {
+				stack[sp++] = right;
+				stack[sp++] = left;
+			} else {
+				stack[sp++] = left;
+				stack[sp++] = right;
+			}
+			continue;
+		}
+
+		for (int i = 0; i < packet.count; i++) {
+			const ray& r = packet.rays[i];
+			double t_enter;
+			COUNT_STAT(tests[render_counters::node_tests], 1);
+			if (!node.box.hit(r.origin(), inv_d[i], t_min, closest[i], t_enter)) continue;
+			for (int p = node.start; p < node.start + node.count; p++) {
+				if (primitives[p]->hit(r, t_min, closest[i], packet.recs[i])) {
+					packet.hits[i] = true;
+					closest[i] = packet.recs[i].t;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < packet.count; i++) {
+		if (unbounded.hit(packet.rays[i], t_min, closest[i], packet.recs[i])) packet.hits[i] = true;
+	}
+}
+
+/* Returns the box around the tree.
+*	@output_box: receives the box
+*	returns false if the scene has unbounded objects or nothing in it.
+*/
+bool bvh::bounding_box(aabb& output_box) const {
+	if (nodes.empty() || !unbounded.objects().empty()) return false;
+	output_box = nodes[0].box;
+	return true;
+}
@@ -0,0 +1,128 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "aabb.h"
+#include "render_stats.h"
+
+#include <memory>
+#include <vector>
+
+/* A node of a flattened BVH. The left child of an internal node is
+*	always the node right after it, so only the right child is stored.
+*/
+struct bvh_node {
+	aabb box;
+	int start;	// leaf: first entry in the primitive order, internal: right child
+	int count;	// number of primitives in a leaf, 0 for internal nodes
+};
+
+/* Builds a BVH over a set of boxes using the surface area heuristic
+*	evaluated over a fixed number of bins per split. Large inputs build
+*	their top levels in parallel.
+*/
+class bvh_builder {
+	public:
+		static void build(const std::vector<aabb>& boxes, std::vector<bvh_node>& nodes, std::vector<int>& order);
+
+	private:
+		bvh_builder(const std::vector<aabb>& boxes, std::vector<int>& order);
+		void build_range(int begin, int end, int depth, std::vector<bvh_node>& out);
+		int split_range(int begin, int end, int depth, const aabb& bounds, const aabb& centroid_bounds);
+
+	private:
+		const std::vector<aabb>& boxes;
+		std::vector<vec3> centroids;
+		std::vector<int>& order;
+		int parallel_depth;
+};
+
+/* Walks a flattened BVH front to back, calling leaf(first, count, t_max)
+*	for every leaf the ray reaches. leaf returns true when it found a hit
+*	and lowers t_max to it. If any_hit is set the walk stops at the first
+*	leaf that reports a hit.
+*	returns true if any leaf reported a hit.
+*/
+template <typename LeafFn>
+bool bvh_traverse(const bvh_node* nodes, size_t node_count, const ray& r, double t_min, double& t_max, bool any_hit, LeafFn leaf) {
+	if (node_count == 0) return false;
+
+	vec3 o = r.origin();
+	vec3 d = r.direction();
+	vec3 inv_d = vec3(1.0/d[0], 1.0/d[1], 1.0/d[2]);
+
+	double t_enter;
+	COUNT_STAT(tests[render_counters::node_tests], 1);
+	if (!nodes[0].box.hit(o, inv_d, t_min, t_max, t_enter)) return false;
+
+	bool hit_anything = false;
+	int stack[64];
+	int sp = 0;
+	int idx = 0;
+	while (true) {
+		const bvh_node& node = nodes[idx];
+		if (node.count > 0) {
+			if (leaf(node.start, node.count, t_max)) {
+				hit_anything = true;
+				if (any_hit) return true;
+			}
+		} else {
+			int left = idx + 1;
+			int right = node.start;
+			double t_left, t_right;
+			COUNT_STAT(tests[render_counters::node_tests], 2);
+			bool hit_left = nodes[left].box.hit(o, inv_d, t_min, t_max, t_left);
+			bool hit_right = nodes[right].box.hit(o, inv_d, t_min, t_max, t_right);
+			if (hit_left && hit_right) {
+				// visit the nearer child first, come back for the other
+				if (t_right < t_left) {
+					int tmp = left;
+					left = right;
+					right = tmp;
+				}
+				stack[sp++] = right;
+				idx = left;
+				continue;
+			}
+			if (hit_left) { idx = left; continue; }
+			if (hit_right) { idx = right; continue; }
+		}
+		if (sp == 0) break;
+		idx = stack[--sp];
+	}
+	return hit_anything;
+}
+
+template <typename LeafFn>
+bool bvh_traverse(const std::vector<bvh_node>& nodes, const ray& r, double t_min, double& t_max, bool any_hit, LeafFn leaf) {
+	return bvh_traverse(nodes.data(), nodes.size(), r, t_min, t_max, any_hit, leaf);
+}
+
+/* Bounding volume hierarchy over the bounded objects of a hittable_list.
+*	Unbounded objects (planes) can't be placed in the tree, so they are
+*	kept in a small list that every ray tests after the tree.
+*/
+class bvh : public hittable {
+	public:
+		bvh(const hittable_list& list);
+
+		virtual bool hit(
+			const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+		virtual bool bounding_box(aabb& output_box) const override;
+		virtual void hit_packet(ray_packet& packet, double t_min, double t_max) const override;
+
+		int primitive_count() const { return int(primitives.size()); }
+		int node_count() const { return int(nodes.size()); }
+
+	public:
+		double build_seconds;	// wall time spent in the constructor
+
+	private:
+		std::vector<shared_ptr<hittable>> primitives;	// in leaf order
+		std::vector<bvh_node> nodes;
+		hittable_list unbounded;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+namespace {
+	const char checkpoint_magic[8] = { 'M', 'P', '1', 'C', 'K', 'P', 'T', '2' };
+}
+
+/* Saves the render state.
+*	@path: where to write
+*	@fb: the framebuffer; only its pixels with samples matter
+*	@state: the settings and progress of the render
+*	returns false if the file couldn't be written.
+*/
+bool write_checkpoint(const std::string& path, const framebuffer& fb, const checkpoint_state& state) {
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream out(tmp.c_str(), std::ios::binary);
+		int32_t header[3] = { state.samples_per_pixel, state.passes, int32_t(state.sampler.size()) };
+		out.write(checkpoint_magic, sizeof(checkpoint_magic));
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(&state.settings), sizeof(state.settings));
+		out.write(state.sampler.data(), state.sampler.size());
+		fb.write_state(out);
+		out.flush();
+		if (!out) return false;
+	}
+	return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+/* Loads a checkpoint into a framebuffer of the same size.
+*	@path: the file
+*	@fb: receives the accumulated samples
+*	@state: receives the settings and progress of the saved render
+*	returns false if the file can't be read, isn't a checkpoint or is
+*	for an image of another size.
+*/
+bool read_checkpoint(const std::string& path, framebuffer& fb, checkpoint_state& state) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	char magic[sizeof(checkpoint_magic)];
+	int32_t header[3];
+	uint64_t settings;
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0) return false;
+	if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+	if (!in.read(reinterpret_cast<char*>(&settings), sizeof(settings))) return false;
+	if (header[2] < 0 || header[2] > 64) return false;
+	std::string name(size_t(header[2]), ' ');
+	if (!in.read(&name[0], name.size())) return false;
+	if (!fb.read_state(in)) return false;
+	state.samples_per_pixel = header[0];
+	state.passes = header[1];
+	state.sampler = name;
+	state.settings = settings;
+	return true;
+}
@@ -0,0 +1,33 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <string>
+#include "framebuffer.h"
+
+/* What a render has to agree on to continue from a checkpoint, and how
+*	far the saved one got.
+*/
+struct checkpoint_state {
+	int samples_per_pixel;	// size of the sample pattern
+	std::string sampler;	// its name, see sampler::parse
+	int passes;				// progressive passes done, -1 for a tiled render
+	uint64_t settings;		// hash of the scene, camera and precision, see render_settings
+
+	bool compatible(const checkpoint_state& other) const {
+		return samples_per_pixel == other.samples_per_pixel && sampler == other.sampler
+			&& (passes < 0) == (other.passes < 0) && settings == other.settings;
+	}
+};
+
+/* A checkpoint file is a small header followed by the framebuffer's raw
+*	accumulation state (unquantized linear color sums and sample counts),
+*	so a render can be continued exactly where it stopped. The file is
+*	written through a temporary and renamed, so a node killed while
+*	writing leaves the previous checkpoint intact. Checkpoints are only
+*	read back on machines with the same byte order.
+*/
+bool write_checkpoint(const std::string& path, const framebuffer& fb, const checkpoint_state& state);
+bool read_checkpoint(const std::string& path, framebuffer& fb, checkpoint_state& state);
+
+#endif
@@ -0,0 +1,521 @@
+#include "distributed.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	const char tile_magic[8] = { 'M', 'P', '1', 'T', 'I', 'L', 'E', '1' };
+	const int poll_ms = 100;			// how often timeouts and backups are looked at
+	const double backup_factor = 2;		// a tile out this many usual tile times gets a copy
+
+	/* Opens a stream socket on an address and listens on it or connects
+	*	to it.
+	*	@address: unix:PATH or HOST:PORT; an empty or * host listens on
+	*		every interface
+	*	@server: listen rather than connect
+	*	@fd: receives the socket
+	*	@unix_path: receives the path of a listening Unix socket
+	*	@error: receives a message on failure
+	*	returns false if the address is bad or the socket can't be opened.
+	*/
+	bool open_socket(const std::string& address, bool server, int& fd, std::string& unix_path, std::string& error) {
+		if (address.compare(0, 5, "unix:") == 0) {
+			std::string path = address.substr(5);
+			sockaddr_un sa;
+			memset(&sa, 0, sizeof(sa));
+			sa.sun_family = AF_UNIX;
+			if (path.empty() || path.size() >= sizeof(sa.sun_path)) {
+				error = "bad socket path " + path;
+				return false;
+			}
+			strcpy(sa.sun_path, path.c_str());
+			fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0) {
+				error = "can't create a socket for " + address;
+				return false;
+			}
+			if (server) {
+				// a socket left behind by an earlier run, never another file
+				struct stat st;
+				if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path.c_str());
+				if (bind(fd, (sockaddr*)&sa, sizeof(sa)) == 0 && ::listen(fd, 64) == 0) {
+					unix_path = path;
+					return true;
+				}
+			} else if (::connect(fd, (sockaddr*)&sa, sizeof(sa)) == 0) {
+				return true;
+			}
+			error = std::string(server ? "can't listen on " : "can't connect to ") + address + ": " + strerror(errno);
+			::close(fd);
+			return false;
+		}
+
+		size_t colon = address.rfind(':');
+		if (colon == std::string::npos) {
+			error = "address must be unix:PATH or HOST:PORT, not " + address;
+			return false;
+		}
+		std::string host = address.substr(0, colon);
+		std::string port = address.substr(colon + 1);
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (server) hints.ai_flags = AI_PASSIVE;
+		addrinfo* found = 0;
+		int status = getaddrinfo((host.empty() || host == "*") ? 0 : host.c_str(), port.c_str(), &hints, &found);
+		if (status != 0) {
+			error = "can't resolve " + address + ": " + gai_strerror(status);
+			return false;
+		}
+		fd = -1;
+		std::string reason = "no address";
+		for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+			fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			if (fd < 0) continue;
+			int on = 1;
+			bool ok;
+			if (server) {
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+				ok = bind(fd, a->ai_addr, a->ai_addrlen) == 0 && ::listen(fd, 64) == 0;
+			} else {
+				ok = ::connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+				if (ok) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			}
+			if (!ok) {
+				reason = strerror(errno);
+				::close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(found);
+		if (fd < 0) {
+			error = std::string(server ? "can't listen on " : "can't connect to ") + address + ": " + reason;
+			return false;
+		}
+		return true;
+	}
+
+	/* Sends all of a buffer, waiting while the socket is full.
+	*	returns false if the connection failed.
+	*/
+	bool send_all(int fd, const void* data, size_t size) {
+		const char* p = (const char*)data;
+		while (size > 0) {
+			ssize_t sent = ::send(fd, p, size, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR) continue;
+			if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				pollfd pfd = { fd, POLLOUT, 0 };
+				poll(&pfd, 1, poll_ms);
+				continue;
+			}
+			if (sent <= 0) return false;
+			p += sent;
+			size -= size_t(sent);
+		}
+		return true;
+	}
+
+	/* Reads exactly size bytes.
+	*	returns false on end of file or failure.
+	*/
+	bool recv_all(int fd, void* data, size_t size) {
+		char* p = (char*)data;
+		while (size > 0) {
+			ssize_t got = ::recv(fd, p, size, 0);
+			if (got < 0 && errno == EINTR) continue;
+			if (got <= 0) return false;
+			p += got;
+			size -= size_t(got);
+		}
+		return true;
+	}
+
+	/* The peer of an accepted connection, for messages.
+	*/
+	std::string peer_name(const sockaddr_storage& sa, int number) {
+		char host[INET6_ADDRSTRLEN] = "";
+		std::ostringstream name;
+		if (sa.ss_family == AF_INET) {
+			const sockaddr_in* in = (const sockaddr_in*)&sa;
+			inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+			name << host << ":" << ntohs(in->sin_port);
+		} else if (sa.ss_family == AF_INET6) {
+			const sockaddr_in6* in = (const sockaddr_in6*)&sa;
+			inet_ntop(AF_INET6, &in->sin6_addr, host, sizeof(host));
+			name << "[" << host << "]:" << ntohs(in->sin6_port);
+		} else {
+			name << "local #" << number;
+		}
+		return name.str();
+	}
+
+	double seconds_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+		return std::chrono::duration<double>(b - a).count();
+	}
+}
+
+bool parse_injected_fault(const std::string& text, injected_fault& out) {
+	size_t colon = text.find(':');
+	if (colon == std::string::npos) return false;
+	std::string kind = text.substr(0, colon);
+	std::string count = text.substr(colon + 1);
+	char* end;
+	long after = strtol(count.c_str(), &end, 10);
+	if (count.empty() || *end != '\0' || after < 0) return false;
+	if (kind == "crash") {
+		out.type = injected_fault::crash;
+	} else if (kind == "hang") {
+		out.type = injected_fault::hang;
+	} else {
+		return false;
+	}
+	out.after = int(after);
+	return true;
+}
+
+tile_hello make_tile_hello(int width, int height, int samples_per_pixel, uint64_t settings) {
+	tile_hello hello = tile_hello();
+	memcpy(hello.magic, tile_magic, sizeof(hello.magic));
+	hello.width = width;
+	hello.height = height;
+	hello.samples_per_pixel = samples_per_pixel;
+	hello.slots = 1;
+	hello.settings = settings;
+	return hello;
+}
+
+/* Constructor. Nothing is opened until listen().
+*/
+tile_coordinator::tile_coordinator(const tile_hello& expected, double worker_timeout) :
+	workers_joined(0), workers_lost(0), workers_rejected(0), tiles_reassigned(0), backup_tiles(0), results_dropped(0),
+	expected(expected), worker_timeout(worker_timeout), listen_fd(-1), connections(0), jobs(0), handler(0), remaining(0),
+	result_seconds(0), result_count(0) {
+}
+
+/* Destructor. Closes every connection and removes a Unix socket.
+*/
+tile_coordinator::~tile_coordinator() {
+	for (size_t k = 0; k < workers.size(); k++) ::close(workers[k].fd);
+	if (listen_fd >= 0) ::close(listen_fd);
+	if (!unix_path.empty()) unlink(unix_path.c_str());
+}
+
+/* Starts listening for workers.
+*	@address: unix:PATH or HOST:PORT
+*	@error: receives a message on failure
+*	returns false if the address can't be listened on.
+*/
+bool tile_coordinator::listen(const std::string& address, std::string& error) {
+	if (!open_socket(address, true, listen_fd, unix_path, error)) return false;
+	fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+	return true;
+}
+
+bool tile_coordinator::run(const std::vector<tile_job>& tiles, const result_handler& on_result,
+	const std::function<bool()>& no_more_workers, std::string& error) {
+	jobs = &tiles;
+	handler = &on_result;
+	pending.clear();
+	for (size_t i = 0; i < tiles.size(); i++) pending.push_back(int(i));
+	done.assign(tiles.size(), 0);
+	copies.assign(tiles.size(), 0);
+	remaining = int(tiles.size());
+
+	std::vector<pollfd> fds;
+	while (remaining > 0) {
+		fds.clear();
+		pollfd listener = { listen_fd, POLLIN, 0 };
+		fds.push_back(listener);
+		for (size_t k = 0; k < workers.size(); k++) {
+			pollfd p = { workers[k].fd, POLLIN, 0 };
+			fds.push_back(p);
+		}
+		if (poll(fds.data(), fds.size(), poll_ms) < 0 && errno != EINTR) {
+			error = std::string("poll failed: ") + strerror(errno);
+			return false;
+		}
+
+		// backwards, so dropping a worker doesn't move the ones still to look at
+		for (size_t k = workers.size(); k-- > 0;) {
+			if (fds[k + 1].revents == 0) continue;
+			std::string reason;
+			if (!read_worker(workers[k], reason)) drop_worker(k, reason);
+		}
+		if (fds[0].revents & POLLIN) accept_workers();
+
+		clock::time_point now = clock::now();
+		for (size_t k = workers.size(); k-- > 0;) {
+			const worker& w = workers[k];
+			if (worker_timeout > 0 && !w.tiles.empty() && seconds_between(w.tiles.front().since, now) > worker_timeout) {
+				drop_worker(k, "timed out");
+			}
+		}
+		for (size_t k = workers.size(); k-- > 0 && remaining > 0;) {
+			if (workers[k].greeted && !deal(workers[k])) drop_worker(k, "send failed");
+		}
+
+		if (workers.empty() && remaining > 0 && no_more_workers()) {
+			std::ostringstream message;
+			message << "no workers left, " << remaining << " of " << tiles.size() << " tiles not rendered";
+			error = message.str();
+			return false;
+		}
+	}
+
+	tile_job stop = { -1, 0, 0, 0, 0 };
+	for (size_t k = 0; k < workers.size(); k++) {
+		send_all(workers[k].fd, &stop, sizeof(stop));
+		::close(workers[k].fd);
+	}
+	workers.clear();
+	return true;
+}
+
+/* Takes every connection waiting on the listening socket.
+*/
+void tile_coordinator::accept_workers() {
+	for (;;) {
+		sockaddr_storage sa;
+		socklen_t length = sizeof(sa);
+		int fd = accept(listen_fd, (sockaddr*)&sa, &length);
+		if (fd < 0 && errno == EINTR) continue;
+		if (fd < 0) return;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));	// fails harmlessly on Unix sockets
+
+		worker w;
+		w.fd = fd;
+		w.name = peer_name(sa, ++connections);
+		w.greeted = false;
+		w.slots = 0;
+		workers.push_back(w);
+	}
+}
+
+/* Reads what a worker has sent and acts on every whole message.
+*	@w: the worker
+*	@reason: receives why the connection is no good
+*	returns false if the worker should be dropped.
+*/
+bool tile_coordinator::read_worker(worker& w, std::string& reason) {
+	char buffer[65536];
+	for (;;) {
+		ssize_t got = ::recv(w.fd, buffer, sizeof(buffer), 0);
+		if (got > 0) {
+			w.input.insert(w.input.end(), buffer, buffer + got);
+			continue;
+		}
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		// anything left over is a half sent message, dropped with the worker
+		reason = (got == 0) ? "connection closed" : strerror(errno);
+		parse_input(w, reason);
+		return false;
+	}
+	return parse_input(w, reason);
+}
+
+/* Handles the whole messages at the front of a worker's input.
+*	@w: the worker
+*	@reason: receives why the worker is no good
+*	returns false if the worker sent something it shouldn't.
+*/
+bool tile_coordinator::parse_input(worker& w, std::string& reason) {
+	size_t used = 0;
+	std::vector<tile_pixel> pixels;
+	for (;;) {
+		const char* p = w.input.data() + used;
+		size_t left = w.input.size() - used;
+		if (!w.greeted) {
+			if (left < sizeof(tile_hello)) break;
+			tile_hello hello;
+			memcpy(&hello, p, sizeof(hello));
+			if (memcmp(hello.magic, tile_magic, sizeof(tile_magic)) != 0) {
+				reason = "not a worker";
+				return false;
+			}
+			if (hello.width != expected.width || hello.height != expected.height
+				|| hello.samples_per_pixel != expected.samples_per_pixel || hello.settings != expected.settings) {
+				reason = "renders with other settings";
+				return false;
+			}
+			w.greeted = true;
+			w.slots = (hello.slots < 1) ? 1 : (hello.slots > 1024) ? 1024 : hello.slots;
+			workers_joined++;
+			std::cerr << "worker " << w.name << " joined, " << w.slots << " tiles at a time" << std::endl;
+			used += sizeof(hello);
+			continue;
+		}
+
+		if (left < sizeof(tile_result)) break;
+		tile_result head;
+		memcpy(&head, p, sizeof(head));
+		size_t a = 0;
+		while (a < w.tiles.size() && w.tiles[a].id != head.id) a++;
+		if (a == w.tiles.size()) {
+			reason = "sent a tile it wasn't given";
+			return false;
+		}
+		const tile_job& job = (*jobs)[head.id];
+		size_t bytes = sizeof(head) + job.pixel_count() * sizeof(tile_pixel);
+		if (left < bytes) break;
+
+		clock::time_point since = w.tiles[a].since;
+		w.tiles.erase(w.tiles.begin() + a);
+		copies[head.id]--;
+		if (done[head.id]) {
+			results_dropped++;
+		} else {
+			done[head.id] = 1;
+			remaining--;
+			result_seconds += seconds_between(since, clock::now());
+			result_count++;
+			// copied out, the input buffer has no alignment to speak of
+			pixels.resize(job.pixel_count());
+			memcpy(pixels.data(), p + sizeof(head), pixels.size() * sizeof(tile_pixel));
+			(*handler)(job, pixels.data());
+		}
+		used += bytes;
+	}
+	w.input.erase(w.input.begin(), w.input.begin() + used);
+	return true;
+}
+
+/* Closes a worker's connection and puts the tiles it had, that no other
+*	worker has, back at the front of the queue.
+*	@index: the worker
+*	@reason: for the message
+*/
+void tile_coordinator::drop_worker(size_t index, const std::string& reason) {
+	worker& w = workers[index];
+	int returned = 0;
+	for (size_t a = 0; a < w.tiles.size(); a++) {
+		int id = w.tiles[a].id;
+		copies[id]--;
+		if (!done[id] && copies[id] == 0) {
+			pending.push_front(id);
+			returned++;
+		}
+	}
+	tiles_reassigned += returned;
+	if (w.greeted) {
+		workers_lost++;
+		std::cerr << "worker " << w.name << " lost (" << reason << "), " << returned << " tiles reassigned" << std::endl;
+	} else {
+		workers_rejected++;
+		std::cerr << "worker " << w.name << " rejected (" << reason << ")" << std::endl;
+	}
+	::close(w.fd);
+	workers.erase(workers.begin() + index);
+}
+
+/* Fills a worker's free slots from the queue, or with backup tiles once
+*	the queue is empty.
+*	@w: the worker
+*	returns false if sending failed.
+*/
+bool tile_coordinator::deal(worker& w) {
+	clock::time_point now = clock::now();
+	while (int(w.tiles.size()) < w.slots) {
+		int id = -1;
+		while (id < 0 && !pending.empty()) {
+			int next = pending.front();
+			pending.pop_front();
+			if (!done[next]) id = next;
+		}
+		bool backup = false;
+		if (id < 0) {
+			id = pick_backup(w, now);
+			backup = true;
+		}
+		if (id < 0) break;
+		if (!send_all(w.fd, &(*jobs)[id], sizeof(tile_job))) {
+			if (!backup) pending.push_front(id);
+			return false;
+		}
+		assignment given = { id, now };
+		w.tiles.push_back(given);
+		copies[id]++;
+		if (backup) backup_tiles++;
+	}
+	return true;
+}
+
+/* The tile to copy onto an idle worker: the one out longest on a single
+*	other worker, if that is well past the usual time for a tile.
+*	@w: the idle worker
+*	@now: the time
+*	returns the tile, or -1 for none.
+*/
+int tile_coordinator::pick_backup(const worker& w, clock::time_point now) const {
+	if (result_count == 0) return -1;
+	double usual = result_seconds / result_count;
+	int best = -1;
+	clock::time_point oldest = now;
+	for (size_t k = 0; k < workers.size(); k++) {
+		const worker& other = workers[k];
+		if (&other == &w) continue;
+		for (size_t a = 0; a < other.tiles.size(); a++) {
+			const assignment& given = other.tiles[a];
+			if (done[given.id] || copies[given.id] > 1) continue;
+			if (seconds_between(given.since, now) < backup_factor * usual) continue;
+			if (given.since < oldest) {
+				oldest = given.since;
+				best = given.id;
+			}
+		}
+	}
+	return best;
+}
+
+/* Constructor. Not connected until connect().
+*/
+tile_worker::tile_worker() : fd(-1) {
+}
+
+tile_worker::~tile_worker() {
+	if (fd >= 0) ::close(fd);
+}
+
+/* Connects to a coordinator and introduces this worker.
+*	@address: unix:PATH or HOST:PORT
+*	@hello: what this worker renders
+*	@error: receives a message on failure
+*	returns false if the coordinator can't be reached.
+*/
+bool tile_worker::connect(const std::string& address, const tile_hello& hello, std::string& error) {
+	std::string unused;
+	if (!open_socket(address, false, fd, unused, error)) return false;
+	if (!send_all(fd, &hello, sizeof(hello))) {
+		error = "can't talk to " + address;
+		return false;
+	}
+	return true;
+}
+
+bool tile_worker::next(tile_job& job) {
+	return recv_all(fd, &job, sizeof(job)) && job.id >= 0;
+}
+
+bool tile_worker::send(const tile_job& job, const tile_pixel* pixels, size_t count) {
+	tile_result head;
+	head.id = job.id;
+	head.pad = 0;
+	std::lock_guard<std::mutex> hold(send_lock);
+	return send_all(fd, &head, sizeof(head)) && send_all(fd, pixels, count * sizeof(tile_pixel));
+}
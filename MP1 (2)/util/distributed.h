@@ -0,0 +1,198 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "vec3.h"
+
+/* Rendering across processes. A coordinator splits the image into tiles
+*	and hands them out over stream sockets to worker processes; each
+*	worker loads the scene once and renders whatever tiles it is sent.
+*	Addresses are unix:PATH for a Unix domain socket or HOST:PORT for
+*	TCP, so workers can run on this machine or on others.
+*
+*	Messages are fixed size records in the byte order and layout of the
+*	machines involved, like a scene cache:
+*		worker -> coordinator: a tile_hello, then for every tile it is
+*			given a tile_result and one tile_pixel per pixel, bottom row
+*			first
+*		coordinator -> worker: tile_jobs, one with id -1 to stop
+*	A worker is sent up to its hello's slots tiles at once so its render
+*	threads don't wait on the network.
+*
+*	The coordinator takes tiles back from a worker whose connection
+*	closes or fails, half sent result and all, and from one that has
+*	sat on a tile longer than the worker timeout, and hands them to the
+*	others. Once every tile is out, idle workers are given copies of the
+*	tiles that have been out longer than tiles usually take (backup
+*	tiles), so one slow worker can't hold up the end of the frame. The
+*	first result for a tile is kept and later ones dropped.
+*/
+
+struct tile_hello {
+	char magic[8];				// "MP1TILE1"
+	int32_t width;
+	int32_t height;
+	int32_t samples_per_pixel;
+	int32_t slots;				// tiles it wants in flight
+	uint64_t settings;			// hash of the settings that change the image
+};
+
+struct tile_job {
+	int32_t id;					// index in the coordinator's list, -1 = stop
+	int32_t x0, y0;				// pixels [x0,x1) x [y0,y1)
+	int32_t x1, y1;
+
+	size_t pixel_count() const { return size_t(x1 - x0) * size_t(y1 - y0); }
+};
+
+struct tile_result {
+	int32_t id;
+	int32_t pad;
+};
+
+struct tile_pixel {
+	vec3 sum;					// the framebuffer's color sum
+	int32_t samples;
+	int32_t pad;
+};
+
+/* A fault for a worker to inject, to test the coordinator's recovery:
+*	after rendering `after` tiles the worker renders half of the next,
+*	sends that half and then exits (crash) or stops answering (hang).
+*/
+struct injected_fault {
+	enum kind { none, crash, hang };
+	kind type;
+	int after;
+};
+
+/* Parses crash:N or hang:N.
+*	@text: the flag value
+*	@out: receives the fault
+*	returns false if the text is neither.
+*/
+bool parse_injected_fault(const std::string& text, injected_fault& out);
+
+/* The hello a worker sends, filled in but for slots.
+*/
+tile_hello make_tile_hello(int width, int height, int samples_per_pixel, uint64_t settings);
+
+/* The coordinator's end: accepts workers, deals out the tiles and hands
+*	every first result to the caller. Single threaded; it only waits in
+*	poll().
+*/
+class tile_coordinator {
+	public:
+		typedef std::function<void(const tile_job&, const tile_pixel*)> result_handler;
+
+		/* Constructor.
+		*	@expected: what workers must render; slots is ignored
+		*	@worker_timeout: seconds a worker may keep a tile before it
+		*		is dropped, 0 for no limit
+		*/
+		tile_coordinator(const tile_hello& expected, double worker_timeout);
+		~tile_coordinator();
+
+		bool listen(const std::string& address, std::string& error);
+
+		/* Renders the tiles on whichever workers connect.
+		*	@tiles: the tiles, with id their index
+		*	@on_result: called once per tile with its pixels
+		*	@no_more_workers: asked while no worker is connected; true
+		*		gives up on the tiles left
+		*	@error: receives a message on failure
+		*	returns false if the render was given up.
+		*/
+		bool run(const std::vector<tile_job>& tiles, const result_handler& on_result,
+			const std::function<bool()>& no_more_workers, std::string& error);
+
+		int connection_count() const { return connections; }
+
+	public:
+		// what happened, for the report
+		int workers_joined;
+		int workers_lost;
+		int workers_rejected;
+		int tiles_reassigned;	// taken back from lost workers
+		int backup_tiles;		// copies handed out to idle workers
+		int results_dropped;	// results that lost the race to a copy
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		struct assignment {
+			int id;
+			clock::time_point since;
+		};
+
+		struct worker {
+			int fd;
+			std::string name;
+			bool greeted;
+			int slots;
+			std::vector<char> input;		// bytes not yet parsed
+			std::vector<assignment> tiles;	// out on this worker
+		};
+
+		void accept_workers();
+		bool read_worker(worker& w, std::string& reason);
+		bool parse_input(worker& w, std::string& reason);
+		void drop_worker(size_t index, const std::string& reason);
+		bool deal(worker& w);
+		int pick_backup(const worker& w, clock::time_point now) const;
+
+	private:
+		tile_hello expected;
+		double worker_timeout;
+		int listen_fd;
+		std::string unix_path;		// unlinked on destruction
+		int connections;			// accepted so far, to name them
+
+		std::vector<worker> workers;
+		const std::vector<tile_job>* jobs;
+		const result_handler* handler;
+		std::deque<int> pending;	// not out on any worker
+		std::vector<char> done;
+		std::vector<int> copies;	// workers each tile is out on
+		int remaining;
+		double result_seconds;		// sum over results, for the backup threshold
+		int result_count;
+};
+
+/* The worker's end of the connection. next() is meant for one thread and
+*	send() may be called from any number.
+*/
+class tile_worker {
+	public:
+		tile_worker();
+		~tile_worker();
+
+		bool connect(const std::string& address, const tile_hello& hello, std::string& error);
+
+		/* Waits for the next tile.
+		*	@job: receives it
+		*	returns false when the coordinator is done or gone.
+		*/
+		bool next(tile_job& job);
+
+		/* Sends a tile's pixels.
+		*	@job: the tile
+		*	@pixels: its pixels, bottom row first
+		*	@count: pixels to send; fewer than the tile has only to fake
+		*		a worker dying mid-result
+		*	returns false if the connection failed.
+		*/
+		bool send(const tile_job& job, const tile_pixel* pixels, size_t count);
+
+	private:
+		int fd;
+		std::mutex send_lock;
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+/* Writes the color to the output stream
+*	@out: The output stream to write the color to
+*	@pixel_color: The color to write
+*	@samples_per_pixel: number of samples summed into pixel_color
+*/
+void write_color(std::ostream &out, vec3 pixel_color, int samples_per_pixel) {
+    // Write the translated [0,255] value of each color component.
+	auto r = pixel_color.x();
+    auto g = pixel_color.y();
+    auto b = pixel_color.z();
+
+    // Divide the color by the number of samples.
+    auto scale = 1.0 / samples_per_pixel;
+    r *= scale;
+    g *= scale;
+    b *= scale;
+
+    out << static_cast<int>(255.999 * r) << ' '
+        << static_cast<int>(255.999 * g) << ' '
+        << static_cast<int>(255.999 * b) << '\n';
+}
+
+/* Constructor
+*	@w: image width
+*	@h: image height
+*/
+framebuffer::framebuffer(int w, int h) : w(w), h(h), y0(0), y1(h), pixels(size_t(w)*h), counts(size_t(w)*h, 0) {
+}
+
+/* Constructor for a buffer that holds a window of rows of the image at
+*	a time. The window starts at the top rows; see set_window().
+*	@w: image width
+*	@h: image height
+*	@window_rows: the most rows the window can hold
+*/
+framebuffer::framebuffer(int w, int h, int window_rows)
+	: w(w), h(h), pixels(size_t(w)*std::min(window_rows, h)), counts(size_t(w)*std::min(window_rows, h), 0) {
+	y1 = h;
+	y0 = h - std::min(window_rows, h);
+}
+
+/* Moves the window to rows [first,end) and clears it.
+*	@first: bottom row of the window
+*	@end: one past the top row; at most the window_rows given to the
+*		constructor above first
+*/
+void framebuffer::set_window(int first, int end) {
+	y0 = first;
+	y1 = end;
+	size_t n = size_t(w) * (end - first);
+	std::fill(pixels.begin(), pixels.begin() + n, vec3(0,0,0));
+	std::fill(counts.begin(), counts.begin() + n, 0);
+}
+
+/* Adds one sample to a pixel.
+*	@i: column
+*	@j: row (0 is the bottom scanline)
+*	@color: sample color
+*/
+void framebuffer::add_sample(int i, int j, const vec3& color) {
+	pixels[index(i,j)] += color;
+	counts[index(i,j)] += 1;
+}
+
+/* Overwrites the accumulated value of a pixel.
+*	@i: column
+*	@j: row
+*	@sum: sum of the sample colors
+*	@samples: number of samples in sum
+*/
+void framebuffer::set(int i, int j, const vec3& sum, int samples) {
+	pixels[index(i,j)] = sum;
+	counts[index(i,j)] = samples;
+}
+
+/* Returns the mean sample color of a pixel, black if it has no samples.
+*	@i: column
+*	@j: row
+*/
+vec3 framebuffer::average(int i, int j) const {
+	int n = counts[index(i,j)];
+	if (n == 0) return vec3(0,0,0);
+	return pixels[index(i,j)] / n;
+}
+
+/* Writes the number of samples in each pixel as a grayscale P3 ppm,
+*	black for none and white for max_samples or more.
+*	@out: The output stream to write to
+*	@max_samples: the count shown as white
+*/
+void framebuffer::write_sample_counts(std::ostream &out, int max_samples) const {
+	out << "P3\n" << w << ' ' << h << "\n255\n";
+	if (max_samples < 1) max_samples = 1;
+	for (int j = y1-1; j >= y0; --j) {
+		for (int i = 0; i < w; ++i) {
+			int n = counts[index(i,j)];
+			int v = (n >= max_samples) ? 255 : int(255.0 * n / max_samples);
+			out << v << ' ' << v << ' ' << v << '\n';
+		}
+	}
+}
+
+/* Returns the number of samples in the whole buffer.
+*/
+long long framebuffer::total_samples() const {
+	long long n = 0;
+	for (size_t k = 0; k < size_t(w) * (y1 - y0); k++) n += counts[k];
+	return n;
+}
+
+/* Looks up an output format by name.
+*	@name: "p3", "p6", "p6-16" or "pfm"
+*	@out: receives the format
+*	returns false for an unknown name.
+*/
+bool parse_ppm_format(const std::string& name, ppm_format& out) {
+	if (name == "p3") out = p3;
+	else if (name == "p6") out = p6;
+	else if (name == "p6-16") out = p6_16;
+	else if (name == "pfm") out = pfm;
+	else return false;
+	return true;
+}
+
+/* Returns the ppm header for the buffer in the given format; binary
+*	pixel data starts right after it.
+*	@format: the encoding
+*/
+std::string framebuffer::ppm_header(ppm_format format) const {
+	// a negative scale marks little endian floats
+	if (format == pfm) return "PF\n" + std::to_string(w) + ' ' + std::to_string(h) + "\n-1.0\n";
+	std::string magic = (format == p3) ? "P3" : "P6";
+	std::string maxval = (format == p6_16) ? "65535" : "255";
+	return magic + "\n" + std::to_string(w) + ' ' + std::to_string(h) + "\n" + maxval + "\n";
+}
+
+/* Writes the binary encoding of a pixel's average color. Channels are
+*	scaled like write_color and clamped to the format's range.
+*	@i: column
+*	@j: row
+*	pfm stores the average unchanged.
+*	@format: p6, p6_16 or pfm
+*	@out: receives bytes_per_pixel(format) bytes
+*/
+void framebuffer::encode_pixel(int i, int j, ppm_format format, unsigned char* out) const {
+	int n = counts[index(i,j)];
+	double scale = 1.0 / ((n == 0) ? 1 : n);
+	const vec3& c = pixels[index(i,j)];
+	for (int k = 0; k < 3; k++) {
+		double v = c[k] * scale;
+		if (format == pfm) {
+			float f = float(v);
+			uint32_t bits;
+			memcpy(&bits, &f, sizeof(bits));
+			for (int b = 0; b < 4; b++) out[4*k + b] = (unsigned char)(bits >> (8*b));
+		} else if (format == p6_16) {
+			int q = static_cast<int>(65535.999 * v);
+			q = (q < 0) ? 0 : (q > 65535) ? 65535 : q;
+			out[2*k] = (unsigned char)(q >> 8);
+			out[2*k + 1] = (unsigned char)(q & 0xff);
+		} else {
+			int q = static_cast<int>(255.999 * v);
+			out[k] = (unsigned char)((q < 0) ? 0 : (q > 255) ? 255 : q);
+		}
+	}
+}
+
+/* Writes the whole buffer as a ppm in scanline order (top row first).
+*	@out: The output stream to write to
+*	@format: the encoding, ASCII P3 by default
+*/
+void framebuffer::write_ppm(std::ostream &out, ppm_format format) const {
+	out << ppm_header(format);
+	write_rows(out, format);
+}
+
+/* Writes the pixels of the window, top row first, without a header.
+*	Writing the header and then every window from the top down gives
+*	the same file as write_ppm.
+*	@out: The output stream to write to
+*	@format: the encoding
+*/
+void framebuffer::write_rows(std::ostream &out, ppm_format format) const {
+	if (format == p3) {
+		for (int j = y1-1; j >= y0; --j) {
+			for (int i = 0; i < w; ++i) {
+				int n = counts[index(i,j)];
+				write_color(out, pixels[index(i,j)], (n == 0) ? 1 : n);
+			}
+		}
+		return;
+	}
+	// binary rows are encoded whole and written in one call each
+	const int bpp = bytes_per_pixel(format);
+	std::vector<unsigned char> row(size_t(w) * bpp);
+	for (int r = 0; r < y1 - y0; r++) {
+		int j = (format == pfm) ? y0 + r : y1 - 1 - r;
+		for (int i = 0; i < w; ++i) {
+			encode_pixel(i, j, format, &row[size_t(i) * bpp]);
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+}
+
+/* Writes the raw accumulation state of the window: its rows, then the
+*	color sums and sample counts as they are held in memory.
+*	@out: a binary stream
+*/
+void framebuffer::write_state(std::ostream &out) const {
+	int32_t header[4] = { w, h, y0, y1 };
+	size_t n = size_t(w) * (y1 - y0);
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(pixels.data()), n * sizeof(vec3));
+	out.write(reinterpret_cast<const char*>(counts.data()), n * sizeof(int));
+}
+
+/* Reads state written by write_state into the window.
+*	@in: a binary stream
+*	returns false if the stream is short or holds other dimensions or
+*	rows than the window.
+*/
+bool framebuffer::read_state(std::istream &in) {
+	int32_t header[4];
+	if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+	if (header[0] != w || header[1] != h || header[2] != y0 || header[3] != y1) return false;
+	size_t n = size_t(w) * (y1 - y0);
+	in.read(reinterpret_cast<char*>(pixels.data()), n * sizeof(vec3));
+	in.read(reinterpret_cast<char*>(counts.data()), n * sizeof(int));
+	return bool(in);
+}
@@ -0,0 +1,74 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "vec3.h"
+
+/* Encodings of the image written by write_ppm.
+*	p3: ASCII, 8 bits per channel
+*	p6: binary, 8 bits per channel
+*	p6_16: binary, 16 bits per channel, most significant byte first
+*	pfm: portable float map, the linear average color as little endian
+*		32 bit floats with no quantization, bottom row first
+*/
+enum ppm_format { p3, p6, p6_16, pfm };
+
+bool parse_ppm_format(const std::string& name, ppm_format& out);
+
+/* Accumulation buffer shared by the render workers. Each pixel keeps the
+*	sum of its sample colors and the number of samples taken. Workers own
+*	disjoint tiles so no locking is needed while tracing.
+*	Pixel (i,j) uses the same coordinates as the render loop: j = 0 is
+*	the bottom scanline.
+*	A buffer can also hold just a window of rows of the image, so a
+*	large image can be rendered band by band in bounded memory. Only the
+*	pixels of the window may be touched, and everything that walks the
+*	buffer walks the window.
+*/
+class framebuffer {
+	public:
+		framebuffer(int w, int h);
+		framebuffer(int w, int h, int window_rows);
+
+		void set_window(int first, int end);
+		int window_begin() const { return y0; }
+		int window_end() const { return y1; }
+		static size_t bytes_per_accumulated_pixel() { return sizeof(vec3) + sizeof(int); }
+
+		void add_sample(int i, int j, const vec3& color);
+		void set(int i, int j, const vec3& sum, int samples);
+		vec3 sum(int i, int j) const { return pixels[index(i,j)]; }
+		int samples(int i, int j) const { return counts[index(i,j)]; }
+		vec3 average(int i, int j) const;
+
+		void write_ppm(std::ostream &out, ppm_format format = p3) const;
+		void write_rows(std::ostream &out, ppm_format format) const;
+		std::string ppm_header(ppm_format format) const;
+		static int bytes_per_pixel(ppm_format format) { return (format == pfm) ? 12 : (format == p6_16) ? 6 : 3; }
+		// the row of the file that holds row j of the image
+		int file_row(int j, ppm_format format) const { return (format == pfm) ? j : h - 1 - j; }
+		void encode_pixel(int i, int j, ppm_format format, unsigned char* out) const;
+		void write_sample_counts(std::ostream &out, int max_samples) const;
+		long long total_samples() const;
+
+		void write_state(std::ostream &out) const;
+		bool read_state(std::istream &in);
+
+		int width() const { return w; }
+		int height() const { return h; }
+
+	private:
+		size_t index(int i, int j) const { return size_t(j - y0)*w + i; }
+
+	private:
+		int w;
+		int h;
+		int y0;			// the window: rows [y0,y1)
+		int y1;
+		std::vector<vec3> pixels;
+		std::vector<int> counts;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "aabb.h"
+#include "ray.h"
+
+/* Convex volume that encloses a bundle of rays, used to cull boxes that
+*	every ray of the bundle misses. It is bounded by a near plane and four
+*	side planes. For rays that share an origin (perspective) the side
+*	planes pass through that origin. For parallel rays (orthographic) they
+*	form a prism around the bundle.
+*/
+class frustum {
+	public:
+		frustum() : count(0) {}
+
+		/* Builds the side planes through four corner rays that enclose a
+		*	bundle, such as the rays through the corners of its pixels'
+		*	footprint, and checks that every ray of the bundle is inside.
+		*	@rays: every ray of the bundle
+		*	@n: number of rays
+		*	@corners: the corner rays, in order around the bundle
+		*	returns false if the rays are too incoherent to bound: they
+		*	neither share an origin nor a direction, the corners are
+		*	degenerate, or some ray lies outside the planes.
+		*/
+		bool build(const ray* rays, int n, const ray corners[4]) {
+			count = 0;
+			if (n < 1) return false;
+
+			vec3 o0 = corners[0].origin();
+			vec3 d0 = corners[0].direction();
+			bool shared_origin = true;
+			bool shared_direction = true;
+			for (int e = 1; e < 4; e++) {
+				if ((corners[e].origin() - o0).length() > 1e-9 * (1 + o0.length())) shared_origin = false;
+				if ((corners[e].direction() - d0).length() > 1e-12 * (1 + d0.length())) shared_direction = false;
+			}
+			vec3 center_o, center_d;
+			for (int i = 0; i < n; i++) {
+				vec3 o = rays[i].origin();
+				vec3 d = rays[i].direction();
+				if ((o - o0).length() > 1e-9 * (1 + o0.length())) shared_origin = false;
+				if ((d - d0).length() > 1e-12 * (1 + d0.length())) shared_direction = false;
+				center_o += o;
+				center_d += normalize(d);
+			}
+			if (!shared_origin && !shared_direction) return false;
+			center_o /= n;
+			center_d = normalize(center_d);
+			vec3 inside = center_o + center_d;	// a point on the central ray
+
+			for (int e = 0; e < 4; e++) {
+				const ray& a = corners[e];
+				const ray& b = corners[(e + 1) % 4];
+				vec3 nrm = shared_origin
+					? cross(a.direction(), b.direction())
+					: cross(b.origin() - a.origin(), d0);
+				double len = nrm.length();
+				if (!(len > 1e-12)) return false;
+				nrm /= len;
+				double offset = dot(nrm, a.origin());
+				if (dot(nrm, inside) < offset) {
+					nrm = -nrm;
+					offset = -offset;
+				}
+				add_plane(nrm, offset);
+			}
+
+			// near plane: nothing behind the ray origins can be hit
+			double near_offset = infinity;
+			for (int i = 0; i < n; i++) {
+				double t = dot(center_d, rays[i].origin());
+				if (t < near_offset) near_offset = t;
+			}
+			add_plane(center_d, near_offset);
+
+			// every ray must start and head inside the side planes
+			for (int i = 0; i < n; i++) {
+				vec3 o = rays[i].origin();
+				vec3 p = o + normalize(rays[i].direction());
+				for (int k = 0; k < 4; k++) {
+					double tol = 1e-9 * (1 + fabs(offsets[k]));
+					if (dot(normals[k], o) < offsets[k] - tol || dot(normals[k], p) < offsets[k] - tol) {
+						count = 0;
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		/* Returns false only if the box is entirely outside one of the
+		*	planes, in which case no ray of the bundle can hit it.
+		*	@box: the box to test
+		*/
+		bool overlaps(const aabb& box) const {
+			vec3 lo = box.min();
+			vec3 hi = box.max();
+			for (int k = 0; k < count; k++) {
+				const vec3& n = normals[k];
+				// the corner of the box furthest along the normal
+				vec3 v = vec3(n[0] >= 0 ? hi[0] : lo[0],
+							  n[1] >= 0 ? hi[1] : lo[1],
+							  n[2] >= 0 ? hi[2] : lo[2]);
+				if (dot(n, v) < offsets[k] - 1e-9 * (1 + fabs(offsets[k]))) return false;
+			}
+			return true;
+		}
+
+		bool valid() const { return count > 0; }
+
+	private:
+		void add_plane(const vec3& n, double offset) {
+			normals[count] = n;
+			offsets[count] = offset;
+			count++;
+		}
+
+	private:
+		vec3 normals[5];	// inward facing
+		double offsets[5];	// a point x is inside when dot(n,x) >= offset
+		int count;
+};
+
+#endif
@@ -2,19 +2,82 @@
 #define HITTABLE_H
 
 #include "ray.h"
+#include "aabb.h"
+#include "frustum.h"
 
-struct hit_record {
-    vec3 p;
-    vec3 n;
-    double t;
-	vec3 kd;
-	vec3 ld;
+class hittable;
 
+/* hit() only records where along the ray and what was hit. Everything
+*	else is filled in by resolve(), once, for the closest hit.
+*/
+template<class T>
+struct hit_record_t {
+    T t;
+	// which primitive was hit: the object that reported the hit and an
+	// index within it (0 for single primitives)
+	const hittable* object;
+	int prim;
+	// when object is an instance: the object inside its geometry that
+	// was hit, prim being the index within that. Only the instance
+	// reads it, so it may be left stale by other hits.
+	const hittable* inner;
+	// barycentric coordinates of the hit on a triangle
+	T u;
+	T v;
+
+	// filled by resolve()
+    vec3_t<T> p;
+    vec3_t<T> n;
+	vec3_t<T> kd;
+	vec3_t<T> ld;
+};
+
+// the hittable interface always reports hits in double precision
+typedef hit_record_t<double> hit_record;
+
+/* A bundle of coherent rays traced together. When bounds is valid it
+*	encloses every ray, so whole subtrees can be culled for the bundle.
+*/
+struct ray_packet {
+    static const int max_rays = 64;
+
+    int count;
+    ray rays[max_rays];
+    hit_record recs[max_rays];
+    bool hits[max_rays];
+    frustum bounds;
 };
 
 class hittable {
     public:
+        // closest hit in [t_min,t_max]. Only t, object, prim, u and v are
+        // set, and rec is left alone if nothing is hit.
         virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+        // fills in p, n, kd and ld of a hit this object reported. Only
+        // objects that put themselves in rec.object need to implement it.
+        virtual void resolve(const ray& r, hit_record& rec) const {}
+        // any-hit query: true as soon as anything is found in [t_min,t_max]
+        virtual bool occluded(const ray& r, double t_min, double t_max) const = 0;
+        // returns false for unbounded objects such as planes
+        virtual bool bounding_box(aabb& output_box) const = 0;
+        // bakes the data hit() needs; call again after editing an object
+        virtual void compile() {}
+
+        // closest hit with position, normal and material filled in
+        bool closest_hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+            if (!hit(r, t_min, t_max, rec)) return false;
+            rec.object->resolve(r, rec);
+            return true;
+        }
+
+        // closest hit for every ray of a packet, one ray at a time unless
+        // the object can make use of the packet's frustum. Like hit(),
+        // the records still need resolve().
+        virtual void hit_packet(ray_packet& packet, double t_min, double t_max) const {
+            for (int i = 0; i < packet.count; i++) {
+                packet.hits[i] = hit(packet.rays[i], t_min, t_max, packet.recs[i]);
+            }
+        }
 };
 
 #endif
@@ -7,17 +7,56 @@
 *	@rec: hit record to store the info
 */
 bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-    hit_record temp_rec;
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
-    for (const auto& object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+    // objects only write rec when they find a closer hit, so no
+    // temporary record is needed
+    for (const auto& object : items) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
     return hit_anything;
 }
+
+/* Determines if the ray hits anything in the list, stopping at the
+*	first object found.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+bool hittable_list::occluded(const ray& r, double t_min, double t_max) const {
+    for (const auto& object : items) {
+        if (object->occluded(r, t_min, t_max)) return true;
+    }
+    return false;
+}
+
+/* Bakes every object and freezes the list. add() and clear() throw
+*	until thaw() is called.
+*/
+void hittable_list::compile() {
+    for (const auto& object : items) {
+        object->compile();
+    }
+    compiled = true;
+}
+
+/* Computes the box around every object in the list
+*	@output_box: receives the box
+*	returns false if the list is empty or holds an unbounded object
+*/
+bool hittable_list::bounding_box(aabb& output_box) const {
+	if (items.empty()) return false;
+
+	aabb temp_box;
+	output_box = aabb();
+	for (const auto& object : items) {
+		if (!object->bounding_box(temp_box)) return false;
+		output_box.expand(temp_box);
+	}
+	return true;
+}
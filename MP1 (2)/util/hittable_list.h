@@ -4,6 +4,7 @@
 #include "hittable.h"
 
 #include <memory>
+#include <stdexcept>
 #include <vector>
 
 using std::shared_ptr;
@@ -11,18 +12,32 @@ using std::make_shared;
 
 class hittable_list : public hittable {
     public:
-        hittable_list() {}
-        hittable_list(shared_ptr<hittable> object) { add(object); }
+        hittable_list() : compiled(false) {}
+        hittable_list(shared_ptr<hittable> object) : compiled(false) { add(object); }
 
-        void clear() { objects.clear(); }
-        void add(shared_ptr<hittable> object) { objects.push_back(object); }
+        void clear() { check_mutable(); items.clear(); }
+        void add(shared_ptr<hittable> object) { check_mutable(); items.push_back(object); }
 
         virtual bool hit(
             const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void compile() override;
 
+        // allows add() and clear() again; compile() before rendering
+        void thaw() { compiled = false; }
+        bool is_compiled() const { return compiled; }
 
-    public:
-        std::vector<shared_ptr<hittable>> objects;
+        const std::vector<shared_ptr<hittable>>& objects() const { return items; }
+
+    private:
+        void check_mutable() const {
+            if (compiled) throw std::logic_error("hittable_list is compiled, thaw() it before editing");
+        }
+
+    private:
+        std::vector<shared_ptr<hittable>> items;
+        bool compiled;
 };
 
 #endif
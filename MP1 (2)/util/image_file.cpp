@@ -0,0 +1,152 @@
+#include "image_file.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+/* Constructor. The file is opened by open().
+*/
+image_file::image_file() : fd(-1), data(0), length(0), header_bytes(0), w(0), h(0), tile_size(1),
+	format(p6), stopping(false), flush_failed(false) {
+}
+
+/* Destructor. Closes the file if close() wasn't called.
+*/
+image_file::~image_file() {
+	close();
+}
+
+/* Creates the file at its final size, maps it and writes the header.
+*	Pixels not yet written read as black.
+*	@path: where to write
+*	@fb: the framebuffer the tiles will come from, for the dimensions
+*	@format: p6, p6_16 or pfm
+*	@tile_size: edge of the tiles, as passed to make_tiles
+*	returns false if the file couldn't be created or mapped.
+*/
+bool image_file::open(const std::string& path, const framebuffer& fb, ppm_format format, int tile_size) {
+	if (is_open() || format == p3) return false;
+	this->format = format;
+	this->tile_size = (tile_size < 1) ? 1 : tile_size;
+	w = fb.width();
+	h = fb.height();
+	std::string header = fb.ppm_header(format);
+	header_bytes = header.size();
+	length = header_bytes + size_t(w) * h * framebuffer::bytes_per_pixel(format);
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+	if (ftruncate(fd, off_t(length)) != 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	void* p = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	data = static_cast<unsigned char*>(p);
+	memcpy(data, header.data(), header_bytes);
+
+	int bands = (h + this->tile_size - 1) / this->tile_size;
+	int per_band = (w + this->tile_size - 1) / this->tile_size;
+	band_remaining.reset(new std::atomic<int>[bands]);
+	for (int b = 0; b < bands; b++) band_remaining[b] = per_band;
+
+	stopping = false;
+	flush_failed = false;
+	flusher = std::thread(&image_file::flush_loop, this);
+	return true;
+}
+
+/* Encodes the pixels [x0,x1) x [y0,y1) of a finished tile into the file.
+*	Tiles must be the ones make_tiles produced for the tile size given
+*	to open(), each written once, for band flushing to work; any other
+*	region is still written but only flushed by close().
+*	Safe to call from several threads for disjoint tiles.
+*	@fb: the framebuffer holding the tile
+*	@x0, y0, x1, y1: the tile
+*/
+void image_file::write_tile(const framebuffer& fb, int x0, int y0, int x1, int y1) {
+	if (!is_open()) return;
+	const size_t bpp = framebuffer::bytes_per_pixel(format);
+	const size_t row_bytes = size_t(w) * bpp;
+	for (int j = y0; j < y1; ++j) {
+		unsigned char* row = data + header_bytes + size_t(fb.file_row(j, format)) * row_bytes;
+		for (int i = x0; i < x1; ++i) {
+			fb.encode_pixel(i, j, format, row + size_t(i) * bpp);
+		}
+	}
+
+	// bands are counted from the top of the image, like make_tiles
+	if ((h - y1) % tile_size != 0) return;
+	int band = (h - y1) / tile_size;
+	if (band_remaining[band].fetch_sub(1) == 1) {
+		int first = std::min(fb.file_row(y0, format), fb.file_row(y1 - 1, format));
+		size_t begin = header_bytes + size_t(first) * row_bytes;
+		queue_flush(begin, begin + size_t(y1 - y0) * row_bytes);
+	}
+}
+
+/* Hands a finished byte range to the flush thread.
+*/
+void image_file::queue_flush(size_t begin, size_t end) {
+	{
+		std::lock_guard<std::mutex> guard(flush_lock);
+		flush_queue.push_back(std::make_pair(begin, end));
+	}
+	flush_ready.notify_one();
+}
+
+/* Body of the flush thread: writes queued ranges back to the file until
+*	close() stops it.
+*/
+void image_file::flush_loop() {
+	const size_t page = size_t(sysconf(_SC_PAGESIZE));
+	TRACE_THREAD_NAME("image flush");
+	std::unique_lock<std::mutex> guard(flush_lock);
+	while (true) {
+		flush_ready.wait(guard, [this]() { return stopping || !flush_queue.empty(); });
+		if (flush_queue.empty()) return;
+		std::pair<size_t, size_t> range = flush_queue.front();
+		flush_queue.pop_front();
+		guard.unlock();
+		// msync wants a page aligned start; the pages shared with a
+		// neighbouring band are written again with that band
+		size_t begin = range.first / page * page;
+		{
+			TRACE_SCOPE("flush band");
+			if (msync(data + begin, range.second - begin, MS_SYNC) != 0) flush_failed = true;
+		}
+		guard.lock();
+	}
+}
+
+/* Waits for outstanding flushes, writes back the whole file and unmaps
+*	it.
+*	returns false if any part of the file couldn't be written.
+*/
+bool image_file::close() {
+	if (!is_open()) return true;
+	TRACE_SCOPE("close image");
+	{
+		std::lock_guard<std::mutex> guard(flush_lock);
+		stopping = true;
+	}
+	flush_ready.notify_one();
+	flusher.join();
+
+	bool ok = !flush_failed;
+	if (msync(data, length, MS_SYNC) != 0) ok = false;
+	if (munmap(data, length) != 0) ok = false;
+	if (::close(fd) != 0) ok = false;
+	data = 0;
+	fd = -1;
+	return ok;
+}
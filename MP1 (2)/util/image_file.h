@@ -0,0 +1,58 @@
+#ifndef IMAGE_FILE_H
+#define IMAGE_FILE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include "framebuffer.h"
+
+/* A binary ppm file mapped into memory, written tile by tile while the
+*	image renders. Each finished tile is encoded straight to its pixels'
+*	offsets in the file, so workers never wait for each other. Once
+*	every tile of a band (a row of tiles) is in, the band's bytes are
+*	handed to a background thread that flushes them to disk while the
+*	rest of the image is still tracing.
+*/
+class image_file {
+	public:
+		image_file();
+		~image_file();
+
+		bool open(const std::string& path, const framebuffer& fb, ppm_format format, int tile_size);
+		void write_tile(const framebuffer& fb, int x0, int y0, int x1, int y1);
+		bool close();
+
+		bool is_open() const { return data != 0; }
+		size_t size() const { return length; }
+
+	private:
+		void flush_loop();
+		void queue_flush(size_t begin, size_t end);
+
+	private:
+		int fd;
+		unsigned char* data;	// the mapping, or null
+		size_t length;			// bytes mapped, the whole file
+		size_t header_bytes;	// pixel data starts here
+		int w;
+		int h;
+		int tile_size;
+		ppm_format format;
+
+		// tiles of each band not yet written
+		std::unique_ptr<std::atomic<int>[]> band_remaining;
+
+		std::thread flusher;
+		std::mutex flush_lock;
+		std::condition_variable flush_ready;
+		std::deque<std::pair<size_t, size_t> > flush_queue;	// byte ranges
+		bool stopping;
+		bool flush_failed;
+};
+
+#endif
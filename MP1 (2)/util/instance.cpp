@@ -0,0 +1,71 @@
+#include "instance.h"
+
+/* Constructor.
+*	@geometry: the shared geometry, compiled
+*	@to_world: takes the geometry's space to world space
+*/
+instance::instance(shared_ptr<hittable> geometry, const transform& to_world) : geometry(geometry), to_world(to_world) {
+	compile();
+}
+
+/* Determines if a ray hits the geometry where this instance puts it.
+*	The geometry's hit record is kept in rec.inner and rec.prim for
+*	resolve().
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: hit record to store the info
+*/
+bool instance::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	hit_record local;
+	if (!geometry->hit(to_world.inverse_ray(r), t_min, t_max, local)) return false;
+	rec.t = local.t;
+	rec.object = this;
+	rec.prim = local.prim;
+	rec.inner = local.object;
+	rec.u = local.u;
+	rec.v = local.v;
+	return true;
+}
+
+/* Resolves the hit in the geometry's space and brings the point and
+*	normal back to world space.
+*	@r: the ray that hit
+*	@rec: a record filled in by hit()
+*/
+void instance::resolve(const ray& r, hit_record& rec) const {
+	hit_record local = rec;
+	local.object = rec.inner;
+	rec.inner->resolve(to_world.inverse_ray(r), local);
+	rec.p = r.at(rec.t);
+	rec.n = normalize(to_world.normal(local.n));
+	rec.kd = local.kd;
+	rec.ld = local.ld;
+}
+
+/* Determines if a ray hits the instance anywhere in [t_min,t_max].
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+bool instance::occluded(const ray& r, double t_min, double t_max) const {
+	return geometry->occluded(to_world.inverse_ray(r), t_min, t_max);
+}
+
+/* The world box around the transformed geometry box.
+*	@output_box: receives the box
+*	returns false if the geometry is unbounded.
+*/
+bool instance::bounding_box(aabb& output_box) const {
+	if (!bounded) return false;
+	output_box = box;
+	return true;
+}
+
+/* Bakes the world box. The geometry is shared and compiled already.
+*/
+void instance::compile() {
+	aabb local;
+	bounded = geometry->bounding_box(local);
+	if (bounded) box = to_world.box(local);
+}
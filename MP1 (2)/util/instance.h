@@ -0,0 +1,41 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <memory>
+#include "hittable.h"
+#include "transform.h"
+
+/* A placed copy of shared geometry. Rays are taken into the geometry's
+*	own space, intersected there and the hit point and normal brought
+*	back out, so any number of instances share one copy of the geometry
+*	and of its acceleration structure. Put instances in a bvh and that
+*	forms a two-level structure: the top level over the instances' world
+*	boxes, the bottom level per unique geometry (a bvh, a triangle_mesh,
+*	or a single primitive).
+*
+*	The geometry must be compiled before it is instanced and must not
+*	itself contain instances; compile() on an instance leaves the shared
+*	geometry alone.
+*/
+class instance : public hittable {
+	public:
+		instance(shared_ptr<hittable> geometry, const transform& to_world);
+
+		virtual bool hit(
+			const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		virtual void resolve(const ray& r, hit_record& rec) const override;
+		virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+		virtual bool bounding_box(aabb& output_box) const override;
+		virtual void compile() override;
+
+	public:
+		shared_ptr<hittable> geometry;
+		transform to_world;
+
+	private:
+		// baked by compile()
+		aabb box;
+		bool bounded;
+};
+
+#endif
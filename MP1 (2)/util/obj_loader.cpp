@@ -0,0 +1,359 @@
+#include "obj_loader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+namespace {
+	const size_t min_chunk_bytes = size_t(1) << 20;	// smaller chunks aren't worth a thread
+	const size_t release_bytes = size_t(8) << 20;	// parsed file pages are dropped in steps of this
+
+	const double powers_of_ten[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool is_blank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool is_digit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	/* One piece of the file, whole lines only.
+	*/
+	struct obj_chunk {
+		const char* begin;
+		const char* end;
+		// counted by the first pass
+		size_t vertices;
+		size_t triangles;
+		size_t lines;
+		// where the chunk's vertices, triangles and lines start overall
+		size_t first_vertex;
+		size_t first_triangle;
+		size_t first_line;
+		std::string error;	// "line: message" of the first problem
+	};
+
+	/* Drops the file pages before upto once a step's worth has been
+	*	parsed. They are clean, so they are simply read again if needed.
+	*	@released: start of the pages still mapped in, page aligned
+	*	@upto: how far parsing got
+	*	@page: the page size
+	*/
+	void release_parsed(const char*& released, const char* upto, size_t page) {
+		if (size_t(upto - released) < release_bytes) return;
+		size_t bytes = size_t(upto - released) / page * page;
+		madvise(const_cast<char*>(released), bytes, MADV_DONTNEED);
+		released += bytes;
+	}
+
+	/* Finds the end of the line at p, and of its content before a #.
+	*/
+	const char* line_end(const char* p, const char* end, const char*& content_end) {
+		const char* eol = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+		if (!eol) eol = end;
+		const char* comment = static_cast<const char*>(memchr(p, '#', size_t(eol - p)));
+		content_end = comment ? comment : eol;
+		return eol;
+	}
+
+	const char* skip_blanks(const char* p, const char* end) {
+		while (p < end && is_blank(*p)) p++;
+		return p;
+	}
+
+	// true if the line at p is the statement tag, e.g. "v" or "f"
+	bool is_statement(const char* p, const char* end, char tag) {
+		return end - p >= 2 && p[0] == tag && is_blank(p[1]);
+	}
+
+	/* Reads the number at p with the result strtod would give. Decimals
+	*	of up to 19 significant digits and a power of ten within 1e+-22
+	*	are exact as one multiplication or division in double, which
+	*	covers what exporters write; anything else goes to strtod.
+	*	@p: the number, moved past it
+	*	@end: end of the line
+	*	@out: receives the value
+	*	returns false if there is no finite number at p.
+	*/
+	bool parse_double(const char*& p, const char* end, double& out) {
+		const char* q = p;
+		bool negative = false;
+		if (q < end && (*q == '-' || *q == '+')) negative = (*q++ == '-');
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+		for (; q < end && is_digit(*q); q++) {
+			any = true;
+			if (mantissa == 0 && *q == '0') continue;
+			mantissa = mantissa*10 + uint64_t(*q - '0');
+			digits++;
+			if (digits > 19) break;
+		}
+		if (digits <= 19 && q < end && *q == '.') {
+			for (q++; q < end && is_digit(*q); q++) {
+				any = true;
+				exponent--;
+				if (mantissa == 0 && *q == '0') continue;
+				mantissa = mantissa*10 + uint64_t(*q - '0');
+				digits++;
+				if (digits > 19) break;
+			}
+		}
+		if (digits <= 19 && any && q < end && (*q == 'e' || *q == 'E')) {
+			const char* e = q + 1;
+			bool e_negative = false;
+			if (e < end && (*e == '-' || *e == '+')) e_negative = (*e++ == '-');
+			int e_value = 0;
+			bool e_any = false;
+			for (; e < end && is_digit(*e); e++) {
+				e_any = true;
+				if (e_value < 10000) e_value = e_value*10 + (*e - '0');
+			}
+			if (e_any) {
+				exponent += e_negative ? -e_value : e_value;
+				q = e;
+			} else {
+				any = false;
+			}
+		}
+		if (digits <= 19 && any && (q == end || is_blank(*q)) && mantissa <= (uint64_t(1) << 53)
+			&& exponent >= -22 && exponent <= 22) {
+			double value = double(mantissa);
+			value = (exponent < 0) ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+			out = negative ? -value : value;
+			p = q;
+			return true;
+		}
+
+		// the slow path needs the word on its own
+		const char* word_end = p;
+		while (word_end < end && !is_blank(*word_end)) word_end++;
+		char buffer[64];
+		size_t length = size_t(word_end - p);
+		if (length == 0 || length >= sizeof(buffer)) return false;
+		memcpy(buffer, p, length);
+		buffer[length] = '\0';
+		char* parsed_end;
+		out = strtod(buffer, &parsed_end);
+		if (parsed_end != buffer + length || !std::isfinite(out)) return false;
+		p = word_end;
+		return true;
+	}
+
+	/* Reads the vertex index at the start of a face corner and skips the
+	*	texture and normal indices after it.
+	*	@p: the corner, moved past it
+	*	@end: end of the line
+	*	@out: receives the index as written, 1 based or negative
+	*	returns false if the corner doesn't start with an index.
+	*/
+	bool parse_index(const char*& p, const char* end, long long& out) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+		if (p == end || !is_digit(*p)) return false;
+		long long value = 0;
+		for (; p < end && is_digit(*p); p++) {
+			value = value*10 + (*p - '0');
+			if (value > INT32_MAX) return false;
+		}
+		while (p < end && !is_blank(*p)) p++;
+		out = negative ? -value : value;
+		return true;
+	}
+
+	/* First pass: counts the vertices, triangles and lines of a chunk.
+	*/
+	void count_chunk(obj_chunk& chunk, size_t page) {
+		const char* released = chunk.begin - reinterpret_cast<uintptr_t>(chunk.begin) % page;
+		const char* p = chunk.begin;
+		while (p < chunk.end) {
+			const char* content_end;
+			const char* eol = line_end(p, chunk.end, content_end);
+			chunk.lines++;
+			p = skip_blanks(p, content_end);
+			if (is_statement(p, content_end, 'v')) {
+				chunk.vertices++;
+			} else if (is_statement(p, content_end, 'f')) {
+				size_t corners = 0;
+				for (p = skip_blanks(p + 1, content_end); p < content_end; p = skip_blanks(p, content_end)) {
+					corners++;
+					while (p < content_end && !is_blank(*p)) p++;
+				}
+				if (corners >= 3) chunk.triangles += corners - 2;
+			}
+			p = eol + 1;
+			release_parsed(released, p, page);
+		}
+	}
+
+	/* Second pass: parses a chunk's vertices and triangles into their
+	*	places in the buffers.
+	*/
+	void parse_chunk(obj_chunk& chunk, size_t total_vertices, vec3* vertices, int32_t* indices, size_t page) {
+		const char* released = chunk.begin - reinterpret_cast<uintptr_t>(chunk.begin) % page;
+		size_t v = chunk.first_vertex;
+		size_t t = chunk.first_triangle;
+		size_t line = chunk.first_line;
+		const char* p = chunk.begin;
+		std::string problem;
+		while (p < chunk.end && problem.empty()) {
+			const char* content_end;
+			const char* eol = line_end(p, chunk.end, content_end);
+			line++;
+			p = skip_blanks(p, content_end);
+			if (is_statement(p, content_end, 'v')) {
+				double xyz[3] = { 0, 0, 0 };
+				p++;
+				for (int k = 0; k < 3 && problem.empty(); k++) {
+					p = skip_blanks(p, content_end);
+					if (!parse_double(p, content_end, xyz[k])) problem = "bad vertex coordinate";
+				}
+				vertices[v++] = vec3(xyz[0], xyz[1], xyz[2]);
+			} else if (is_statement(p, content_end, 'f')) {
+				int corners = 0;
+				int32_t first = 0, previous = 0;
+				for (p = skip_blanks(p + 1, content_end); p < content_end && problem.empty(); p = skip_blanks(p, content_end)) {
+					long long index;
+					if (!parse_index(p, content_end, index) || index == 0) {
+						problem = "bad face vertex";
+						break;
+					}
+					// negative indices count back from the last vertex so far
+					long long resolved = (index > 0) ? index - 1 : (long long)v + index;
+					if (resolved < 0 || resolved >= (long long)total_vertices) {
+						problem = "face vertex out of range";
+						break;
+					}
+					int32_t current = int32_t(resolved);
+					if (corners == 0) {
+						first = current;
+					} else if (corners >= 2) {
+						indices[3*t] = first;
+						indices[3*t + 1] = previous;
+						indices[3*t + 2] = current;
+						t++;
+					}
+					previous = current;
+					corners++;
+				}
+				if (problem.empty() && corners < 3) problem = "face with fewer than 3 vertices";
+			}
+			p = eol + 1;
+			release_parsed(released, p, page);
+		}
+		if (!problem.empty()) {
+			std::ostringstream message;
+			message << line << ": " << problem;
+			chunk.error = message.str();
+		}
+	}
+
+	/* Runs work on every chunk, one thread each.
+	*/
+	template <typename Work>
+	void for_each_chunk(std::vector<obj_chunk>& chunks, Work work) {
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < chunks.size(); i++) {
+			threads.push_back(std::thread([&chunks, &work, i]() { work(chunks[i]); }));
+		}
+		work(chunks[0]);
+		for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+	}
+}
+
+bool load_obj(const std::string& path, triangle_mesh& mesh, std::string& error, int threads) {
+	mesh.vertices.clear();
+	mesh.indices.clear();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) ::close(fd);
+		error = "can't open " + path;
+		return false;
+	}
+	size_t length = size_t(st.st_size);
+	if (length == 0) {
+		::close(fd);
+		return true;
+	}
+	void* mapping = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		error = "can't map " + path;
+		return false;
+	}
+	madvise(mapping, length, MADV_SEQUENTIAL);
+	const char* data = static_cast<const char*>(mapping);
+	const size_t page = size_t(sysconf(_SC_PAGESIZE));
+
+	// cut the file into chunks of whole lines
+	if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+	size_t count = length / min_chunk_bytes;
+	if (count > size_t(threads)) count = size_t(threads);
+	if (count < 1) count = 1;
+	std::vector<obj_chunk> chunks(count);
+	const char* begin = data;
+	for (size_t i = 0; i < count; i++) {
+		const char* end = data + length;
+		if (i + 1 < count) {
+			const char* target = data + length / count * (i + 1);
+			if (target < begin) target = begin;
+			const char* eol = static_cast<const char*>(memchr(target, '\n', size_t(end - target)));
+			if (eol) end = eol + 1;
+		}
+		obj_chunk& chunk = chunks[i];
+		chunk.begin = begin;
+		chunk.end = end;
+		chunk.vertices = chunk.triangles = chunk.lines = 0;
+		begin = end;
+	}
+
+	for_each_chunk(chunks, [page](obj_chunk& chunk) { count_chunk(chunk, page); });
+
+	size_t vertices = 0, triangles = 0, lines = 0;
+	for (size_t i = 0; i < count; i++) {
+		chunks[i].first_vertex = vertices;
+		chunks[i].first_triangle = triangles;
+		chunks[i].first_line = lines;
+		vertices += chunks[i].vertices;
+		triangles += chunks[i].triangles;
+		lines += chunks[i].lines;
+	}
+	if (vertices > size_t(INT32_MAX) || triangles > size_t(INT32_MAX) / 3) {
+		munmap(mapping, length);
+		error = path + " has too many vertices or faces";
+		return false;
+	}
+
+	mesh.vertices.resize(vertices);
+	mesh.indices.resize(3 * triangles);
+	vec3* vertex_out = mesh.vertices.data();
+	int32_t* index_out = mesh.indices.data();
+	for_each_chunk(chunks, [&](obj_chunk& chunk) {
+		parse_chunk(chunk, vertices, vertex_out, index_out, page);
+	});
+	munmap(mapping, length);
+
+	for (size_t i = 0; i < count; i++) {
+		if (!chunks[i].error.empty()) {
+			error = path + ":" + chunks[i].error;
+			mesh.vertices.clear();
+			mesh.indices.clear();
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,28 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <string>
+#include "triangle_mesh.h"
+
+/* Reads the geometry of a Wavefront OBJ file into a mesh: the v lines
+*	(x y z, anything after z is ignored) and the f lines, whose polygons
+*	are split into triangle fans. Vertex indices may be negative
+*	(relative); texture and normal indices after a / are skipped, as
+*	are every other statement (vt, vn, g, o, s, usemtl, mtllib, ...).
+*
+*	The file is mapped and cut into one chunk per thread at line
+*	boundaries. A first pass counts each chunk's vertices and triangles,
+*	so the vertex and index buffers are allocated once at their final
+*	size; a second pass parses every chunk straight into its place in
+*	them. No per-face objects are made, and file pages are released
+*	behind the parsers, so peak memory stays close to the two buffers.
+*	@path: the file
+*	@mesh: receives the vertices and indices, not compiled; its material
+*	is left alone
+*	@error: receives a message with the line number on failure
+*	@threads: parser threads, 0 for one per hardware thread
+*	returns false if the file can't be read or isn't valid OBJ.
+*/
+bool load_obj(const std::string& path, triangle_mesh& mesh, std::string& error, int threads = 0);
+
+#endif
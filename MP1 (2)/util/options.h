@@ -0,0 +1,248 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "framebuffer.h"
+#include "distributed.h"
+
+/* Render settings that are given as --name value flags. Everything
+*	else on the command line is left for the positional arguments
+*	documented on main().
+*/
+struct render_options {
+	int threads = 0;		// 0 = one per hardware thread
+	int tile_size = 16;		// edge length of a square tile in pixels
+	std::string accel = "bvh";	// "bvh", "list" or "soa"
+	int packet_size = 0;		// edge of a primary ray packet, 0 = no packets
+	std::string simd = "auto";	// kernels for --accel soa, see simd_kernels.h
+	std::string precision = "double";	// scalar type of the scene geometry
+	int samples_per_pixel = 100;
+	std::string sampler = "mj";	// "mj", "sobol" or "random", see sampler.h
+	int adaptive = 0;		// first pass samples per pixel, 0 = not adaptive
+	double adaptive_threshold = 0.004;	// standard error a pixel must reach
+	std::string spp_image;		// where to write the sample count image
+	int target_spp = 0;			// progressive: stop after this many passes
+	double time_budget = 0;		// progressive: seconds the render may take
+	std::string preview;		// progressive: file for intermediate images
+	double preview_interval = 1;	// seconds between intermediate images
+	int wavefront = 0;			// rays per wavefront queue, 0 = no wavefronts
+	ppm_format format = p3;		// encoding of the image
+	std::string output;			// image file, standard output if empty
+	double memory_limit = 0;	// streaming: MB of framebuffer, 0 = whole image
+	std::string checkpoint;		// where to save the render state
+	double checkpoint_interval = 60;	// seconds between checkpoints
+	std::string resume;			// checkpoint to continue from
+	std::string scene = "default";	// built-in scene, see scenes.h
+	std::string scene_file;		// text scene or scene cache, see scene_file.h
+	std::string write_cache;	// bake the scene into a cache and exit
+	std::string write_scene;	// save the scene as text and exit
+	std::string stats;			// where to write the render counters as JSON
+	std::string heatmap;		// where to write the per-pixel cost image
+	std::string heatmap_metric = "tests";	// "tests" or "time" per pixel
+	std::string trace;			// where to write the timeline
+	int trace_events = 65536;	// ring buffer size per thread
+	int workers = 0;			// worker processes to start, see distributed.h
+	std::string listen;			// address for workers on other machines
+	std::string connect;		// be a worker for the coordinator at this address
+	double worker_timeout = 60;	// seconds a worker may keep a tile, 0 = forever
+	std::string inject_fault;	// worker: crash:N or hang:N, for testing
+};
+
+/* Matches an argument against a flag name and reads its integer value.
+*	@argc: size of args
+*	@args: the argument array
+*	@i: index of the argument, advanced past the value on a match
+*	@name: flag name, e.g. "--threads"
+*	@value: receives the value
+*	returns true if args[i] was the flag.
+*/
+inline bool read_int_option(int argc, char** args, int& i, const char* name, int& value) {
+	if (strcmp(args[i], name) != 0) return false;
+	if (i + 1 >= argc) {
+		std::cerr << "missing value for " << name << std::endl;
+		exit(1);
+	}
+	value = atoi(args[++i]);
+	return true;
+}
+
+/* Matches an argument against a flag name and reads its real value.
+*	@argc: size of args
+*	@args: the argument array
+*	@i: index of the argument, advanced past the value on a match
+*	@name: flag name, e.g. "--adaptive-threshold"
+*	@value: receives the value
+*	returns true if args[i] was the flag.
+*/
+inline bool read_double_option(int argc, char** args, int& i, const char* name, double& value) {
+	if (strcmp(args[i], name) != 0) return false;
+	if (i + 1 >= argc) {
+		std::cerr << "missing value for " << name << std::endl;
+		exit(1);
+	}
+	value = atof(args[++i]);
+	return true;
+}
+
+/* Matches an argument against a flag name and reads its string value.
+*	@argc: size of args
+*	@args: the argument array
+*	@i: index of the argument, advanced past the value on a match
+*	@name: flag name, e.g. "--accel"
+*	@value: receives the value
+*	returns true if args[i] was the flag.
+*/
+inline bool read_string_option(int argc, char** args, int& i, const char* name, std::string& value) {
+	if (strcmp(args[i], name) != 0) return false;
+	if (i + 1 >= argc) {
+		std::cerr << "missing value for " << name << std::endl;
+		exit(1);
+	}
+	value = args[++i];
+	return true;
+}
+
+/* Pulls the --flags out of args and compacts the remaining positional
+*	arguments to the front.
+*	@argc: size of args
+*	@args: the argument array, rewritten in place
+*	@opts: receives the parsed options
+*	returns the new argc.
+*/
+inline int parse_options(int argc, char** args, render_options& opts) {
+	int out = 1;
+	std::string format = "p3";
+	for (int i = 1; i < argc; i++) {
+		if (read_int_option(argc, args, i, "--threads", opts.threads)) continue;
+		if (read_int_option(argc, args, i, "--tile", opts.tile_size)) continue;
+		if (read_string_option(argc, args, i, "--accel", opts.accel)) continue;
+		if (read_string_option(argc, args, i, "--simd", opts.simd)) continue;
+		if (read_int_option(argc, args, i, "--packet", opts.packet_size)) continue;
+		if (read_string_option(argc, args, i, "--precision", opts.precision)) continue;
+		if (read_int_option(argc, args, i, "--spp", opts.samples_per_pixel)) continue;
+		if (read_string_option(argc, args, i, "--sampler", opts.sampler)) continue;
+		if (read_int_option(argc, args, i, "--adaptive", opts.adaptive)) continue;
+		if (read_double_option(argc, args, i, "--adaptive-threshold", opts.adaptive_threshold)) continue;
+		if (read_string_option(argc, args, i, "--spp-image", opts.spp_image)) continue;
+		if (read_int_option(argc, args, i, "--target-spp", opts.target_spp)) continue;
+		if (read_double_option(argc, args, i, "--time-budget", opts.time_budget)) continue;
+		if (read_string_option(argc, args, i, "--preview", opts.preview)) continue;
+		if (read_double_option(argc, args, i, "--preview-interval", opts.preview_interval)) continue;
+		if (read_int_option(argc, args, i, "--wavefront", opts.wavefront)) continue;
+		if (read_string_option(argc, args, i, "--format", format)) continue;
+		if (read_string_option(argc, args, i, "--output", opts.output)) continue;
+		if (read_double_option(argc, args, i, "--memory-limit", opts.memory_limit)) continue;
+		if (read_string_option(argc, args, i, "--checkpoint", opts.checkpoint)) continue;
+		if (read_double_option(argc, args, i, "--checkpoint-interval", opts.checkpoint_interval)) continue;
+		if (read_string_option(argc, args, i, "--resume", opts.resume)) continue;
+		if (read_string_option(argc, args, i, "--scene", opts.scene)) continue;
+		if (read_string_option(argc, args, i, "--scene-file", opts.scene_file)) continue;
+		if (read_string_option(argc, args, i, "--write-cache", opts.write_cache)) continue;
+		if (read_string_option(argc, args, i, "--write-scene", opts.write_scene)) continue;
+		if (read_string_option(argc, args, i, "--stats", opts.stats)) continue;
+		if (read_string_option(argc, args, i, "--heatmap", opts.heatmap)) continue;
+		if (read_string_option(argc, args, i, "--heatmap-metric", opts.heatmap_metric)) continue;
+		if (read_string_option(argc, args, i, "--trace", opts.trace)) continue;
+		if (read_int_option(argc, args, i, "--trace-events", opts.trace_events)) continue;
+		if (read_int_option(argc, args, i, "--workers", opts.workers)) continue;
+		if (read_string_option(argc, args, i, "--listen", opts.listen)) continue;
+		if (read_string_option(argc, args, i, "--connect", opts.connect)) continue;
+		if (read_double_option(argc, args, i, "--worker-timeout", opts.worker_timeout)) continue;
+		if (read_string_option(argc, args, i, "--inject-fault", opts.inject_fault)) continue;
+		if (strncmp(args[i], "--", 2) == 0) {
+			std::cerr << "unknown option " << args[i] << std::endl;
+			exit(1);
+		}
+		args[out++] = args[i];
+	}
+	if (opts.tile_size < 1) opts.tile_size = 1;
+	if (opts.packet_size < 0 || opts.packet_size > 8) {
+		std::cerr << "--packet must be between 0 and 8" << std::endl;
+		exit(1);
+	}
+	if (opts.accel != "bvh" && opts.accel != "list" && opts.accel != "soa") {
+		std::cerr << "unknown --accel " << opts.accel << std::endl;
+		exit(1);
+	}
+	if (opts.samples_per_pixel < 1) opts.samples_per_pixel = 1;
+	if (opts.adaptive < 0) opts.adaptive = 0;
+	if (opts.adaptive > opts.samples_per_pixel) opts.adaptive = opts.samples_per_pixel;
+	if ((opts.target_spp > 0 || opts.time_budget > 0) && (opts.adaptive > 0 || opts.packet_size > 0)) {
+		std::cerr << "progressive rendering can't be combined with --adaptive or --packet" << std::endl;
+		exit(1);
+	}
+	if (opts.adaptive > 0 && opts.packet_size > 0) {
+		std::cerr << "--adaptive and --packet can't be used together" << std::endl;
+		exit(1);
+	}
+	if (opts.wavefront < 0) opts.wavefront = 0;
+	if (opts.wavefront > 0 && (opts.adaptive > 0 || opts.packet_size > 0 || opts.target_spp > 0 || opts.time_budget > 0)) {
+		std::cerr << "--wavefront can't be combined with --adaptive, --packet or progressive rendering" << std::endl;
+		exit(1);
+	}
+	if (opts.sampler != "mj" && opts.sampler != "sobol" && opts.sampler != "random") {
+		std::cerr << "unknown --sampler " << opts.sampler << std::endl;
+		exit(1);
+	}
+	if (opts.memory_limit > 0 &&
+		(opts.adaptive > 0 || opts.target_spp > 0 || opts.time_budget > 0 || !opts.spp_image.empty())) {
+		std::cerr << "--memory-limit can't be combined with --adaptive, progressive rendering or --spp-image" << std::endl;
+		exit(1);
+	}
+	if (opts.checkpoint.empty()) opts.checkpoint = opts.resume;
+	if (!opts.checkpoint.empty() && (opts.adaptive > 0 || opts.memory_limit > 0)) {
+		std::cerr << "--checkpoint and --resume can't be combined with --adaptive or --memory-limit" << std::endl;
+		exit(1);
+	}
+	if (opts.trace_events < 1) opts.trace_events = 1;
+	if (opts.heatmap_metric != "tests" && opts.heatmap_metric != "time") {
+		std::cerr << "unknown --heatmap-metric " << opts.heatmap_metric << std::endl;
+		exit(1);
+	}
+	if (!opts.heatmap.empty() && (opts.packet_size > 0 || opts.wavefront > 0 || opts.memory_limit > 0)) {
+		std::cerr << "--heatmap can't be combined with --packet, --wavefront or --memory-limit" << std::endl;
+		exit(1);
+	}
+	if (!parse_ppm_format(format, opts.format)) {
+		std::cerr << "unknown --format " << format << std::endl;
+		exit(1);
+	}
+	if (opts.precision != "double" && opts.precision != "float") {
+		std::cerr << "unknown --precision " << opts.precision << std::endl;
+		exit(1);
+	}
+	if (opts.workers < 0) opts.workers = 0;
+	if (opts.worker_timeout < 0) opts.worker_timeout = 0;
+	const bool coordinating = opts.workers > 0 || !opts.listen.empty();
+	if (coordinating && !opts.connect.empty()) {
+		std::cerr << "--connect can't be combined with --workers or --listen" << std::endl;
+		exit(1);
+	}
+	if ((coordinating || !opts.connect.empty()) && (opts.adaptive > 0 || opts.target_spp > 0 || opts.time_budget > 0 ||
+		opts.memory_limit > 0 || !opts.checkpoint.empty() || !opts.spp_image.empty() ||
+		!opts.stats.empty() || !opts.heatmap.empty() || !opts.trace.empty() ||
+		!opts.write_cache.empty() || !opts.write_scene.empty())) {
+		std::cerr << "--workers, --listen and --connect can't be combined with --adaptive, progressive rendering, "
+			"--memory-limit, checkpoints, --spp-image, --stats, --heatmap, --trace or --write-*" << std::endl;
+		exit(1);
+	}
+	if (!opts.connect.empty() && !opts.output.empty()) {
+		std::cerr << "a worker sends its tiles to the coordinator, which writes the image; drop --output" << std::endl;
+		exit(1);
+	}
+	injected_fault fault;
+	if (!opts.inject_fault.empty() && !parse_injected_fault(opts.inject_fault, fault)) {
+		std::cerr << "unknown --inject-fault " << opts.inject_fault << ", use crash:N or hang:N" << std::endl;
+		exit(1);
+	}
+	if (!opts.inject_fault.empty() && opts.workers == 0 && opts.connect.empty()) {
+		std::cerr << "--inject-fault needs --workers or --connect" << std::endl;
+		exit(1);
+	}
+	return out;
+}
+
+#endif
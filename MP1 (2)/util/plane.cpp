@@ -1,30 +1,103 @@
 #include "plane.h"
+#include "render_stats.h"
 
-/* Determines if a ray intersects a plane.
+/* Finds the intersection of a ray with the plane.
 *	@r: Ray to cast
 *	@t_min: min value of t
 *	@t_max: max value of t
-*	@rec: The hit record to store the info
+*	@t: receives the t of the intersection
 *	returns true if the ray intersects the plane, false otherwise.
 */
-bool plane::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+template<class T>
+bool plane_t<T>::solve(const ray_t<T>& r, T t_min, T t_max, T& t) const {
+	return intersect(point, unit_normal, r, t_min, t_max, t);
+}
+
+/* The intersection test of solve() on baked plane data, for code that
+*	keeps planes in its own arrays.
+*	@p: a point on the plane
+*	@unit_n: the unit normal
+*	@r, t_min, t_max, t: as for solve()
+*/
+template<class T>
+bool plane_t<T>::intersect(const vec3_t<T>& p, const vec3_t<T>& unit_n, const ray_t<T>& r, T t_min, T t_max, T& t) {
+	COUNT_STAT(tests[render_counters::plane_tests], 1);
 	// (p-a) . n = 0
 	// (o + td - a) . n = 0
 	// t = (an - on)/dn = (a-o)n/dn
-	vec3 o = r.origin();
-	vec3 d = r.direction();
-	double denom = dot(d,n);
+	vec3_t<T> o = r.origin();
+	vec3_t<T> d = r.direction();
+	T denom = dot(d,unit_n);
 	//std::cout << denom << std::endl;
-	if (denom > 1e-6 || denom < -1e-6) {
-		double t = dot((p - o),n)/denom;
-		if (t < 0) return false;
-		rec.t = t;
-    	rec.p = r.at(rec.t);
-    	rec.n = normalize(n);
-		rec.kd = kd;
-		rec.ld = ld;
-		//std::cout << "here" << std::endl;
+	if (denom > T(1e-6) || denom < T(-1e-6)) {
+		t = dot((p - o),unit_n)/denom;
+		if (t < t_min || t_max < t) return false;
 		return true;
 	}
 	return false;
 }
+
+/* Determines if a ray intersects a plane.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: The hit record to store the info
+*	returns true if the ray intersects the plane, false otherwise.
+*/
+template<class T>
+bool plane_t<T>::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	T t;
+	if (!solve(ray_t<T>(r), T(t_min), T(t_max), t)) return false;
+	// the limits may have rounded outwards on their way to T
+	if (t < t_min || t_max < t) return false;
+
+	rec.t = t;
+	rec.object = this;
+	rec.prim = 0;
+	//std::cout << "here" << std::endl;
+	return true;
+}
+
+/* Fills in the hit point, normal and material of a hit on the plane
+*	@r: the ray that hit
+*	@rec: a record filled in by hit()
+*/
+template<class T>
+void plane_t<T>::resolve(const ray& r, hit_record& rec) const {
+	rec.p = r.at(rec.t);
+	rec.n = vec3(unit_normal);
+	rec.kd = vec3(kd);
+	rec.ld = vec3(ld);
+}
+
+/* Determines if a ray hits the plane anywhere in [t_min,t_max]
+*	without filling in a hit record.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	returns true if the ray intersects the plane, false otherwise.
+*/
+template<class T>
+bool plane_t<T>::occluded(const ray& r, double t_min, double t_max) const {
+	T t;
+	return solve(ray_t<T>(r), T(t_min), T(t_max), t) && t_min <= t && t <= t_max;
+}
+
+/* Bakes the unit normal.
+*/
+template<class T>
+void plane_t<T>::compile() {
+	unit_normal = normalize(normal);
+}
+
+/* Planes are infinite so they have no bounding box.
+*	@output_box: unused
+*	returns false
+*/
+template<class T>
+bool plane_t<T>::bounding_box(aabb& output_box) const {
+	return false;
+}
+
+template class plane_t<double>;
+template class plane_t<float>;
@@ -4,19 +4,50 @@
 #include "hittable.h"
 #include "vec3.h"
 
-class plane : public hittable {
+/* Plane stored and intersected in precision T. Hits are reported
+*	through the double precision hittable interface. The geometry is
+*	private so it can't change without the baked data following it.
+*/
+template<class T>
+class plane_t : public hittable {
     public:
-        plane() : kd(vec3(0,0,0)), ld(vec3(0,0,0)) {}
-        plane(vec3 pu, vec3 nu, vec3 kdu, vec3 ldu) : p(pu), n(nu), kd(kdu), ld(ldu) {};
+        plane_t() : kd(vec3_t<T>(0,0,0)), ld(vec3_t<T>(0,0,0)), point(vec3_t<T>(0,0,0)), normal(vec3_t<T>(0,0,1)) { compile(); }
+        plane_t(vec3_t<T> pu, vec3_t<T> nu, vec3_t<T> kdu, vec3_t<T> ldu) : kd(kdu), ld(ldu), point(pu), normal(nu) { compile(); };
 
         virtual bool hit(
             const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual void resolve(const ray& r, hit_record& rec) const override;
+        virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void compile() override;
+
+        vec3_t<T> p() const { return point; }
+        vec3_t<T> n() const { return normal; }
+        vec3_t<T> unit_n() const { return unit_normal; }
+
+        // change the geometry and bake it again
+        void set_point(const vec3_t<T>& pu) { point = pu; }
+        void set_normal(const vec3_t<T>& nu) { normal = nu; compile(); }
+
+    private:
+        bool solve(const ray_t<T>& r, T t_min, T t_max, T& t) const;
+
+    public:
+        static bool intersect(const vec3_t<T>& p, const vec3_t<T>& unit_n, const ray_t<T>& r, T t_min, T t_max, T& t);
 
     public:
-        vec3 p;
-		vec3 n;
-		vec3 kd;
-		vec3 ld;
+		vec3_t<T> kd;
+		vec3_t<T> ld;
+
+    private:
+        vec3_t<T> point;
+		vec3_t<T> normal;
+
+		// baked by compile()
+		vec3_t<T> unit_normal;
 };
 
+typedef plane_t<double> plane;
+typedef plane_t<float> planef;
+
 #endif
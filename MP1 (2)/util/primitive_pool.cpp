@@ -0,0 +1,302 @@
+#include "primitive_pool.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "plane.h"
+#include "simd_kernels.h"
+#include "render_stats.h"
+
+/* Constructor. Copies the baked data of every sphere, triangle and plane
+*	in the list into the pools. Other hittables are kept as they are and
+*	tested after the pools. Primitives of either precision are converted
+*	to the pool's.
+*	@list: a compiled scene
+*/
+template<class T>
+primitive_pool_t<T>::primitive_pool_t(const hittable_list& list) {
+	for (const auto& object : list.objects()) {
+		const hittable* h = object.get();
+		if (const sphere* s = dynamic_cast<const sphere*>(h)) {
+			add_sphere(s->center(), s->radius(), s->kd, s->ld);
+		} else if (const spheref* s = dynamic_cast<const spheref*>(h)) {
+			add_sphere(vec3(s->center()), s->radius(), vec3(s->kd), vec3(s->ld));
+		} else if (const triangle* t = dynamic_cast<const triangle*>(h)) {
+			add_triangle(t->v1(), t->v2(), t->v3(), t->kd, t->ld);
+		} else if (const trianglef* t = dynamic_cast<const trianglef*>(h)) {
+			add_triangle(vec3(t->v1()), vec3(t->v2()), vec3(t->v3()), vec3(t->kd), vec3(t->ld));
+		} else if (const plane* p = dynamic_cast<const plane*>(h)) {
+			add_plane(p->p(), p->n(), p->kd, p->ld);
+		} else if (const planef* p = dynamic_cast<const planef*>(h)) {
+			add_plane(vec3(p->p()), vec3(p->n()), vec3(p->kd), vec3(p->ld));
+		} else {
+			others.add(object);
+		}
+	}
+}
+
+/* Looks up a material, adding it if it hasn't been seen.
+*	@kd: diffuse material component
+*	@ld: diffuse light color
+*	returns the material index.
+*/
+template<class T>
+int primitive_pool_t<T>::material(const vec3& kd, const vec3& ld) {
+	std::vector<double> key = { kd[0], kd[1], kd[2], ld[0], ld[1], ld[2] };
+	std::map<std::vector<double>, int>::iterator it = mat_index.find(key);
+	if (it != mat_index.end()) return it->second;
+
+	int index = int(mat_kd.size());
+	mat_kd.push_back(kd);
+	mat_ld.push_back(ld);
+	mat_index[key] = index;
+	return index;
+}
+
+/* Adds a sphere
+*	@center: center of the sphere
+*	@radius: radius of the sphere
+*	@kd: diffuse material component
+*	@ld: diffuse light color
+*/
+template<class T>
+void primitive_pool_t<T>::add_sphere(const vec3& center, double radius, const vec3& kd, const vec3& ld) {
+	// baked the way sphere_t<T>::compile does it
+	T r = T(radius);
+	sphere_cx.push_back(T(center[0]));
+	sphere_cy.push_back(T(center[1]));
+	sphere_cz.push_back(T(center[2]));
+	sphere_r2.push_back(r*r);
+	sphere_inv_r.push_back(T(1.0)/r);
+	sphere_mat.push_back(material(kd, ld));
+}
+
+/* Adds a triangle
+*	@v1, v2, v3: vertices in CCW order
+*	@kd: diffuse material component
+*	@ld: diffuse light color
+*/
+template<class T>
+void primitive_pool_t<T>::add_triangle(const vec3& v1, const vec3& v2, const vec3& v3, const vec3& kd, const vec3& ld) {
+	triangle_t<T> baked = triangle_t<T>(vec3_t<T>(v1), vec3_t<T>(v2), vec3_t<T>(v3), vec3_t<T>(kd), vec3_t<T>(ld));
+	tri_v0x.push_back(baked.v1()[0]);
+	tri_v0y.push_back(baked.v1()[1]);
+	tri_v0z.push_back(baked.v1()[2]);
+	tri_e1x.push_back(baked.edge1()[0]);
+	tri_e1y.push_back(baked.edge1()[1]);
+	tri_e1z.push_back(baked.edge1()[2]);
+	tri_e2x.push_back(baked.edge2()[0]);
+	tri_e2y.push_back(baked.edge2()[1]);
+	tri_e2z.push_back(baked.edge2()[2]);
+	tri_nx.push_back(baked.unit_n()[0]);
+	tri_ny.push_back(baked.unit_n()[1]);
+	tri_nz.push_back(baked.unit_n()[2]);
+	tri_mat.push_back(material(kd, ld));
+}
+
+/* Adds a plane
+*	@p: a point on the plane
+*	@n: normal of the plane, need not be unit length
+*	@kd: diffuse material component
+*	@ld: diffuse light color
+*/
+template<class T>
+void primitive_pool_t<T>::add_plane(const vec3& p, const vec3& n, const vec3& kd, const vec3& ld) {
+	vec3_t<T> unit_n = normalize(vec3_t<T>(n));
+	plane_px.push_back(T(p[0]));
+	plane_py.push_back(T(p[1]));
+	plane_pz.push_back(T(p[2]));
+	plane_nx.push_back(unit_n[0]);
+	plane_ny.push_back(unit_n[1]);
+	plane_nz.push_back(unit_n[2]);
+	plane_mat.push_back(material(kd, ld));
+}
+
+/* Tests the ray against every sphere with the active kernels.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t, lowered to every hit found
+*	@any_hit: stop at the first hit
+*	returns the index of the closest sphere hit, -1 if none.
+*/
+template<class T>
+int primitive_pool_t<T>::hit_spheres(const ray_t<T>& r, T t_min, T& t_max, bool any_hit) const {
+	if (sphere_r2.empty()) return -1;
+	COUNT_STAT(tests[render_counters::sphere_tests], sphere_r2.size());
+	vec3_t<T> o = r.origin();
+	vec3_t<T> d = r.direction();
+	T od[6] = { o[0], o[1], o[2], d[0], d[1], d[2] };
+	sphere_arrays_t<T> s = { sphere_cx.data(), sphere_cy.data(), sphere_cz.data(), sphere_r2.data(), int(sphere_r2.size()) };
+	return active_kernels<T>().spheres(s, od, od + 3, t_min, t_max, any_hit);
+}
+
+/* Tests the ray against every triangle with the active kernels.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t, lowered to every hit found
+*	@any_hit: stop at the first hit
+*	returns the index of the closest triangle hit, -1 if none.
+*/
+template<class T>
+int primitive_pool_t<T>::hit_triangles(const ray_t<T>& r, T t_min, T& t_max, bool any_hit) const {
+	if (tri_v0x.empty()) return -1;
+	COUNT_STAT(tests[render_counters::triangle_tests], tri_v0x.size());
+	vec3_t<T> o = r.origin();
+	vec3_t<T> d = r.direction();
+	T od[6] = { o[0], o[1], o[2], d[0], d[1], d[2] };
+	triangle_arrays_t<T> tri = {
+		tri_v0x.data(), tri_v0y.data(), tri_v0z.data(),
+		tri_e1x.data(), tri_e1y.data(), tri_e1z.data(),
+		tri_e2x.data(), tri_e2y.data(), tri_e2z.data(),
+		int(tri_v0x.size()) };
+	return active_kernels<T>().triangles(tri, od, od + 3, t_min, t_max, any_hit);
+}
+
+/* Tests the ray against every plane. Same arithmetic as plane::solve.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t, lowered to every hit found
+*	@any_hit: stop at the first hit
+*	returns the index of the closest plane hit, -1 if none.
+*/
+template<class T>
+int primitive_pool_t<T>::hit_planes(const ray_t<T>& r, T t_min, T& t_max, bool any_hit) const {
+	vec3_t<T> o = r.origin();
+	vec3_t<T> d = r.direction();
+
+	int best = -1;
+	int n = int(plane_px.size());
+	COUNT_STAT(tests[render_counters::plane_tests], n);
+	for (int i = 0; i < n; i++) {
+		T nx = plane_nx[i], ny = plane_ny[i], nz = plane_nz[i];
+		T denom = d[0]*nx + d[1]*ny + d[2]*nz;
+		if (denom > T(1e-6) || denom < T(-1e-6)) {
+			T t = ((plane_px[i] - o[0])*nx + (plane_py[i] - o[1])*ny + (plane_pz[i] - o[2])*nz)/denom;
+			if (t < t_min || t_max < t) continue;
+			t_max = t;
+			best = i;
+			if (any_hit) break;
+		}
+	}
+	return best;
+}
+
+/* Determines if the ray hits any primitive in the pools. The pools are
+*	searched with the ray and the limits rounded to T.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: hit record to store the info
+*/
+template<class T>
+bool primitive_pool_t<T>::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	ray_t<T> rt = ray_t<T>(r);
+	T closest = T(t_max);
+	int s = hit_spheres(rt, T(t_min), closest, false);
+	int t = hit_triangles(rt, T(t_min), closest, false);
+	int p = hit_planes(rt, T(t_min), closest, false);
+	double closest_so_far = (s >= 0 || t >= 0 || p >= 0) ? double(closest) : t_max;
+
+	if (others.hit(r, t_min, closest_so_far, rec)) return true;
+
+	// the last pool to report a hit holds the closest one. Primitives
+	// are numbered spheres first, then triangles, then planes.
+	if (p >= 0) {
+		rec.prim = int(sphere_count() + triangle_count()) + p;
+	} else if (t >= 0) {
+		rec.prim = int(sphere_count()) + t;
+	} else if (s >= 0) {
+		rec.prim = s;
+	} else {
+		return false;
+	}
+	rec.t = closest_so_far;
+	rec.object = this;
+	return true;
+}
+
+/* Fills in the hit point, normal and material of a hit on a pooled
+*	primitive
+*	@r: the ray that hit
+*	@rec: a record filled in by hit()
+*/
+template<class T>
+void primitive_pool_t<T>::resolve(const ray& r, hit_record& rec) const {
+	int spheres = int(sphere_count());
+	int triangles = int(triangle_count());
+	int mat;
+	rec.p = r.at(rec.t);
+	if (rec.prim >= spheres + triangles) {
+		int p = rec.prim - spheres - triangles;
+		rec.n = vec3(plane_nx[p], plane_ny[p], plane_nz[p]);
+		mat = plane_mat[p];
+	} else if (rec.prim >= spheres) {
+		int t = rec.prim - spheres;
+		rec.n = vec3(tri_nx[t], tri_ny[t], tri_nz[t]);
+		mat = tri_mat[t];
+	} else {
+		int s = rec.prim;
+		vec3 c = vec3(sphere_cx[s], sphere_cy[s], sphere_cz[s]);
+		rec.n = double(sphere_inv_r[s]) * (rec.p - c);
+		mat = sphere_mat[s];
+	}
+	rec.kd = mat_kd[mat];
+	rec.ld = mat_ld[mat];
+}
+
+/* Determines if the ray hits anything in the pools, stopping at the
+*	first primitive found.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+template<class T>
+bool primitive_pool_t<T>::occluded(const ray& r, double t_min, double t_max) const {
+	ray_t<T> rt = ray_t<T>(r);
+	T limit = T(t_max);
+	if (hit_spheres(rt, T(t_min), limit, true) >= 0) return true;
+	if (hit_triangles(rt, T(t_min), limit, true) >= 0) return true;
+	if (hit_planes(rt, T(t_min), limit, true) >= 0) return true;
+	return others.occluded(r, t_min, t_max);
+}
+
+/* Computes the box around every pooled primitive
+*	@output_box: receives the box
+*	returns false if the pools hold a plane or nothing at all.
+*/
+template<class T>
+bool primitive_pool_t<T>::bounding_box(aabb& output_box) const {
+	if (!plane_px.empty()) return false;
+	if (sphere_r2.empty() && tri_v0x.empty() && others.objects().empty()) return false;
+
+	output_box = aabb();
+	for (size_t i = 0; i < sphere_r2.size(); i++) {
+		double r = sqrt(double(sphere_r2[i]));
+		output_box.expand(vec3(sphere_cx[i] - r, sphere_cy[i] - r, sphere_cz[i] - r));
+		output_box.expand(vec3(sphere_cx[i] + r, sphere_cy[i] + r, sphere_cz[i] + r));
+	}
+	for (size_t i = 0; i < tri_v0x.size(); i++) {
+		vec3 v0 = vec3(tri_v0x[i], tri_v0y[i], tri_v0z[i]);
+		output_box.expand(v0);
+		output_box.expand(v0 + vec3(tri_e1x[i], tri_e1y[i], tri_e1z[i]));
+		output_box.expand(v0 + vec3(tri_e2x[i], tri_e2y[i], tri_e2z[i]));
+	}
+	if (!others.objects().empty()) {
+		aabb box;
+		if (!others.bounding_box(box)) return false;
+		output_box.expand(box);
+	}
+	return true;
+}
+
+/* Returns the bytes held by the pools, not counting the material table.
+*/
+template<class T>
+size_t primitive_pool_t<T>::memory_bytes() const {
+	size_t n = 0;
+	n += sphere_count() * (5*sizeof(T) + sizeof(int));
+	n += triangle_count() * (12*sizeof(T) + sizeof(int));
+	n += plane_count() * (6*sizeof(T) + sizeof(int));
+	return n;
+}
+
+template class primitive_pool_t<double>;
+template class primitive_pool_t<float>;
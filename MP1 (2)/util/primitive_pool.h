@@ -0,0 +1,80 @@
+#ifndef PRIMITIVE_POOL_H
+#define PRIMITIVE_POOL_H
+
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <map>
+#include <vector>
+
+/* Scene storage that keeps each primitive type in its own
+*	structure-of-arrays pool instead of behind shared_ptr<hittable>.
+*	A ray is tested against every sphere, then every triangle, then every
+*	plane in tight loops over contiguous arrays, and the hit record is
+*	only filled in once for the closest primitive. Spheres and triangles
+*	go through the SIMD kernels picked for the CPU (simd_kernels.h).
+*	Materials are stored once and referenced by index.
+*	Geometry is stored and intersected in precision T. The float pool
+*	takes half the memory and its kernels test twice as many primitives
+*	per instruction, at the cost of precision far from the origin (large
+*	spheres, distant geometry); the double pool is the reference.
+*/
+template<class T>
+class primitive_pool_t : public hittable {
+	public:
+		primitive_pool_t() {}
+		primitive_pool_t(const hittable_list& list);
+
+		void add_sphere(const vec3& center, double radius, const vec3& kd, const vec3& ld);
+		void add_triangle(const vec3& v1, const vec3& v2, const vec3& v3, const vec3& kd, const vec3& ld);
+		void add_plane(const vec3& p, const vec3& n, const vec3& kd, const vec3& ld);
+
+		virtual bool hit(
+			const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		virtual void resolve(const ray& r, hit_record& rec) const override;
+		virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+		virtual bool bounding_box(aabb& output_box) const override;
+
+		size_t sphere_count() const { return sphere_r2.size(); }
+		size_t triangle_count() const { return tri_v0x.size(); }
+		size_t plane_count() const { return plane_px.size(); }
+		size_t memory_bytes() const;
+
+	private:
+		int material(const vec3& kd, const vec3& ld);
+
+		int hit_spheres(const ray_t<T>& r, T t_min, T& t_max, bool any_hit) const;
+		int hit_triangles(const ray_t<T>& r, T t_min, T& t_max, bool any_hit) const;
+		int hit_planes(const ray_t<T>& r, T t_min, T& t_max, bool any_hit) const;
+
+	private:
+		// spheres
+		std::vector<T> sphere_cx, sphere_cy, sphere_cz;
+		std::vector<T> sphere_r2, sphere_inv_r;
+		std::vector<int> sphere_mat;
+
+		// triangles: first vertex, the two edges leaving it and the unit normal
+		std::vector<T> tri_v0x, tri_v0y, tri_v0z;
+		std::vector<T> tri_e1x, tri_e1y, tri_e1z;
+		std::vector<T> tri_e2x, tri_e2y, tri_e2z;
+		std::vector<T> tri_nx, tri_ny, tri_nz;
+		std::vector<int> tri_mat;
+
+		// planes: a point on the plane and the unit normal
+		std::vector<T> plane_px, plane_py, plane_pz;
+		std::vector<T> plane_nx, plane_ny, plane_nz;
+		std::vector<int> plane_mat;
+
+		// materials
+		std::vector<vec3> mat_kd;
+		std::vector<vec3> mat_ld;
+		std::map<std::vector<double>, int> mat_index;
+
+		// anything that isn't a sphere, triangle or plane
+		hittable_list others;
+};
+
+typedef primitive_pool_t<double> primitive_pool;
+typedef primitive_pool_t<float> primitive_pool_f;
+
+#endif
@@ -1,20 +1,51 @@
 #ifndef RAY_H
 #define RAY_H
 
-#include "vec3.cpp"
+#include "vec3.h"
 
-class ray {
+/* A ray o + t*d, templated on the scalar type like vec3_t.
+*/
+template<class T>
+class ray_t {
 	private:
-		vec3 o;
-		vec3 d;
+		vec3_t<T> o;
+		vec3_t<T> d;
 
 	public:
-		ray();
-		ray(const vec3& origin, const vec3& direction);
+		/* Empty Constructor
+		*/
+		constexpr ray_t() {}
 
-		vec3 direction() const;
-		vec3 origin() const;
-		vec3 at(double t) const;
+		/* Constructor
+		*	@origin: origin point of the ray
+		*	@direction: direction of the ray
+		*/
+		constexpr ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction) : o(origin), d(direction) {}
+
+		/* Converts from a ray of another precision.
+		*	@r: the ray to convert
+		*/
+		template<class U>
+		constexpr explicit ray_t(const ray_t<U>& r) : o(r.origin()), d(r.direction()) {}
+
+		/*
+		*	Returns the direction of the ray.
+		*/
+		constexpr vec3_t<T> direction() const { return d; }
+
+		/*
+		* Returns the origin of the ray.
+		*/
+		constexpr vec3_t<T> origin() const { return o; }
+
+		/* Gets the point on the ray at time t.
+		*	@t: the time value
+		*	returns the point on the ray at time t.
+		*/
+		constexpr vec3_t<T> at(T t) const { return o + (t*d); }
 };
 
+typedef ray_t<double> ray;
+typedef ray_t<float> rayf;
+
 #endif
@@ -0,0 +1,67 @@
+#include "ray_queue.h"
+
+/* Constructor
+*	@capacity: the most rays the queue holds
+*/
+ray_queue::ray_queue(size_t capacity) : count(0), capacity(capacity < 1 ? 1 : capacity), shadow_count(0) {
+	size_t c = this->capacity;
+	origin.resize(c);
+	direction.resize(c);
+	pixel.resize(c);
+	hit.resize(c);
+	t.resize(c);
+	object.resize(c);
+	prim.resize(c);
+	inner.resize(c);
+	u.resize(c);
+	v.resize(c);
+	p.resize(c);
+	n.resize(c);
+	kd.resize(c);
+	ld.resize(c);
+	shadow_source.resize(c);
+	shadow_origin.resize(c);
+	shadow_direction.resize(c);
+	shadow_tmax.resize(c);
+	occluded.resize(c);
+	color.resize(c);
+}
+
+/* Returns the closest hit of ray i as hit() reported it, without the
+*	fields resolve() fills in.
+*	@i: the ray
+*/
+hit_record ray_queue::get_hit(size_t i) const {
+	hit_record rec;
+	rec.t = t[i];
+	rec.object = object[i];
+	rec.prim = prim[i];
+	rec.inner = inner[i];
+	rec.u = u[i];
+	rec.v = v[i];
+	return rec;
+}
+
+/* Stores the closest hit of ray i.
+*	@i: the ray
+*	@rec: the record hit() filled in
+*/
+void ray_queue::set_hit(size_t i, const hit_record& rec) {
+	t[i] = rec.t;
+	object[i] = rec.object;
+	prim[i] = rec.prim;
+	inner[i] = rec.inner;
+	u[i] = rec.u;
+	v[i] = rec.v;
+}
+
+/* Returns the bytes held by the queue's arrays.
+*/
+size_t ray_queue::memory_bytes() const {
+	size_t per_ray = 3*sizeof(double) * 9		// the vec3 streams
+		+ sizeof(double) * 4					// t, u, v, shadow_tmax
+		+ sizeof(int) * 3						// pixel, prim, shadow_source
+		+ sizeof(const hittable*) * 2			// object, inner
+		+ 2;									// hit, occluded
+	return per_ray * capacity;
+}
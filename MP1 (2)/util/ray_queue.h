@@ -0,0 +1,78 @@
+#ifndef RAY_QUEUE_H
+#define RAY_QUEUE_H
+
+#include <vector>
+#include "hittable.h"
+
+/* An array of vec3 stored as one array per component, so a loop over
+*	many of them reads each component contiguously.
+*/
+struct vec3_stream {
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> z;
+
+	void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+	vec3 get(size_t i) const { return vec3(x[i], y[i], z[i]); }
+	void set(size_t i, const vec3& v) { x[i] = v.x(); y[i] = v.y(); z[i] = v.z(); }
+};
+
+/* The rays of one wavefront and everything the stages of the pipeline
+*	pass along about them, in structure-of-arrays form. Each stage reads
+*	the arrays the previous one wrote:
+*	ray generation -> origin, direction, pixel
+*	closest hit -> hit, t, object, prim, inner, u, v
+*	resolve -> p, n, kd, ld
+*	shadow rays -> shadow_*, compacted to the rays that hit something
+*	occlusion -> occluded
+*	shading -> color
+*/
+struct ray_queue {
+	size_t count;				// rays in the queue
+	size_t capacity;
+
+	// primary rays
+	vec3_stream origin;
+	vec3_stream direction;
+	std::vector<int> pixel;		// where the sample goes, see the stage that reads it
+
+	// closest hit
+	std::vector<unsigned char> hit;
+	std::vector<double> t;
+	std::vector<const hittable*> object;
+	std::vector<int> prim;
+	std::vector<const hittable*> inner;
+	std::vector<double> u;
+	std::vector<double> v;
+
+	// surface at the hit
+	vec3_stream p;
+	vec3_stream n;
+	vec3_stream kd;
+	vec3_stream ld;
+
+	// shadow rays of the first shadow_count hits
+	size_t shadow_count;
+	std::vector<int> shadow_source;		// index of the primary ray
+	vec3_stream shadow_origin;
+	vec3_stream shadow_direction;
+	std::vector<double> shadow_tmax;
+	std::vector<unsigned char> occluded;	// by primary ray, for the hits
+
+	vec3_stream color;
+
+	ray_queue(size_t capacity);
+
+	void clear() { count = 0; shadow_count = 0; }
+	bool full() const { return count == capacity; }
+
+	ray get_ray(size_t i) const { return ray(origin.get(i), direction.get(i)); }
+	hit_record get_hit(size_t i) const;
+	void set_hit(size_t i, const hit_record& rec);
+
+	ray get_shadow_ray(size_t s) const { return ray(shadow_origin.get(s), shadow_direction.get(s)); }
+
+	size_t memory_bytes() const;
+};
+
+#endif
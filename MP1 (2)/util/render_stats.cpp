@@ -0,0 +1,226 @@
+#include "render_stats.h"
+
+#include <algorithm>
+#include <fstream>
+
+/* Constructor, all counts zero.
+*/
+render_counters::render_counters() : primary_rays(0), shadow_rays(0), hits(0), shadowed(0), packets(0), unbounded_packets(0), owner(0) {
+	for (int k = 0; k < test_kind_count; k++) tests[k] = 0;
+}
+
+/* Intersection tests of every kind together.
+*/
+long long render_counters::total_tests() const {
+	long long total = 0;
+	for (int k = 0; k < test_kind_count; k++) total += tests[k];
+	return total;
+}
+
+/* Adds another thread's counts to these.
+*	@other: the counts to add
+*/
+void render_counters::merge(const render_counters& other) {
+	primary_rays += other.primary_rays;
+	shadow_rays += other.shadow_rays;
+	hits += other.hits;
+	shadowed += other.shadowed;
+	packets += other.packets;
+	unbounded_packets += other.unbounded_packets;
+	for (int k = 0; k < test_kind_count; k++) tests[k] += other.tests[k];
+	tiles.insert(tiles.end(), other.tiles.begin(), other.tiles.end());
+}
+
+/* Name of a kind of intersection test, as used in the reports.
+*	@kind: a test_kind
+*/
+const char* render_counters::test_name(int kind) {
+	static const char* names[test_kind_count] = { "sphere", "triangle", "plane", "bvh_node" };
+	return names[kind];
+}
+
+/* Constructor
+*	@w: image width
+*	@h: image height
+*	@per_pixel: also keep the cost of every pixel, for a heatmap
+*/
+render_stats::render_stats(int w, int h, bool per_pixel) : w(w), h(h) {
+	if (per_pixel) {
+		pixel_tests.assign(size_t(w) * h, 0);
+		pixel_ns.assign(size_t(w) * h, 0);
+	}
+}
+
+/* Makes the calling thread count into its own counters here, creating
+*	them on its first call.
+*	returns the thread's counters.
+*/
+render_counters* render_stats::attach() {
+	render_counters*& counters = active_counters();
+	if (counters && counters->owner == this) return counters;
+	std::lock_guard<std::mutex> guard(lock);
+	threads.push_back(std::unique_ptr<render_counters>(new render_counters()));
+	counters = threads.back().get();
+	counters->owner = this;
+	return counters;
+}
+
+/* The counters of every thread merged. Only meaningful once the threads
+*	are done rendering.
+*/
+render_counters render_stats::total() const {
+	std::lock_guard<std::mutex> guard(lock);
+	render_counters sum;
+	for (size_t t = 0; t < threads.size(); t++) sum.merge(*threads[t]);
+	return sum;
+}
+
+/* Adds to the cost of a pixel. A pixel is only ever rendered by one
+*	thread at a time, so this takes no lock.
+*	@i, j: the pixel
+*	@tests: intersection tests its samples made
+*	@ns: nanoseconds they took
+*/
+void render_stats::add_pixel(int i, int j, long long tests, long long ns) {
+	size_t p = size_t(j) * w + i;
+	pixel_tests[p] += double(tests);
+	pixel_ns[p] += double(ns);
+}
+
+/* Prints the merged counters.
+*	@out: where to print
+*	@seconds: wall time of the render
+*/
+void render_stats::print_summary(std::ostream& out, double seconds) const {
+	render_counters sum = total();
+	long long rays = sum.primary_rays + sum.shadow_rays;
+	out << "stats: " << threads.size() << " threads, " << seconds << " s" << std::endl;
+	out << "  rays: " << sum.primary_rays << " primary (" << sum.hits << " hit), "
+		<< sum.shadow_rays << " shadow (" << sum.shadowed << " blocked), "
+		<< (seconds > 0 ? rays / seconds : 0) << " rays/s" << std::endl;
+	out << "  tests:";
+	for (int k = 0; k < render_counters::test_kind_count; k++) {
+		out << " " << sum.tests[k] << " " << render_counters::test_name(k) << (k + 1 < render_counters::test_kind_count ? "," : "");
+	}
+	out << " (" << (rays > 0 ? double(sum.total_tests()) / rays : 0) << " per ray)" << std::endl;
+	if (sum.packets > 0) {
+		out << "  packets: " << sum.packets << " traced, " << sum.unbounded_packets << " without a frustum ("
+			<< 100.0 * sum.unbounded_packets / sum.packets << "%)" << std::endl;
+	}
+	if (!sum.tiles.empty()) {
+		long long total_ns = 0;
+		size_t slowest = 0;
+		for (size_t t = 0; t < sum.tiles.size(); t++) {
+			total_ns += sum.tiles[t].ns;
+			if (sum.tiles[t].ns > sum.tiles[slowest].ns) slowest = t;
+		}
+		out << "  tiles: " << sum.tiles.size() << " rendered, " << total_ns / 1e6 / sum.tiles.size()
+			<< " ms mean, slowest " << sum.tiles[slowest].ns / 1e6 << " ms at ("
+			<< sum.tiles[slowest].x0 << "," << sum.tiles[slowest].y0 << ")" << std::endl;
+	}
+}
+
+namespace {
+	void write_counters(std::ostream& out, const render_counters& c) {
+		out << "{\"primary_rays\": " << c.primary_rays << ", \"hits\": " << c.hits
+			<< ", \"shadow_rays\": " << c.shadow_rays << ", \"shadowed\": " << c.shadowed << ", \"tests\": {";
+		for (int k = 0; k < render_counters::test_kind_count; k++) {
+			out << (k ? ", " : "") << "\"" << render_counters::test_name(k) << "\": " << c.tests[k];
+		}
+		long long tile_ns = 0;
+		for (size_t i = 0; i < c.tiles.size(); i++) tile_ns += c.tiles[i].ns;
+		out << "}, \"packets\": " << c.packets << ", \"unbounded_packets\": " << c.unbounded_packets
+			<< ", \"tiles\": " << c.tiles.size() << ", \"tile_ms\": " << tile_ns / 1e6 << "}";
+	}
+}
+
+/* Writes the merged counters, each thread's counters and every tile's
+*	time as JSON.
+*	@path: file to write
+*	@seconds: wall time of the render
+*	returns false if the file couldn't be written.
+*/
+bool render_stats::write_json(const std::string& path, double seconds) const {
+	std::ofstream out(path.c_str());
+	render_counters sum = total();
+	out << "{\n";
+	out << "  \"seconds\": " << seconds << ",\n";
+	out << "  \"width\": " << w << ",\n";
+	out << "  \"height\": " << h << ",\n";
+	out << "  \"total\": ";
+	write_counters(out, sum);
+	out << ",\n  \"threads\": [";
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (size_t t = 0; t < threads.size(); t++) {
+			out << (t ? ",\n    " : "\n    ");
+			write_counters(out, *threads[t]);
+		}
+		out << (threads.empty() ? "],\n" : "\n  ],\n");
+	}
+	// tiles in image order, top row first; progressive passes render a
+	// tile many times, those are added up
+	std::vector<render_counters::tile_time> tiles = sum.tiles;
+	std::sort(tiles.begin(), tiles.end(), [](const render_counters::tile_time& a, const render_counters::tile_time& b) {
+		return (a.y0 != b.y0) ? a.y0 > b.y0 : a.x0 < b.x0;
+	});
+	out << "  \"tiles\": [";
+	for (size_t i = 0, first = 0; i < tiles.size(); i = first) {
+		long long ns = 0;
+		for (first = i; first < tiles.size() && tiles[first].x0 == tiles[i].x0 && tiles[first].y0 == tiles[i].y0; first++) {
+			ns += tiles[first].ns;
+		}
+		out << (i ? ",\n    " : "\n    ") << "{\"x\": " << tiles[i].x0 << ", \"y\": " << tiles[i].y0
+			<< ", \"renders\": " << first - i << ", \"ms\": " << ns / 1e6 << "}";
+	}
+	out << (tiles.empty() ? "]\n" : "\n  ]\n");
+	out << "}\n";
+	return bool(out);
+}
+
+/* Writes the cost of every pixel as a binary ppm, colored from black
+*	through blue, red and yellow to white. The scale tops out at the
+*	99.5th percentile so a few extreme pixels don't wash out the rest;
+*	pixels above it are white.
+*	@path: file to write
+*	@m: intersection tests or time per pixel
+*	returns false if there are no pixel costs or the file couldn't be
+*	written.
+*/
+bool render_stats::write_heatmap(const std::string& path, metric m) const {
+	if (!per_pixel()) return false;
+	const std::vector<double>& cost = (m == test_count) ? pixel_tests : pixel_ns;
+	std::vector<double> sorted(cost);
+	size_t k = size_t(0.995 * (sorted.size() - 1));
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	double top = (sorted[k] > 0) ? sorted[k] : 1;
+
+	static const float stops[5][3] = { {0,0,0}, {0,0,1}, {1,0,0}, {1,1,0}, {1,1,1} };
+	std::ofstream out(path.c_str(), std::ios::binary);
+	out << "P6\n" << w << " " << h << "\n255\n";
+	std::vector<unsigned char> row(size_t(w) * 3);
+	for (int j = h - 1; j >= 0; j--) {
+		for (int i = 0; i < w; i++) {
+			double x = cost[size_t(j) * w + i] / top;
+			if (x > 1) x = 1;
+			double s = x * 4;
+			int a = (s >= 4) ? 3 : int(s);
+			double f = s - a;
+			for (int c = 0; c < 3; c++) {
+				row[3*i + c] = (unsigned char)(255 * (stops[a][c] + f * (stops[a+1][c] - stops[a][c])) + 0.5);
+			}
+		}
+		out.write(reinterpret_cast<const char*>(&row[0]), row.size());
+	}
+	return bool(out);
+}
+
+/* Reads a heatmap metric name: "tests" or "time".
+*	returns false for anything else.
+*/
+bool render_stats::parse_metric(const std::string& name, metric& m) {
+	if (name == "tests") m = test_count;
+	else if (name == "time") m = nanoseconds;
+	else return false;
+	return true;
+}
@@ -0,0 +1,137 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* What one render thread did. Each thread counts into its own copy
+*	through active_counters(), so counting is a plain increment with no
+*	sharing between threads; the copies are merged once the render is
+*	done. Intersection tests are counted per primitive tested, including
+*	the ones the SIMD kernels of --accel soa test a vector at a time.
+*/
+struct render_counters {
+	enum test_kind { sphere_tests, triangle_tests, plane_tests, node_tests, test_kind_count };
+
+	struct tile_time {
+		int x0, y0;
+		long long ns;
+	};
+
+	long long primary_rays;
+	long long shadow_rays;
+	long long hits;				// primary rays that hit something
+	long long shadowed;			// shadow rays that were blocked
+	long long tests[test_kind_count];
+	long long packets;			// --packet bundles traced, once per sample
+	long long unbounded_packets;	// of those, traced ray by ray as no frustum bounds them
+	std::vector<tile_time> tiles;	// every tile this thread rendered
+	const void* owner;			// the render_stats these belong to
+
+	render_counters();
+
+	long long total_tests() const;
+	void merge(const render_counters& other);
+
+	static const char* test_name(int kind);
+};
+
+/* The counters of the calling thread, or null when nothing is being
+*	counted.
+*/
+inline render_counters*& active_counters() {
+	static thread_local render_counters* counters = 0;
+	return counters;
+}
+
+/* Adds n to a field of the calling thread's counters. Compiled out with
+*	-DMP1_NO_STATS.
+*/
+#ifndef MP1_NO_STATS
+#define COUNT_STAT(field, n) do { if (render_counters* counters_ = active_counters()) counters_->field += (n); } while (0)
+#else
+#define COUNT_STAT(field, n) do {} while (0)
+#endif
+
+/* Collects the counters of every render thread and, if asked, the cost
+*	of every pixel: the intersection tests and nanoseconds that went into
+*	its samples. Writes a summary, a JSON report and a heatmap of the
+*	pixel costs.
+*/
+class render_stats {
+	public:
+		enum metric { test_count, nanoseconds };
+
+		render_stats(int w, int h, bool per_pixel);
+
+		render_counters* attach();
+		render_counters total() const;
+		bool per_pixel() const { return !pixel_tests.empty(); }
+		void add_pixel(int i, int j, long long tests, long long ns);
+
+		void print_summary(std::ostream& out, double seconds) const;
+		bool write_json(const std::string& path, double seconds) const;
+		bool write_heatmap(const std::string& path, metric m) const;
+
+		static bool parse_metric(const std::string& name, metric& m);
+
+	private:
+		mutable std::mutex lock;
+		std::vector<std::unique_ptr<render_counters> > threads;
+		int w;
+		int h;
+		std::vector<double> pixel_tests;
+		std::vector<double> pixel_ns;
+};
+
+/* Times a tile from construction to destruction and makes the calling
+*	thread count into stats. Does nothing when stats is null.
+*/
+class tile_timer {
+	public:
+		tile_timer(render_stats* stats, int x0, int y0) : counters(stats ? stats->attach() : 0), x0(x0), y0(y0) {
+			if (counters) start = std::chrono::steady_clock::now();
+		}
+
+		~tile_timer() {
+			if (!counters) return;
+			render_counters::tile_time t = { x0, y0,
+				(long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() };
+			counters->tiles.push_back(t);
+		}
+
+	private:
+		render_counters* counters;
+		int x0, y0;
+		std::chrono::steady_clock::time_point start;
+};
+
+/* Measures what one pixel cost from construction to finish(), for the
+*	heatmap. Does nothing unless stats keeps pixel costs; the thread must
+*	be counting (see tile_timer).
+*/
+class pixel_cost {
+	public:
+		pixel_cost(render_stats* stats) : stats((stats && stats->per_pixel()) ? stats : 0), tests(0) {
+			if (!this->stats) return;
+			tests = active_counters()->total_tests();
+			start = std::chrono::steady_clock::now();
+		}
+
+		void finish(int i, int j) {
+			if (!stats) return;
+			long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			stats->add_pixel(i, j, active_counters()->total_tests() - tests, ns);
+		}
+
+	private:
+		render_stats* stats;
+		long long tests;
+		std::chrono::steady_clock::time_point start;
+};
+
+#endif
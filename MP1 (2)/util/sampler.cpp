@@ -0,0 +1,221 @@
+#include "sampler.h"
+
+#include <cmath>
+
+namespace {
+	const double two_pow_minus_32 = 1.0/4294967296.0;
+	const double two_pow_minus_53 = 1.0/9007199254740992.0;
+	const int multi_jitter_patterns = 64;			// per frame, whatever the spp
+	const size_t multi_jitter_table = 1 << 16;		// most points tabulated; past it they're computed per sample
+
+	/* Pseudo-random permutation of [0,l) indexed by i, chosen by the
+	*	seed p. This is the hash-based permutation from Kensler's
+	*	"Correlated Multi-Jittered Sampling"; it cycle-walks a bijection
+	*	on the next power of two until the result lands below l.
+	*	@i: index to permute, in [0,l)
+	*	@l: size of the permutation
+	*	@p: seed
+	*/
+	uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+		uint32_t w = l - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do {
+			i ^= p; i *= 0xe170893d;
+			i ^= p >> 16;
+			i ^= (i & w) >> 4;
+			i ^= p >> 8; i *= 0x0929eb3f;
+			i ^= p >> 23;
+			i ^= (i & w) >> 1; i *= 1 | p >> 27;
+			i *= 0x6935fa69;
+			i ^= (i & w) >> 11; i *= 0x74dcb303;
+			i ^= (i & w) >> 2; i *= 0x9e501cc3;
+			i ^= (i & w) >> 2; i *= 0xc860a3df;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= l);
+		return (i + p) % l;
+	}
+
+	/* Reverses the bits of x, the base 2 radical inverse in 0.32 fixed
+	*	point. This is the first dimension of the Sobol sequence.
+	*/
+	uint32_t reverse_bits(uint32_t x) {
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+		x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+		x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+		x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+		return x;
+	}
+
+	/* Second dimension of the Sobol sequence in 0.32 fixed point.
+	*	@i: index in the sequence
+	*/
+	uint32_t sobol_second(uint32_t i) {
+		uint32_t r = 0;
+		for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1) {
+			if (i & 1) r ^= v;
+		}
+		return r;
+	}
+}
+
+/* Constructor
+*	@i, j: the pixel
+*	@sample: sample index within the pixel
+*	@frame: frame or pass number, so repeated passes draw new numbers
+*/
+counter_rng::counter_rng(int i, int j, int sample, unsigned frame) {
+	uint64_t pixel = (uint64_t(uint32_t(i)) << 32) | uint32_t(j);
+	uint64_t rest = (uint64_t(frame) << 32) | uint32_t(sample);
+	key = mix(pixel ^ mix(rest + 0x9e3779b97f4a7c15ULL));
+}
+
+/* The splitmix64 finalizer: a bijection on 64 bit integers whose
+*	output bits each depend on every input bit.
+*	@x: value to hash
+*/
+uint64_t counter_rng::mix(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+uint32_t counter_rng::bits(unsigned dimension) const {
+	return uint32_t(mix(key + (uint64_t(dimension) + 1) * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+double counter_rng::uniform(unsigned dimension) const {
+	return (mix(key + (uint64_t(dimension) + 1) * 0x9e3779b97f4a7c15ULL) >> 11) * two_pow_minus_53;
+}
+
+/* Constructor
+*	@p: the pattern
+*	@samples_per_pixel: samples taken in each pixel per frame, any
+*		positive count (it no longer has to be a perfect square)
+*	@frame: frame or pass number
+*	@first, count: the samples of each pixel worth tabulating, all of
+*		them by default; a progressive pass draws only one. Others are
+*		computed when drawn, to the same values.
+*/
+sampler::sampler(pattern p, int samples_per_pixel, unsigned frame, int first, int count)
+	: type(p), spp(samples_per_pixel < 1 ? 1 : samples_per_pixel), frame(frame) {
+	// the most square grid_m x grid_n grid that holds spp cells
+	grid_m = int(sqrt(double(spp)));
+	while ((grid_m + 1) * (grid_m + 1) <= spp) grid_m++;
+	while (grid_m * grid_m > spp) grid_m--;
+	grid_n = (spp + grid_m - 1) / grid_m;
+	patterns = 0;
+	table_first = 0;
+	table_count = 0;
+	frame_key = counter_rng::mix(uint64_t(frame) + 0x9e3779b97f4a7c15ULL);
+	if (type == multi_jitter) build_multi_jitter(first, count);
+}
+
+vec3 sampler::get(int i, int j, int k) const {
+	switch (type) {
+		case multi_jitter: return get_multi_jitter(i, j, k);
+		case sobol: return get_sobol(i, j, k);
+		default: break;
+	}
+	counter_rng rng(i, j, k, frame);
+	return vec3(rng.uniform(0), rng.uniform(1), 0);
+}
+
+/* Seeds the frame's correlated multi-jittered patterns, and tabulates
+*	samples [first, first + count) of each when they fit in
+*	multi_jitter_table. The number of patterns never depends on the spp:
+*	with fewer, pixels would share their samples and a progressive render
+*	stopped early would show it.
+*	@first, count: samples to tabulate; a negative count means the rest
+*/
+void sampler::build_multi_jitter(int first, int count) {
+	patterns = multi_jitter_patterns;
+	seeds.resize(patterns);
+	for (int v = 0; v < patterns; v++) seeds[v] = counter_rng(v, 0, 0, frame).bits(2);
+	if (first < 0 || first >= spp) return;
+	if (count < 0 || count > spp - first) count = spp - first;
+	if (size_t(patterns) * count > multi_jitter_table) return;
+	table_first = first;
+	table_count = count;
+	points.resize(size_t(patterns) * count);
+	for (int v = 0; v < patterns; v++) {
+		for (int k = 0; k < count; k++) points[size_t(v) * count + k] = multi_jitter_point(v, first + k);
+	}
+}
+
+/* Sample k of multi-jittered pattern v. It lands in one cell of the
+*	coarse grid_m x grid_n grid and, within it, in its own row and column
+*	of the fine grid, so a pattern is stratified in 2D and in each 1D
+*	projection. Every pattern shuffles the rows and columns with its own
+*	permutations, and k itself so any prefix of the samples is spread
+*	over the pixel.
+*/
+vec3 sampler::multi_jitter_point(int v, int k) const {
+	uint32_t m = grid_m;
+	uint32_t n = grid_n;
+	uint32_t p = seeds[v];
+	uint32_t s = permute(uint32_t(k), uint32_t(spp), p * 0x51633e2d);
+	uint32_t sx = permute(s % m, m, p * 0xa511e9b3);
+	uint32_t sy = permute(s / m, n, p * 0x63d83595);
+
+	counter_rng rng(v, 0, k, frame);
+	double jx = rng.uniform(0);
+	double jy = rng.uniform(1);
+	double x = (s % m + (sy + jx) / n) / m;
+	double y = (s / m + (sx + jy) / m) / n;
+	return vec3(x, y, 0);
+}
+
+/* Multi-jittered sample: sample k of the pattern the pixel's hash picks,
+*	from the table if the constructor tabulated it.
+*/
+vec3 sampler::get_multi_jitter(int i, int j, int k) const {
+	uint64_t pixel = (uint64_t(uint32_t(i)) << 32) | uint32_t(j);
+	uint64_t pick = (counter_rng::mix(pixel ^ frame_key) >> 32) * uint64_t(patterns) >> 32;
+	uint32_t slot = uint32_t(k - table_first);
+	if (slot >= uint32_t(table_count)) return multi_jitter_point(int(pick), k);
+	return points[size_t(pick) * table_count + slot];
+}
+
+/* Sobol sample with random digit scrambling. Both dimensions are XORed
+*	with per-pixel random bits, which keeps the (0,2) stratification of
+*	the sequence while decorrelating neighbouring pixels. Frames continue
+*	the sequence instead of restarting it, so every pass adds new
+*	well-stratified points.
+*/
+vec3 sampler::get_sobol(int i, int j, int k) const {
+	counter_rng rng(i, j, 0, 0);
+	uint32_t index = uint32_t(frame) * uint32_t(spp) + uint32_t(k);
+	double x = (reverse_bits(index) ^ rng.bits(3)) * two_pow_minus_32;
+	double y = (sobol_second(index) ^ rng.bits(4)) * two_pow_minus_32;
+	return vec3(x, y, 0);
+}
+
+/* Looks up a pattern by name.
+*	@name: "mj", "sobol" or "random"
+*	@out: receives the pattern
+*	returns false for an unknown name.
+*/
+bool sampler::parse(const std::string& name, pattern& out) {
+	if (name == "mj") out = multi_jitter;
+	else if (name == "sobol") out = sobol;
+	else if (name == "random") out = random;
+	else return false;
+	return true;
+}
+
+const char* sampler::name(pattern p) {
+	switch (p) {
+		case multi_jitter: return "mj";
+		case sobol: return "sobol";
+		default: return "random";
+	}
+}
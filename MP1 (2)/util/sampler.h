@@ -0,0 +1,90 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "vec3.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Stateless random numbers keyed by (pixel, sample, frame). Every value
+*	is a hash of its key, so any thread can draw any sample in any order
+*	without shared state, and a pixel renders the same no matter which
+*	thread or tile it lands in.
+*/
+class counter_rng {
+	public:
+		counter_rng(int i, int j, int sample, unsigned frame);
+
+		/* Returns a uniform double in [0,1) for one dimension of the
+		*	sample (0 and 1 for the pixel offset, more for later uses).
+		*	@dimension: which number of the sample to draw
+		*/
+		double uniform(unsigned dimension) const;
+
+		/* Returns uniform 32 random bits for one dimension of the sample.
+		*	@dimension: which number of the sample to draw
+		*/
+		uint32_t bits(unsigned dimension) const;
+
+		static uint64_t mix(uint64_t x);
+
+	private:
+		uint64_t key;
+};
+
+/* Generates the sub-pixel offsets used for antialiasing. Samples are
+*	looked up or computed from (pixel, sample index, frame), so any
+*	thread can draw any sample and nothing changes after construction.
+*	Pixels get decorrelated patterns.
+*	- multi_jitter: correlated multi-jittered sampling (Kensler 2013).
+*	  Each frame has 64 patterns, each with its own permutations of the
+*	  rows and columns, and every pixel uses the one its hash picks. The
+*	  constructor tabulates up to 1024 samples of each, those of a pass
+*	  for progressive rendering, so a sample costs one hash and a
+*	  lookup; any other sample is computed when drawn.
+*	- sobol: the first two dimensions of the Sobol sequence, a (0,2)
+*	  sequence, with per-pixel random digit scrambling.
+*	- random: independent uniform offsets.
+*/
+class sampler {
+	public:
+		enum pattern { multi_jitter, sobol, random };
+
+		sampler(pattern p, int samples_per_pixel, unsigned frame = 0, int first = 0, int count = -1);
+
+		/* Returns the offset of sample k of pixel (i,j) in [0,1)^2 as the
+		*	x and y of a vec3.
+		*	@i, j: the pixel
+		*	@k: sample index, in [0, samples_per_pixel)
+		*/
+		vec3 get(int i, int j, int k) const;
+
+		int samples() const { return spp; }
+		pattern kind() const { return type; }
+		unsigned frame_index() const { return frame; }
+
+		static bool parse(const std::string& name, pattern& out);
+		static const char* name(pattern p);
+
+	private:
+		void build_multi_jitter(int first, int count);
+		vec3 multi_jitter_point(int v, int k) const;
+		vec3 get_multi_jitter(int i, int j, int k) const;
+		vec3 get_sobol(int i, int j, int k) const;
+
+	private:
+		pattern type;
+		int spp;
+		unsigned frame;
+		int grid_m;		// multi-jitter grid is grid_m x grid_n
+		int grid_n;
+		int patterns;				// multi-jitter patterns of the frame
+		std::vector<uint32_t> seeds;	// one per pattern
+		std::vector<vec3> points;	// their samples [table_first, table_first + table_count)
+		int table_first;
+		int table_count;
+		uint64_t frame_key;			// seeds the pixels' choice of pattern
+};
+
+#endif
@@ -0,0 +1,768 @@
+#include "scene_file.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "plane.h"
+#include "triangle_mesh.h"
+#include "obj_loader.h"
+#include "instance.h"
+#include "shading.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace {
+	const char cache_magic[8] = { 'M', 'P', '1', 'S', 'C', 'N', '0', '1' };
+
+	/* Splits a line into words in place, dropping a trailing # comment.
+	*	@line: the line, overwritten with the separators
+	*	@words: receives pointers to the words
+	*/
+	void split_words(char* line, std::vector<char*>& words) {
+		words.clear();
+		char* p = line;
+		while (*p) {
+			while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+			if (*p == '\0' || *p == '#') break;
+			words.push_back(p);
+			while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') p++;
+			if (*p == '#') {
+				*p = '\0';
+				break;
+			}
+			if (*p) *p++ = '\0';
+		}
+	}
+
+	/* Reads count numbers starting at words[first].
+	*	returns false if one isn't a finite number.
+	*/
+	bool parse_numbers(const std::vector<char*>& words, size_t first, int count, double* out) {
+		for (int k = 0; k < count; k++) {
+			char* end;
+			errno = 0;
+			out[k] = strtod(words[first + k], &end);
+			if (*end != '\0' || end == words[first + k] || errno == ERANGE || !std::isfinite(out[k])) return false;
+		}
+		return true;
+	}
+
+	vec3 to_vec3(const double* v) {
+		return vec3(v[0], v[1], v[2]);
+	}
+
+	typedef std::array<double, 6> material_key;
+
+	material_key key_of(const vec3& kd, const vec3& ld) {
+		material_key key = {{ kd[0], kd[1], kd[2], ld[0], ld[1], ld[2] }};
+		return key;
+	}
+
+	/* Numbers the distinct materials of a scene in order of first use.
+	*/
+	struct material_table {
+		std::vector<scene_cache_material> materials;
+		std::map<material_key, int> index;
+
+		int32_t add(const vec3& kd, const vec3& ld) {
+			material_key key = key_of(kd, ld);
+			std::map<material_key, int>::iterator found = index.find(key);
+			if (found != index.end()) return found->second;
+			scene_cache_material m;
+			m.kd = kd;
+			m.ld = ld;
+			materials.push_back(m);
+			index[key] = int(materials.size()) - 1;
+			return int32_t(materials.size()) - 1;
+		}
+	};
+
+	/* Finds a file named in a scene file: relative names are relative to
+	*	the scene file's directory.
+	*/
+	std::string relative_to(const std::string& scene_path, const std::string& name) {
+		size_t slash = scene_path.rfind('/');
+		if (name.empty() || name[0] == '/' || slash == std::string::npos) return name;
+		return scene_path.substr(0, slash + 1) + name;
+	}
+
+	/* The statements of the text format, see scene_file.h.
+	*/
+	struct statement_syntax {
+		const char* name;
+		int numbers;
+		bool named;		// a name or file comes before the numbers
+		bool material;	// a material name comes after them
+		const char* usage;
+	};
+
+	const statement_syntax statements[] = {
+		{ "camera", 9, false, false, "camera ex ey ez  dx dy dz  ux uy uz" },
+		{ "light", 3, false, false, "light x y z" },
+		{ "ambient", 6, false, false, "ambient ka.r ka.g ka.b  la.r la.g la.b" },
+		{ "material", 6, true, false, "material NAME  kd.r kd.g kd.b  ld.r ld.g ld.b" },
+		{ "sphere", 4, false, true, "sphere cx cy cz  radius  MATERIAL" },
+		{ "triangle", 9, false, true, "triangle x1 y1 z1  x2 y2 z2  x3 y3 z3  MATERIAL" },
+		{ "plane", 6, false, true, "plane px py pz  nx ny nz  MATERIAL" },
+		{ "mesh", 0, true, true, "mesh FILE  MATERIAL" },
+		{ "object", 0, true, false, "object NAME" },
+		{ "end", 0, false, false, "end" },
+		{ "instance", 9, true, false, "instance NAME  tx ty tz  rx ry rz  sx sy sz" },
+	};
+
+	/* The shared geometry of an object: a lone object as it is (a mesh
+	*	brings its own BVH), several in a BVH of their own.
+	*	@list: the object's primitives
+	*/
+	shared_ptr<hittable> object_geometry(hittable_list& list) {
+		list.compile();
+		if (list.objects().size() == 1) return list.objects()[0];
+		return make_shared<bvh>(list);
+	}
+
+	uint64_t align8(uint64_t offset) {
+		return (offset + 7) & ~uint64_t(7);
+	}
+
+	// true if count records of size bytes at offset lie inside the file
+	bool section_fits(uint64_t offset, uint64_t count, size_t size, uint64_t length) {
+		if (offset % 8 != 0 || offset > length) return false;
+		return count <= (length - offset) / size;
+	}
+
+	// true if every primitive's material is one of the cache's
+	template <typename T>
+	bool materials_fit(const T* records, uint64_t count, uint64_t material_count) {
+		for (uint64_t i = 0; i < count; i++) {
+			if (records[i].material < 0 || uint64_t(records[i].material) >= material_count) return false;
+		}
+		return true;
+	}
+
+	/* Checks everything a traversal of a cache's BVH follows: every
+	*	order entry is a sphere or triangle, every leaf's entries lie in
+	*	the order array, and every internal node's children come after it
+	*	in the array, no deeper than bvh_traverse's stack.
+	*	@nodes, node_count: the tree
+	*	@order: the leaf order, one entry per sphere and triangle
+	*	@bounded: number of spheres and triangles
+	*/
+	bool tree_fits(const bvh_node* nodes, uint64_t node_count, const int32_t* order, int64_t bounded) {
+		for (int64_t i = 0; i < bounded; i++) {
+			if (order[i] < 0 || order[i] >= bounded) return false;
+		}
+		std::vector<unsigned char> depth(size_t(node_count), 0);
+		for (uint64_t i = 0; i < node_count; i++) {
+			const bvh_node& node = nodes[i];
+			if (node.count > 0) {
+				if (node.start < 0 || node.start > bounded - node.count) return false;
+				continue;
+			}
+			if (node.count < 0 || i + 1 >= node_count || node.start <= int64_t(i)
+				|| uint64_t(node.start) >= node_count || depth[i] >= 63) return false;
+			unsigned char below = depth[i] + 1;
+			if (depth[i + 1] < below) depth[i + 1] = below;
+			if (depth[node.start] < below) depth[node.start] = below;
+		}
+		return true;
+	}
+}
+
+bool load_scene_text(const std::string& path, hittable_list& world, scene_view& view, std::string& error,
+	int threads) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) {
+		error = "can't open " + path;
+		return false;
+	}
+	in.seekg(0, std::ios::end);
+	std::vector<char> text(size_t(in.tellg()) + 1, '\0');
+	in.seekg(0, std::ios::beg);
+	if (!in.read(text.data(), std::streamsize(text.size() - 1))) {
+		error = "can't read " + path;
+		return false;
+	}
+
+	view = default_view();
+	std::map<std::string, int> material_names;
+	std::vector<scene_cache_material> materials;
+	// primitives go to the world, or to the object being defined
+	hittable_list* target = &world;
+	hittable_list object_list;
+	std::string object_name;
+	std::map<std::string, shared_ptr<hittable> > objects;
+	std::vector<char*> words;
+	double v[9];
+	int line_number = 0;
+	char* line = text.data();
+	while (line < text.data() + text.size() - 1) {
+		char* end = strchr(line, '\n');
+		if (end) *end = '\0';
+		line_number++;
+		split_words(line, words);
+		line = end ? end + 1 : text.data() + text.size() - 1;
+		if (words.empty()) continue;
+
+		const std::string statement = words[0];
+		const statement_syntax* syntax = 0;
+		for (size_t k = 0; k < sizeof(statements) / sizeof(statements[0]); k++) {
+			if (statement == statements[k].name) syntax = &statements[k];
+		}
+
+		size_t first = (syntax && syntax->named) ? 2 : 1;
+		std::string problem;
+		int material = -1;
+		if (!syntax) {
+			problem = "unknown statement " + statement;
+		} else if (words.size() != first + syntax->numbers + (syntax->material ? 1 : 0)) {
+			problem = std::string("usage: ") + syntax->usage;
+		} else if (!parse_numbers(words, first, syntax->numbers, v)) {
+			problem = "bad number in " + statement;
+		} else if (syntax->material) {
+			std::map<std::string, int>::iterator found = material_names.find(words.back());
+			if (found == material_names.end()) {
+				problem = "undefined material " + std::string(words.back());
+			} else {
+				material = found->second;
+			}
+		}
+
+		if (!problem.empty()) {
+			// reported below
+		} else if (statement == "camera") {
+			if (!(to_vec3(v + 3).length() > 0) || !(to_vec3(v + 6).length() > 0)) {
+				problem = "camera view direction and up can't be zero";
+			} else if (!(cross(to_vec3(v + 3), to_vec3(v + 6)).length() > 0)) {
+				problem = "camera view direction can't be parallel to up";
+			} else {
+				view.eyepoint = to_vec3(v);
+				view.viewdir = to_vec3(v + 3);
+				view.up = to_vec3(v + 6);
+			}
+		} else if (statement == "light") {
+			lightPos = to_vec3(v);
+		} else if (statement == "ambient") {
+			ka = to_vec3(v);
+			la = to_vec3(v + 3);
+		} else if (statement == "material") {
+			scene_cache_material m;
+			m.kd = to_vec3(v);
+			m.ld = to_vec3(v + 3);
+			material_names[words[1]] = int(materials.size());
+			materials.push_back(m);
+		} else if (statement == "sphere") {
+			const scene_cache_material& m = materials[material];
+			if (!(v[3] > 0)) {
+				problem = "sphere radius must be positive";
+			} else {
+				target->add(make_shared<sphere>(to_vec3(v), v[3], m.kd, m.ld));
+			}
+		} else if (statement == "triangle") {
+			const scene_cache_material& m = materials[material];
+			if (!(cross(to_vec3(v + 3) - to_vec3(v), to_vec3(v + 6) - to_vec3(v)).length() > 0)) {
+				problem = "triangle has no area";
+			} else {
+				target->add(make_shared<triangle>(to_vec3(v), to_vec3(v + 3), to_vec3(v + 6), m.kd, m.ld));
+			}
+		} else if (statement == "plane") {
+			const scene_cache_material& m = materials[material];
+			if (!(to_vec3(v + 3).length() > 0)) {
+				problem = "plane normal can't be zero";
+			} else {
+				target->add(make_shared<plane>(to_vec3(v), to_vec3(v + 3), m.kd, m.ld));
+			}
+		} else if (statement == "mesh") {
+			const scene_cache_material& m = materials[material];
+			shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>(m.kd, m.ld);
+			if (load_obj(relative_to(path, words[1]), *mesh, problem, threads)) target->add(mesh);
+		} else if (statement == "object") {
+			if (target != &world) {
+				problem = "objects can't be nested";
+			} else if (objects.count(words[1])) {
+				problem = "object " + std::string(words[1]) + " is already defined";
+			} else {
+				object_name = words[1];
+				object_list = hittable_list();
+				target = &object_list;
+			}
+		} else if (statement == "end") {
+			if (target == &world) {
+				problem = "end without object";
+			} else if (object_list.objects().empty()) {
+				problem = "object " + object_name + " is empty";
+			} else {
+				objects[object_name] = object_geometry(object_list);
+				target = &world;
+			}
+		} else {
+			std::map<std::string, shared_ptr<hittable> >::iterator found = objects.find(words[1]);
+			if (target != &world) {
+				problem = "instances can't be inside an object";
+			} else if (found == objects.end()) {
+				problem = "undefined object " + std::string(words[1]);
+			} else if (v[6] == 0 || v[7] == 0 || v[8] == 0) {
+				problem = "instance scale can't be zero";
+			} else {
+				world.add(make_shared<instance>(found->second,
+					transform::place(to_vec3(v), to_vec3(v + 3), to_vec3(v + 6))));
+			}
+		}
+		if (!problem.empty()) {
+			std::ostringstream message;
+			message << path << ":" << line_number << ": " << problem;
+			error = message.str();
+			return false;
+		}
+	}
+	if (target != &world) {
+		error = path + ": object " + object_name + " has no end";
+		return false;
+	}
+	return true;
+}
+
+bool save_scene_text(const std::string& path, const hittable_list& world, const scene_view& view, std::string& error) {
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream out(tmp.c_str());
+		out.precision(17);
+		out << "# written by mp1 --write-scene\n";
+		out << "camera " << view.eyepoint << "  " << view.viewdir << "  " << view.up << "\n";
+		out << "light " << lightPos << "\n";
+		out << "ambient " << ka << "  " << la << "\n";
+
+		// materials are written as they are first used
+		material_table table;
+		for (size_t i = 0; i < world.objects().size(); i++) {
+			const hittable* object = world.objects()[i].get();
+			const sphere* s = dynamic_cast<const sphere*>(object);
+			const triangle* t = dynamic_cast<const triangle*>(object);
+			const plane* p = dynamic_cast<const plane*>(object);
+			const triangle_mesh* mesh = dynamic_cast<const triangle_mesh*>(object);
+			vec3 kd, ld;
+			if (s) { kd = s->kd; ld = s->ld; }
+			else if (t) { kd = t->kd; ld = t->ld; }
+			else if (p) { kd = p->kd; ld = p->ld; }
+			else if (mesh) { kd = mesh->kd; ld = mesh->ld; }
+			else {
+				error = "only spheres, triangles, planes and meshes can be saved";
+				return false;
+			}
+			size_t known = table.materials.size();
+			int32_t m = table.add(kd, ld);
+			if (table.materials.size() != known) out << "material m" << m << " " << kd << "  " << ld << "\n";
+
+			if (mesh) {
+				// meshes are written out as their triangles
+				for (size_t k = 0; k < mesh->triangle_count(); k++) {
+					out << "triangle " << mesh->corner(k, 0) << "  " << mesh->corner(k, 1) << "  "
+						<< mesh->corner(k, 2) << "  m" << m << "\n";
+				}
+				continue;
+			}
+			if (s) out << "sphere " << s->center() << "  " << s->radius();
+			else if (t) out << "triangle " << t->v1() << "  " << t->v2() << "  " << t->v3();
+			else out << "plane " << p->p() << "  " << p->n();
+			out << "  m" << m << "\n";
+		}
+		out.flush();
+		if (!out) {
+			error = "can't write " + tmp;
+			return false;
+		}
+	}
+	if (rename(tmp.c_str(), path.c_str()) != 0) {
+		error = "can't rename " + tmp;
+		return false;
+	}
+	return true;
+}
+
+/* Constructor. The cache is mapped by open().
+*/
+scene_cache::scene_cache() : fd(-1), data(0), length(0), header(0), materials(0), spheres(0), triangles(0),
+	planes(0), nodes(0), order(0), sphere_count(0), bounded_count(0), plane_count(0) {
+}
+
+/* Destructor. Unmaps the cache.
+*/
+scene_cache::~scene_cache() {
+	close();
+}
+
+/* Checks whether a file starts like a scene cache.
+*	@path: the file
+*	returns false for text scenes and unreadable files.
+*/
+bool scene_cache::is_cache(const std::string& path) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	char magic[sizeof(cache_magic)];
+	return in.read(magic, sizeof(magic)) && memcmp(magic, cache_magic, sizeof(magic)) == 0;
+}
+
+/* Bakes a scene into a cache file: its primitives, materials, camera and
+*	lighting, and a BVH built exactly like bvh's over the same objects.
+*	The file is written through a temporary and renamed.
+*	@path: where to write
+*	@world: a scene of spheres, triangles, planes and meshes
+*	@view: the camera
+*	@error: receives a message on failure
+*	returns false if the scene has other objects or the file can't be written.
+*/
+bool scene_cache::write(const std::string& path, const hittable_list& world, const scene_view& view, std::string& error) {
+	material_table table;
+	std::vector<scene_cache_sphere> sphere_records;
+	std::vector<scene_cache_triangle> triangle_records;
+	std::vector<scene_cache_plane> plane_records;
+	// bounded objects in list order: index into sphere_records, or
+	// -1 - index into triangle_records
+	std::vector<int> bounded;
+	std::vector<aabb> boxes;
+	aabb box;
+	auto add_triangle = [&](const triangle& t) {
+		scene_cache_triangle record = scene_cache_triangle();
+		record.v1 = t.v1();
+		record.edge1 = t.edge1();
+		record.edge2 = t.edge2();
+		record.unit_n = t.unit_n();
+		record.material = table.add(t.kd, t.ld);
+		bounded.push_back(-1 - int(triangle_records.size()));
+		triangle_records.push_back(record);
+		t.bounding_box(box);
+		boxes.push_back(box);
+	};
+	for (size_t i = 0; i < world.objects().size(); i++) {
+		const hittable* object = world.objects()[i].get();
+		if (const sphere* s = dynamic_cast<const sphere*>(object)) {
+			scene_cache_sphere record = scene_cache_sphere();
+			record.center = s->center();
+			record.radius2 = s->radius2();
+			record.inv_radius = s->inv_radius();
+			record.material = table.add(s->kd, s->ld);
+			bounded.push_back(int(sphere_records.size()));
+			sphere_records.push_back(record);
+		} else if (const triangle* t = dynamic_cast<const triangle*>(object)) {
+			add_triangle(*t);
+			continue;
+		} else if (const triangle_mesh* mesh = dynamic_cast<const triangle_mesh*>(object)) {
+			// a mesh is flattened into the cache's own triangles
+			for (size_t k = 0; k < mesh->triangle_count(); k++) {
+				add_triangle(triangle(mesh->corner(k, 0), mesh->corner(k, 1), mesh->corner(k, 2), mesh->kd, mesh->ld));
+			}
+			continue;
+		} else if (const plane* p = dynamic_cast<const plane*>(object)) {
+			scene_cache_plane record = scene_cache_plane();
+			record.p = p->p();
+			record.unit_n = p->unit_n();
+			record.material = table.add(p->kd, p->ld);
+			plane_records.push_back(record);
+			continue;
+		} else {
+			error = "only spheres, triangles, planes and meshes can be cached";
+			return false;
+		}
+		object->bounding_box(box);
+		boxes.push_back(box);
+	}
+
+	std::vector<bvh_node> node_records;
+	std::vector<int> leaf_order;
+	bvh_builder::build(boxes, node_records, leaf_order);
+	std::vector<int32_t> order_records(leaf_order.size());
+	for (size_t i = 0; i < leaf_order.size(); i++) {
+		int b = bounded[leaf_order[i]];
+		order_records[i] = (b >= 0) ? b : int32_t(sphere_records.size()) - 1 - b;
+	}
+
+	scene_cache_header h = scene_cache_header();
+	memcpy(h.magic, cache_magic, sizeof(cache_magic));
+	h.header_size = sizeof(scene_cache_header);
+	h.node_size = sizeof(bvh_node);
+	h.eyepoint = view.eyepoint;
+	h.viewdir = view.viewdir;
+	h.up = view.up;
+	h.light = lightPos;
+	h.ka = ka;
+	h.la = la;
+	h.material_count = table.materials.size();
+	h.sphere_count = sphere_records.size();
+	h.triangle_count = triangle_records.size();
+	h.plane_count = plane_records.size();
+	h.node_count = node_records.size();
+	h.materials = align8(sizeof(h));
+	h.spheres = align8(h.materials + h.material_count * sizeof(scene_cache_material));
+	h.triangles = align8(h.spheres + h.sphere_count * sizeof(scene_cache_sphere));
+	h.planes = align8(h.triangles + h.triangle_count * sizeof(scene_cache_triangle));
+	h.nodes = align8(h.planes + h.plane_count * sizeof(scene_cache_plane));
+	h.order = align8(h.nodes + h.node_count * sizeof(bvh_node));
+	h.length = h.order + order_records.size() * sizeof(int32_t);
+
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream out(tmp.c_str(), std::ios::binary);
+		uint64_t written = 0;
+		// pads to offset, then writes size bytes
+		auto put = [&](uint64_t offset, const void* bytes, size_t size) {
+			static const char zeros[8] = { 0 };
+			out.write(zeros, std::streamsize(offset - written));
+			out.write(static_cast<const char*>(bytes), std::streamsize(size));
+			written = offset + size;
+		};
+		put(0, &h, sizeof(h));
+		put(h.materials, table.materials.data(), table.materials.size() * sizeof(scene_cache_material));
+		put(h.spheres, sphere_records.data(), sphere_records.size() * sizeof(scene_cache_sphere));
+		put(h.triangles, triangle_records.data(), triangle_records.size() * sizeof(scene_cache_triangle));
+		put(h.planes, plane_records.data(), plane_records.size() * sizeof(scene_cache_plane));
+		put(h.nodes, node_records.data(), node_records.size() * sizeof(bvh_node));
+		put(h.order, order_records.data(), order_records.size() * sizeof(int32_t));
+		out.flush();
+		if (!out) {
+			error = "can't write " + tmp;
+			return false;
+		}
+	}
+	if (rename(tmp.c_str(), path.c_str()) != 0) {
+		error = "can't rename " + tmp;
+		return false;
+	}
+	return true;
+}
+
+/* Maps a cache and checks that its sections lie inside the file and
+*	that every index in it, the BVH's children and leaf ranges, the
+*	leaf order and the primitives' materials, is in range, so a corrupt
+*	cache is refused instead of crashing the render. This reads the file
+*	through once.
+*	@path: the file
+*	@view: receives the camera
+*	@error: receives a message on failure
+*	returns false if the file can't be mapped or isn't a cache of this
+*	build. Moves the light and the ambient term (see shading.h).
+*/
+bool scene_cache::open(const std::string& path, scene_view& view, std::string& error) {
+	close();
+	fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		error = "can't open " + path;
+		close();
+		return false;
+	}
+	length = size_t(st.st_size);
+	if (length < sizeof(scene_cache_header)) {
+		error = path + " is too short for a scene cache";
+		close();
+		return false;
+	}
+	void* p = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		error = "can't map " + path;
+		data = 0;
+		close();
+		return false;
+	}
+	data = static_cast<const unsigned char*>(p);
+
+	const scene_cache_header* h = reinterpret_cast<const scene_cache_header*>(data);
+	if (memcmp(h->magic, cache_magic, sizeof(cache_magic)) != 0 || h->header_size != sizeof(scene_cache_header)
+		|| h->node_size != sizeof(bvh_node)) {
+		error = path + " is not a scene cache of this build";
+		close();
+		return false;
+	}
+	if (h->length != length
+		|| !section_fits(h->materials, h->material_count, sizeof(scene_cache_material), length)
+		|| !section_fits(h->spheres, h->sphere_count, sizeof(scene_cache_sphere), length)
+		|| !section_fits(h->triangles, h->triangle_count, sizeof(scene_cache_triangle), length)
+		|| !section_fits(h->planes, h->plane_count, sizeof(scene_cache_plane), length)
+		|| !section_fits(h->nodes, h->node_count, sizeof(bvh_node), length)
+		|| !section_fits(h->order, h->sphere_count + h->triangle_count, sizeof(int32_t), length)
+		|| h->sphere_count + h->triangle_count + h->plane_count > uint64_t(INT32_MAX)
+		|| h->node_count > uint64_t(INT32_MAX)) {
+		error = path + " is truncated or corrupt";
+		close();
+		return false;
+	}
+	if (!tree_fits(reinterpret_cast<const bvh_node*>(data + h->nodes), h->node_count,
+			reinterpret_cast<const int32_t*>(data + h->order), int64_t(h->sphere_count + h->triangle_count))
+		|| !materials_fit(reinterpret_cast<const scene_cache_sphere*>(data + h->spheres), h->sphere_count, h->material_count)
+		|| !materials_fit(reinterpret_cast<const scene_cache_triangle*>(data + h->triangles), h->triangle_count, h->material_count)
+		|| !materials_fit(reinterpret_cast<const scene_cache_plane*>(data + h->planes), h->plane_count, h->material_count)) {
+		error = path + " is corrupt";
+		close();
+		return false;
+	}
+
+	header = h;
+	materials = reinterpret_cast<const scene_cache_material*>(data + h->materials);
+	spheres = reinterpret_cast<const scene_cache_sphere*>(data + h->spheres);
+	triangles = reinterpret_cast<const scene_cache_triangle*>(data + h->triangles);
+	planes = reinterpret_cast<const scene_cache_plane*>(data + h->planes);
+	nodes = reinterpret_cast<const bvh_node*>(data + h->nodes);
+	order = reinterpret_cast<const int32_t*>(data + h->order);
+	sphere_count = int(h->sphere_count);
+	bounded_count = int(h->sphere_count + h->triangle_count);
+	plane_count = int(h->plane_count);
+
+	view.eyepoint = h->eyepoint;
+	view.viewdir = h->viewdir;
+	view.up = h->up;
+	lightPos = h->light;
+	ka = h->ka;
+	la = h->la;
+	return true;
+}
+
+/* Unmaps the cache. Nothing may be traced through it afterwards.
+*/
+void scene_cache::close() {
+	if (data) munmap(const_cast<unsigned char*>(data), length);
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+	data = 0;
+	length = 0;
+	header = 0;
+	sphere_count = bounded_count = plane_count = 0;
+}
+
+/* returns the number of spheres, triangles and planes.
+*/
+size_t scene_cache::primitive_count() const {
+	return size_t(bounded_count) + size_t(plane_count);
+}
+
+/* Intersects one primitive, filling in t, object, prim and the
+*	barycentrics like the primitive's own hit().
+*	@id: the primitive's number
+*/
+bool scene_cache::hit_primitive(int id, const ray& r, double t_min, double t_max, hit_record& rec) const {
+	if (id < sphere_count) {
+		const scene_cache_sphere& s = spheres[id];
+		double root;
+		if (!sphere::intersect(s.center, s.radius2, r, t_min, t_max, root)) return false;
+		rec.t = root;
+	} else if (id < bounded_count) {
+		const scene_cache_triangle& tri = triangles[id - sphere_count];
+		double t, u, v;
+		if (!triangle::intersect(tri.v1, tri.edge1, tri.edge2, r, t_min, t_max, t, u, v)) return false;
+		rec.t = t;
+		rec.u = u;
+		rec.v = v;
+	} else {
+		const scene_cache_plane& pl = planes[id - bounded_count];
+		double t;
+		if (!plane::intersect(pl.p, pl.unit_n, r, t_min, t_max, t)) return false;
+		rec.t = t;
+	}
+	rec.object = this;
+	rec.prim = id;
+	return true;
+}
+
+/* Any-hit test of one primitive.
+*	@id: the primitive's number
+*/
+bool scene_cache::occludes(int id, const ray& r, double t_min, double t_max) const {
+	double t, u, v;
+	if (id < sphere_count) {
+		const scene_cache_sphere& s = spheres[id];
+		return sphere::intersect(s.center, s.radius2, r, t_min, t_max, t);
+	} else if (id < bounded_count) {
+		const scene_cache_triangle& tri = triangles[id - sphere_count];
+		return triangle::intersect(tri.v1, tri.edge1, tri.edge2, r, t_min, t_max, t, u, v);
+	}
+	const scene_cache_plane& pl = planes[id - bounded_count];
+	return plane::intersect(pl.p, pl.unit_n, r, t_min, t_max, t);
+}
+
+/* Determines if the ray hits anything in the cache, using its BVH for
+*	the spheres and triangles and a linear test for the planes.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: hit record to store the info
+*/
+bool scene_cache::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	double closest_so_far = t_max;
+	bool hit_anything = bvh_traverse(nodes, node_count(), r, t_min, closest_so_far, false,
+		[&](int first, int count, double& t_limit) {
+			bool hit_leaf = false;
+			for (int i = first; i < first + count; i++) {
+				if (hit_primitive(order[i], r, t_min, t_limit, rec)) {
+					hit_leaf = true;
+					t_limit = rec.t;
+				}
+			}
+			return hit_leaf;
+		});
+
+	for (int i = 0; i < plane_count; i++) {
+		if (hit_primitive(bounded_count + i, r, t_min, closest_so_far, rec)) {
+			hit_anything = true;
+			closest_so_far = rec.t;
+		}
+	}
+	return hit_anything;
+}
+
+/* Fills in the hit point, normal and material of a hit
+*	@r: the ray that hit
+*	@rec: a record filled in by hit()
+*/
+void scene_cache::resolve(const ray& r, hit_record& rec) const {
+	rec.p = r.at(rec.t);
+	int32_t material;
+	if (rec.prim < sphere_count) {
+		const scene_cache_sphere& s = spheres[rec.prim];
+		rec.n = s.inv_radius * (rec.p - s.center);
+		material = s.material;
+	} else if (rec.prim < bounded_count) {
+		const scene_cache_triangle& tri = triangles[rec.prim - sphere_count];
+		rec.n = tri.unit_n;
+		material = tri.material;
+	} else {
+		const scene_cache_plane& pl = planes[rec.prim - bounded_count];
+		rec.n = pl.unit_n;
+		material = pl.material;
+	}
+	rec.kd = materials[material].kd;
+	rec.ld = materials[material].ld;
+}
+
+/* Determines if the ray hits anything, testing the planes first and
+*	leaving the tree at the first primitive found.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+bool scene_cache::occluded(const ray& r, double t_min, double t_max) const {
+	for (int i = 0; i < plane_count; i++) {
+		if (occludes(bounded_count + i, r, t_min, t_max)) return true;
+	}
+	return bvh_traverse(nodes, node_count(), r, t_min, t_max, true,
+		[&](int first, int count, double& t_limit) {
+			for (int i = first; i < first + count; i++) {
+				if (occludes(order[i], r, t_min, t_limit)) return true;
+			}
+			return false;
+		});
+}
+
+/* The box of the BVH's root.
+*	@output_box: receives the box
+*	returns false if the cache has planes or is empty.
+*/
+bool scene_cache::bounding_box(aabb& output_box) const {
+	if (plane_count > 0 || node_count() == 0) return false;
+	output_box = nodes[0].box;
+	return true;
+}
@@ -0,0 +1,162 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <stdint.h>
+#include <string>
+#include "hittable_list.h"
+#include "bvh.h"
+#include "scenes.h"
+
+/* Scenes read from disk, selected with --scene-file, in two forms.
+*
+*	The text form is for writing scenes by hand. One statement per line,
+*	# starts a comment:
+*		camera ex ey ez  dx dy dz  ux uy uz	eye, view direction and up
+*		light x y z							the point light
+*		ambient ka.r ka.g ka.b  la.r la.g la.b
+*		material NAME  kd.r kd.g kd.b  ld.r ld.g ld.b
+*		sphere cx cy cz  radius  MATERIAL
+*		triangle x1 y1 z1  x2 y2 z2  x3 y3 z3  MATERIAL
+*		plane px py pz  nx ny nz  MATERIAL
+*		mesh FILE  MATERIAL					a Wavefront OBJ file, see obj_loader.h
+*		object NAME							starts a named object: the
+*											primitives up to
+*		end									go into it, not the scene
+*		instance NAME  tx ty tz  rx ry rz  sx sy sz
+*	Radii must be positive, and normals, the view direction and up
+*	nonzero, with the view not parallel to up; triangles need an area.
+*	An instance places a copy of an object: scaled by s (no zeros),
+*	turned rx, ry and rz degrees about x, y and z in that order and moved
+*	by t. Every instance of an object shares its geometry and its BVH
+*	(see instance.h), so a thousand copies cost little more than one.
+*	Objects can't be nested or contain instances. Materials and objects
+*	must be defined before they are used and files are found relative
+*	to the scene file. Statements left out keep the defaults of the
+*	built-in scenes.
+*
+*	The binary form (a scene cache, written with --write-cache) holds the
+*	same scene as baked primitive records and a prebuilt BVH, laid out
+*	exactly as scene_cache traverses them. It is mapped, not parsed:
+*	opening one only checks that its indices are in range, without
+*	building anything. Caches are only valid on machines with the same
+*	byte order and structure layout, which the header records.
+*/
+
+/* Reads a text scene.
+*	@path: the file
+*	@world: receives the objects, not compiled
+*	@view: receives the camera, if the file has one
+*	@error: receives a message with the line number on failure
+*	@threads: threads to parse each mesh with, 0 for one per hardware
+*		thread
+*	returns false if the file can't be read or has an error. Moves the
+*	light and the ambient term (see shading.h) like build_scene.
+*/
+bool load_scene_text(const std::string& path, hittable_list& world, scene_view& view, std::string& error,
+	int threads = 0);
+
+/* Writes a scene of spheres, triangles, planes and meshes as text, with
+*	every number printed in full so it reads back exactly. Meshes are
+*	written as their triangles. The current light and ambient term are
+*	written with it.
+*	@path: where to write
+*	@world: the scene
+*	@view: the camera
+*	@error: receives a message on failure
+*	returns false if the scene has other objects (instances among them)
+*	or the file can't be written.
+*/
+bool save_scene_text(const std::string& path, const hittable_list& world, const scene_view& view, std::string& error);
+
+// layout of a scene cache, all offsets in bytes from the start of the file
+struct scene_cache_header {
+	char magic[8];
+	uint32_t header_size;	// sizeof(scene_cache_header) of the writer
+	uint32_t node_size;		// sizeof(bvh_node) of the writer
+	vec3 eyepoint, viewdir, up;
+	vec3 light, ka, la;
+	uint64_t material_count, sphere_count, triangle_count, plane_count, node_count;
+	uint64_t materials, spheres, triangles, planes, nodes, order;
+	uint64_t length;		// size of the whole file
+};
+
+struct scene_cache_material {
+	vec3 kd;
+	vec3 ld;
+};
+
+struct scene_cache_sphere {
+	vec3 center;
+	double radius2;
+	double inv_radius;
+	int32_t material;
+	int32_t pad;
+};
+
+struct scene_cache_triangle {
+	vec3 v1;
+	vec3 edge1;
+	vec3 edge2;
+	vec3 unit_n;
+	int32_t material;
+	int32_t pad;
+};
+
+struct scene_cache_plane {
+	vec3 p;
+	vec3 unit_n;
+	int32_t material;
+	int32_t pad;
+};
+
+/* A mapped scene cache. Primitives are numbered spheres first, then
+*	triangles, then planes; that number is the hit record's prim. The
+*	BVH's order array lists sphere and triangle numbers in leaf order,
+*	and the planes are tested after the tree, as in bvh. The arithmetic
+*	is the primitives' own, so a cache renders the same image as the
+*	scene it was written from with --accel bvh.
+*/
+class scene_cache : public hittable {
+	public:
+		scene_cache();
+		~scene_cache();
+
+		static bool is_cache(const std::string& path);
+		static bool write(const std::string& path, const hittable_list& world, const scene_view& view, std::string& error);
+
+		bool open(const std::string& path, scene_view& view, std::string& error);
+		void close();
+
+		virtual bool hit(
+			const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		virtual void resolve(const ray& r, hit_record& rec) const override;
+		virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+		virtual bool bounding_box(aabb& output_box) const override;
+
+		size_t size() const { return length; }
+		size_t primitive_count() const;
+		size_t node_count() const { return header ? size_t(header->node_count) : 0; }
+
+	private:
+		bool hit_primitive(int id, const ray& r, double t_min, double t_max, hit_record& rec) const;
+		bool occludes(int id, const ray& r, double t_min, double t_max) const;
+
+	private:
+		int fd;
+		const unsigned char* data;	// the mapping, or null
+		size_t length;
+
+		// views into the mapping
+		const scene_cache_header* header;
+		const scene_cache_material* materials;
+		const scene_cache_sphere* spheres;
+		const scene_cache_triangle* triangles;
+		const scene_cache_plane* planes;
+		const bvh_node* nodes;
+		const int32_t* order;
+		int sphere_count;
+		int bounded_count;	// spheres and triangles
+		int plane_count;
+};
+
+#endif
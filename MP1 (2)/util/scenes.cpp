@@ -0,0 +1,198 @@
+#include "scenes.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "plane.h"
+#include "triangle_mesh.h"
+#include "instance.h"
+#include "sampler.h"
+#include "shading.h"
+
+#include <cmath>
+
+namespace {
+	// fixed seeds, so the random scenes are the same on every build
+	const unsigned spheres_seed = 10000;
+	const unsigned terrain_seed = 1000000;
+	const unsigned instances_seed = 100000;
+
+	// the point the default eye looks through the middle of the image
+	// at depth z, and the width of the view there (for 400 pixels)
+	vec3 view_center(double z) {
+		double c = 250 * (400 - z) / 401 - 250;
+		return vec3(c, -c, z);
+	}
+
+	double view_width(double z) {
+		return 400 * (400 - z) / 401;
+	}
+
+	void default_scene(hittable_list& world) {
+		world.add(make_shared<plane>(vec3(0,0,-400), vec3(0,0,1), vec3(0.8,0.5,0.8), vec3(1,0.4,0.6)));
+		//world.add(make_shared<sphere>(vec3(0,0,-2), 1.95, vec3(1,0,0), vec3(1,1,1)));
+		//world.add(make_shared<triangle>(vec3(50-100,50-100,-1.5), vec3(0-100,-50-100,-1.5), vec3(100-100,-50-100,-1.5), vec3(0.5,0.4,0.8), vec3(0.5,0.5,0.5)));
+		//world.add(make_shared<sphere>(vec3(0,-100.5,-1), 100, vec3(1,1,1), vec3(1,1,1)));
+
+		//world.add(make_shared<sphere>(vec3(-50,0,-52),49.99,vec3(0,0,1),vec3(1,1,1)));
+		//world.add(make_shared<sphere>(vec3(0,-100.5,-120),100,vec3(66.0/255.0, 221.0/255.0, 245.0/255.0),vec3(1,1,1)));
+
+		// perspective
+		world.add(make_shared<triangle>(vec3(50-100,50-100,100), vec3(0-100,-50-100,100), vec3(100-100,-50-100,100), vec3(0.5,0.4,0.8), vec3(0.5,0.5,0.5)));
+		world.add(make_shared<sphere>(vec3(-50,0,0),49.99,vec3(0,0,1),vec3(1,1,1)));
+		world.add(make_shared<sphere>(vec3(0,-100.5,0),100,vec3(66.0/255.0, 221.0/255.0, 245.0/255.0),vec3(1,1,1)));
+	}
+
+	void shadows_scene(hittable_list& world) {
+		world.add(make_shared<plane>(vec3(0,0,-150), vec3(0,0,1), vec3(0.9,0.9,0.8), vec3(1,1,1)));
+		for (int gy = 0; gy < 9; gy++) {
+			for (int gx = 0; gx < 9; gx++) {
+				vec3 c = vec3(-200 + 50*gx, -200 + 50*gy, -60 + 10*((gx + gy) % 3));
+				world.add(make_shared<sphere>(c, 14, vec3(0.2 + 0.08*gx, 0.3, 0.2 + 0.08*gy), vec3(1,1,1)));
+			}
+		}
+		// slats between the spheres, closer to the light
+		for (int k = 0; k < 8; k++) {
+			double y = -175 + 50*k;
+			world.add(make_shared<triangle>(vec3(-230,y,20), vec3(230,y,20), vec3(-230,y+12,30), vec3(0.7,0.6,0.3), vec3(1,1,1)));
+			world.add(make_shared<triangle>(vec3(230,y,20), vec3(230,y+12,30), vec3(-230,y+12,30), vec3(0.7,0.6,0.3), vec3(1,1,1)));
+		}
+		lightPos = vec3(-700,300,600);
+	}
+
+	void spheres_scene(hittable_list& world) {
+		world.add(make_shared<plane>(vec3(0,0,-100), vec3(0,0,1), vec3(0.6,0.6,0.6), vec3(1,1,1)));
+		// a 100 x 100 grid filling the view, jittered within its cells
+		const double step = view_width(-85) / 100;
+		const vec3 corner = view_center(-98) - vec3(50*step, 50*step, 0);
+		for (int k = 0; k < 10000; k++) {
+			counter_rng rng(k, 0, 0, spheres_seed);
+			int gx = k % 100;
+			int gy = k / 100;
+			double r = 1 + 1.5*rng.uniform(0);
+			vec3 c = corner + vec3(step*(gx + rng.uniform(1)), step*(gy + rng.uniform(2)), 30*rng.uniform(3));
+			vec3 kd = vec3(rng.uniform(4), rng.uniform(5), rng.uniform(6));
+			world.add(make_shared<sphere>(c, r, kd, vec3(1,1,1)));
+		}
+	}
+
+	// terrain height at (x,y): a few octaves of waves with random phases
+	double terrain_height(double x, double y) {
+		double z = 0;
+		double scale = 1;
+		for (int octave = 0; octave < 5; octave++) {
+			counter_rng rng(octave, 0, 0, terrain_seed);
+			double fx = 0.01 * scale * (1 + rng.uniform(0));
+			double fy = 0.01 * scale * (1 + rng.uniform(1));
+			z += 30 / scale * sin(fx*x + 6.283*rng.uniform(2)) * cos(fy*y + 6.283*rng.uniform(3));
+			scale *= 2.1;
+		}
+		return z;
+	}
+
+	void terrain_scene(hittable_list& world) {
+		// 708 x 708 quads of two triangles each: 1002528 triangles
+		const int n = 708;
+		const double extent = view_width(-60);
+		const double step = extent / n;
+		const vec3 corner = view_center(-60) - vec3(extent/2, extent/2, 0);
+		std::vector<vec3> row0(n + 1), row1(n + 1);
+		for (int i = 0; i <= n; i++) {
+			double x = corner.x() + step*i;
+			row1[i] = vec3(x, corner.y(), -60 + terrain_height(x, corner.y()));
+		}
+		for (int j = 1; j <= n; j++) {
+			row0.swap(row1);
+			double y = corner.y() + step*j;
+			for (int i = 0; i <= n; i++) {
+				double x = corner.x() + step*i;
+				row1[i] = vec3(x, y, -60 + terrain_height(x, y));
+			}
+			for (int i = 0; i < n; i++) {
+				// greener low, browner high
+				double h = (row0[i].z() + 60) / 60;
+				if (h < -1) h = -1;
+				if (h > 1) h = 1;
+				vec3 kd = vec3(0.45 + 0.2*h, 0.55 - 0.15*h, 0.3);
+				world.add(make_shared<triangle>(row0[i], row0[i+1], row1[i+1], kd, vec3(1,1,1)));
+				world.add(make_shared<triangle>(row0[i], row1[i+1], row1[i], kd, vec3(1,1,1)));
+			}
+		}
+	}
+
+	// a unit sphere with lumps, 224 x 224 quads of two triangles each
+	// (100352 triangles, the ones at the poles empty), wound outward
+	shared_ptr<triangle_mesh> lumpy_sphere() {
+		const int n = 224;
+		shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>(vec3(0.8,0.55,0.3), vec3(1,1,1));
+		mesh->vertices.reserve((n + 1) * n);
+		mesh->indices.reserve(6 * n * n);
+		for (int i = 0; i <= n; i++) {
+			double theta = pi * i / n;
+			for (int j = 0; j < n; j++) {
+				double phi = 2 * pi * j / n;
+				double r = 1 + 0.15 * sin(5*phi) * sin(4*theta);
+				mesh->vertices.push_back(r * vec3(sin(theta)*cos(phi), cos(theta), sin(theta)*sin(phi)));
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) {
+				int a = i*n + j, b = i*n + (j + 1) % n, c = b + n, d = a + n;
+				int32_t quad[6] = { a, b, c, a, c, d };
+				mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+			}
+		}
+		mesh->compile();
+		return mesh;
+	}
+
+	void instances_scene(hittable_list& world) {
+		world.add(make_shared<plane>(vec3(0,0,-100), vec3(0,0,1), vec3(0.6,0.6,0.6), vec3(1,1,1)));
+		// one mesh placed 10000 times on the grid of spheres10k, each
+		// turned and stretched its own way
+		shared_ptr<triangle_mesh> mesh = lumpy_sphere();
+		const double step = view_width(-85) / 100;
+		const vec3 corner = view_center(-98) - vec3(50*step, 50*step, 0);
+		for (int k = 0; k < 10000; k++) {
+			counter_rng rng(k, 0, 0, instances_seed);
+			int gx = k % 100;
+			int gy = k / 100;
+			double r = 1 + 1.5*rng.uniform(0);
+			vec3 c = corner + vec3(step*(gx + rng.uniform(1)), step*(gy + rng.uniform(2)), 30*rng.uniform(3));
+			vec3 degrees = 360 * vec3(rng.uniform(4), rng.uniform(5), rng.uniform(6));
+			vec3 size = r * vec3(0.7 + 0.6*rng.uniform(7), 0.7 + 0.6*rng.uniform(8), 1);
+			world.add(make_shared<instance>(mesh, transform::place(c, degrees, size)));
+		}
+	}
+}
+
+const std::vector<std::string>& scene_names() {
+	static const char* names[] = { "default", "shadows", "spheres10k", "triangles1m", "instances10k" };
+	static const std::vector<std::string> list(names, names + 5);
+	return list;
+}
+
+scene_view default_view() {
+	scene_view view;
+	//view.eyepoint = vec3(1,1,400); // perspective projection
+	view.eyepoint = vec3(-250,250,400);
+	view.viewdir = vec3(0,0,-1);
+	view.up = vec3(0,1,0);
+	return view;
+}
+
+bool build_scene(const std::string& name, hittable_list& world, scene_view& view) {
+	view = default_view();
+	if (name == "default") {
+		default_scene(world);
+	} else if (name == "shadows") {
+		shadows_scene(world);
+	} else if (name == "spheres10k") {
+		spheres_scene(world);
+	} else if (name == "triangles1m") {
+		terrain_scene(world);
+	} else if (name == "instances10k") {
+		instances_scene(world);
+	} else {
+		return false;
+	}
+	return true;
+}
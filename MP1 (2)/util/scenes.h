@@ -0,0 +1,44 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include <string>
+#include <vector>
+#include "hittable_list.h"
+
+/* Where a scene is seen from. The camera keeps its image plane near
+*	the origin (see camera.h), so every scene is built around it.
+*/
+struct scene_view {
+	vec3 eyepoint;
+	vec3 viewdir;
+	vec3 up;
+};
+
+/* The camera of the built-in scenes, looking down -z at the origin.
+*/
+scene_view default_view();
+
+/* The built-in scenes, selected with --scene. They are the benchmark
+*	corpus of bench/scenes.cpp, so a scene must not change once its
+*	golden image is saved; add a new one instead.
+*	- default: the plane, triangle and two spheres of the submitted images
+*	- shadows: a grid of spheres and floating triangles in front of a
+*	  wall, lit from the side so most of the wall is in shadow and every
+*	  shadow ray has to get past the grid
+*	- spheres10k: 10000 small spheres of random size and color
+*	- triangles1m: a terrain heightfield of about a million triangles
+*	- instances10k: one mesh of about 100000 triangles placed 10000
+*	  times, turned and stretched; the mesh and its BVH are held once
+*/
+const std::vector<std::string>& scene_names();
+
+/* Fills an empty scene list with a built-in scene and moves the light
+*	(lightPos, see shading.h) where the scene wants it.
+*	@name: one of scene_names()
+*	@world: receives the objects, not compiled
+*	@view: receives the camera placement
+*	returns false if there is no scene of that name.
+*/
+bool build_scene(const std::string& name, hittable_list& world, scene_view& view);
+
+#endif
@@ -0,0 +1,113 @@
+#include "shading.h"
+#include "util.h"
+#include "render_stats.h"
+
+// Phong reflection
+vec3 ka = vec3(0.5,0.3,0.7); 	// ambient material
+vec3 la = vec3(0.4,0.23,0.1);	// ambient colo
+//vec3 ka = vec3(0,0,0); 	// ambient material
+//vec3 la = vec3(0,0,0);	// ambient color
+vec3 lightPos = vec3(-500,-200,1200);
+
+// how far shadow rays start off the surface. Float geometry needs a
+// larger offset or surfaces shadow themselves.
+double shadow_epsilon = 1e-5;
+//vec3 lightPos = vec3(1,1,1);
+//float alpha = 1;	// shininess coefficient;
+
+/* Clamps the value of components of color.
+*	to the interval [0,1]
+*	@color: The vec3 to clamp
+*	a vec3 with components clamped to [0,1].
+*/
+vec3 clamp(vec3 color) {
+	color[0] = (color[0] > 1) ? 1 : color[0];
+	color[1] = (color[1] > 1) ? 1 : color[1];
+	color[2] = (color[2] > 1) ? 1 : color[2];
+	color[0] = (color[0] < 0) ? 0 : color[0];
+	color[1] = (color[1] < 0) ? 0 : color[1];
+	color[2] = (color[2] < 0) ? 0 : color[2];
+	return color;
+}
+
+/* Does Phong Shading using Blinn-Phong model
+*	@hitpoint: The solution to the ray equation. 
+*			(The point on the ray intersecting the sphere.)
+*	@n: normal to the surface
+*	@kd: diffuse material component
+*	@ld: diffuse light color
+*	returns a vec3 color of the pixel shaded using phong shading
+*/
+vec3 phong(vec3 hitpoint,vec3 n, vec3 kd, vec3 ld) {
+	vec3 L = normalize(lightPos - hitpoint);	// clamp L and N maybe?
+	vec3 N = normalize(n);
+
+	double d = dot(L,N);
+	if (d < 0) d = 0;
+	vec3 color = (ka*la) + (kd*d*ld);
+	return clamp(color);
+}
+
+/* Makes the ray from a hit point toward the light. It starts a little
+*	off the surface so the surface doesn't shadow itself.
+*	@hitpoint: the point being lit
+*	@light_distance: receives the distance from the ray origin to the
+*		light; only objects closer than that cast a shadow
+*	returns the shadow ray.
+*/
+ray shadow_ray(const vec3& hitpoint, double& light_distance) {
+	vec3 norm_dir = normalize(lightPos - hitpoint);
+	double eps = shadow_epsilon;
+	vec3 shadow_origin = hitpoint + vec3(eps,eps,eps)*norm_dir;
+	light_distance = (lightPos - shadow_origin).length();
+	return ray(shadow_origin, norm_dir);
+}
+
+/* Returns the sky gradient seen by a ray that hits nothing.
+*	@r: the ray
+*/
+vec3 sky(const ray& r) {
+	vec3 unit_direction = normalize(r.direction());
+    double t = 0.5*(unit_direction.y() + 1.0);
+    return (1.0-t)*vec3(1.0, 1.0, 1.0) + t*vec3(0.5, 0.7, 1.0);
+}
+
+/* Colors a traced ray: shadowed or Phong shaded where it hit something,
+*	the sky gradient where it didn't.
+*	@r: The ray that was cast.
+*	@hit: whether the ray hit anything
+*	@rec: the closest hit, if any
+*	@world: the scene, for the shadow ray
+*	@shadowed: if given, set to whether the hit point is in shadow
+*	returns the color for a pixel at a point on the viewplane.
+*/
+vec3 shade(const ray& r, bool hit, const hit_record& rec, const hittable& world, bool* shadowed) {
+	if (shadowed) *shadowed = false;
+	COUNT_STAT(primary_rays, 1);
+	if (hit) {
+		// Shadows
+		// create a ray from hitpoint to all light sources
+		double light_distance;
+		ray to_light = shadow_ray(rec.p, light_distance);
+		COUNT_STAT(hits, 1);
+		COUNT_STAT(shadow_rays, 1);
+		if (world.occluded(to_light,0,light_distance)) {
+			// color at that point is black
+			COUNT_STAT(shadowed, 1);
+			if (shadowed) *shadowed = true;
+			return vec3(0,0,0);
+		}
+		return phong(rec.p, rec.n, rec.kd, rec.ld);
+	}
+	return sky(r);
+}
+
+/* Casts a ray to determine if it hits any objects in the scene.
+*	@r: The ray to cast.
+*	returns the color for a pixel at a point on the viewplane.
+*/
+vec3 raycast(ray r, const hittable& world) {
+	hit_record rec;
+	bool hit = world.closest_hit(r,0,infinity,rec);
+	return shade(r, hit, rec, world);
+}
@@ -0,0 +1,22 @@
+#ifndef SHADING_H
+#define SHADING_H
+
+#include "hittable.h"
+
+/* The scene's lighting: one point light with Phong (Blinn-Phong
+*	diffuse) shading, hard shadows and a sky gradient behind everything.
+*/
+
+extern vec3 ka;				// ambient material
+extern vec3 la;				// ambient color
+extern vec3 lightPos;
+extern double shadow_epsilon;	// shadow ray offset off the surface
+
+vec3 clamp(vec3 color);
+vec3 phong(vec3 hitpoint, vec3 n, vec3 kd, vec3 ld);
+ray shadow_ray(const vec3& hitpoint, double& light_distance);
+vec3 sky(const ray& r);
+vec3 shade(const ray& r, bool hit, const hit_record& rec, const hittable& world, bool* shadowed = 0);
+vec3 raycast(ray r, const hittable& world);
+
+#endif
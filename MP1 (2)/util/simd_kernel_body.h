@@ -0,0 +1,168 @@
+/* Vector kernel bodies. This file has no include guard: simd_kernels.cpp
+*	includes it once per instruction set and precision after defining
+*	KERNEL_SUFFIX, the scalar type SCALAR, WIDTH, the vector type VD, the
+*	mask type VM and the V... and M... operation macros for that
+*	instruction set, inside a #pragma GCC target region. Those macros are
+*	undefined again at the end of this file.
+*	The arithmetic mirrors the scalar kernels operation by operation.
+*/
+
+#define KERNEL_CAT2(a,b) a##_##b
+#define KERNEL_CAT(a,b) KERNEL_CAT2(a,b)
+
+/* Vector version of scalar_spheres.
+*/
+static int KERNEL_CAT(spheres, KERNEL_SUFFIX)(const sphere_arrays_t<SCALAR>& s, const SCALAR* o, const SCALAR* d,
+	SCALAR t_min, SCALAR& t_max, bool any_hit) {
+	const SCALAR a = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+	const VD ox = VSET1(o[0]), oy = VSET1(o[1]), oz = VSET1(o[2]);
+	const VD dx = VSET1(d[0]), dy = VSET1(d[1]), dz = VSET1(d[2]);
+	const VD va = VSET1(a);
+	const VD vt_min = VSET1(t_min);
+	const VD zero = VSET1(SCALAR(0));
+
+	int best = -1;
+	int n = s.count;
+	int simd_end = n - n % WIDTH;
+	for (int i = 0; i < simd_end; i += WIDTH) {
+		VD ocx = VSUB(ox, VLOAD(s.cx + i));
+		VD ocy = VSUB(oy, VLOAD(s.cy + i));
+		VD ocz = VSUB(oz, VLOAD(s.cz + i));
+		VD h = VADD(VADD(VMUL(ocx,dx), VMUL(ocy,dy)), VMUL(ocz,dz));
+		VD k = VDIV(h, va);
+		VD n1x = VSUB(ocx, VMUL(k,dx));
+		VD n1y = VSUB(ocy, VMUL(k,dy));
+		VD n1z = VSUB(ocz, VMUL(k,dz));
+		VD nn = VADD(VADD(VMUL(n1x,n1x), VMUL(n1y,n1y)), VMUL(n1z,n1z));
+		VD discriminant = VMUL(va, VSUB(VLOAD(s.r2 + i), nn));
+		VM real = VCMP_GE(discriminant, zero);
+		if (MBITS(real) == 0) continue;
+
+		// a zero discriminant gives sq = 0 and both roots equal -h/a,
+		// the same value the scalar single-root branch computes.
+		VD sq = VSQRT(VMAX(discriminant, zero));
+		VD neg_h = VNEG(h);
+		VD r1 = VDIV(VSUB(neg_h, sq), va);
+		VD r2 = VDIV(VADD(neg_h, sq), va);
+		VD vt_max = VSET1(t_max);
+		VM in1 = MAND(VCMP_GE(r1, vt_min), VCMP_LE(r1, vt_max));
+		VM in2 = MAND(VCMP_GE(r2, vt_min), VCMP_LE(r2, vt_max));
+		int bits = MBITS(MAND(real, MOR(in1, in2)));
+		if (bits == 0) continue;
+
+		SCALAR roots[WIDTH];
+		VSTORE(roots, VBLEND(in1, r2, r1));
+		// lanes in order so ties resolve like the scalar loop
+		for (int l = 0; l < WIDTH; l++) {
+			if ((bits & (1 << l)) && roots[l] <= t_max) {
+				t_max = roots[l];
+				best = i + l;
+				if (any_hit) return best;
+			}
+		}
+	}
+
+	if (simd_end < n) {
+		sphere_arrays_t<SCALAR> rest = { s.cx + simd_end, s.cy + simd_end, s.cz + simd_end, s.r2 + simd_end, n - simd_end };
+		int tail = scalar_spheres(rest, o, d, t_min, t_max, any_hit);
+		if (tail >= 0) best = simd_end + tail;
+	}
+	return best;
+}
+
+/* Vector version of scalar_triangles.
+*/
+static int KERNEL_CAT(triangles, KERNEL_SUFFIX)(const triangle_arrays_t<SCALAR>& tri, const SCALAR* o, const SCALAR* d,
+	SCALAR t_min, SCALAR& t_max, bool any_hit) {
+	const VD ox = VSET1(o[0]), oy = VSET1(o[1]), oz = VSET1(o[2]);
+	const VD dx = VSET1(d[0]), dy = VSET1(d[1]), dz = VSET1(d[2]);
+	const VD vt_min = VSET1(t_min);
+	const VD zero = VSET1(SCALAR(0));
+	const VD one = VSET1(SCALAR(1));
+	const VD eps = VSET1(SCALAR(triangle_epsilon));
+	const VD neg_eps = VSET1(-SCALAR(triangle_epsilon));
+
+	int best = -1;
+	int n = tri.count;
+	int simd_end = n - n % WIDTH;
+	for (int i = 0; i < simd_end; i += WIDTH) {
+		VD e1x = VLOAD(tri.e1x + i), e1y = VLOAD(tri.e1y + i), e1z = VLOAD(tri.e1z + i);
+		VD e2x = VLOAD(tri.e2x + i), e2y = VLOAD(tri.e2y + i), e2z = VLOAD(tri.e2z + i);
+
+		VD hx = VSUB(VMUL(dy,e2z), VMUL(dz,e2y));
+		VD hy = VSUB(VMUL(dz,e2x), VMUL(dx,e2z));
+		VD hz = VSUB(VMUL(dx,e2y), VMUL(dy,e2x));
+		VD a = VADD(VADD(VMUL(e1x,hx), VMUL(e1y,hy)), VMUL(e1z,hz));
+		VM parallel = MAND(VCMP_GT(a, neg_eps), VCMP_LT(a, eps));
+
+		VD f = VDIV(one, a);
+		VD sx = VSUB(ox, VLOAD(tri.v0x + i));
+		VD sy = VSUB(oy, VLOAD(tri.v0y + i));
+		VD sz = VSUB(oz, VLOAD(tri.v0z + i));
+		VD u = VMUL(f, VADD(VADD(VMUL(sx,hx), VMUL(sy,hy)), VMUL(sz,hz)));
+		VM ok = MANDNOT(parallel, MAND(VCMP_GE(u, zero), VCMP_LE(u, one)));
+		if (MBITS(ok) == 0) continue;
+
+		VD qx = VSUB(VMUL(sy,e1z), VMUL(sz,e1y));
+		VD qy = VSUB(VMUL(sz,e1x), VMUL(sx,e1z));
+		VD qz = VSUB(VMUL(sx,e1y), VMUL(sy,e1x));
+		VD v = VMUL(f, VADD(VADD(VMUL(dx,qx), VMUL(dy,qy)), VMUL(dz,qz)));
+		ok = MAND(ok, MAND(VCMP_GE(v, zero), VCMP_LE(VADD(u, v), one)));
+
+		VD t = VMUL(f, VADD(VADD(VMUL(e2x,qx), VMUL(e2y,qy)), VMUL(e2z,qz)));
+		VD vt_max = VSET1(t_max);
+		ok = MAND(ok, MAND(VCMP_GE(t, zero), VCMP_GE(t, vt_min)));
+		ok = MAND(ok, MAND(VCMP_LE(t, vt_max), VCMP_GT(t, eps)));
+		int bits = MBITS(ok);
+		if (bits == 0) continue;
+
+		SCALAR ts[WIDTH];
+		VSTORE(ts, t);
+		for (int l = 0; l < WIDTH; l++) {
+			if ((bits & (1 << l)) && ts[l] <= t_max) {
+				t_max = ts[l];
+				best = i + l;
+				if (any_hit) return best;
+			}
+		}
+	}
+
+	if (simd_end < n) {
+		triangle_arrays_t<SCALAR> rest = {
+			tri.v0x + simd_end, tri.v0y + simd_end, tri.v0z + simd_end,
+			tri.e1x + simd_end, tri.e1y + simd_end, tri.e1z + simd_end,
+			tri.e2x + simd_end, tri.e2y + simd_end, tri.e2z + simd_end,
+			n - simd_end };
+		int tail = scalar_triangles(rest, o, d, t_min, t_max, any_hit);
+		if (tail >= 0) best = simd_end + tail;
+	}
+	return best;
+}
+
+#undef KERNEL_CAT
+#undef KERNEL_CAT2
+
+#undef KERNEL_SUFFIX
+#undef SCALAR
+#undef WIDTH
+#undef VD
+#undef VM
+#undef VSET1
+#undef VLOAD
+#undef VSTORE
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMAX
+#undef VNEG
+#undef VCMP_GE
+#undef VCMP_LE
+#undef VCMP_GT
+#undef VCMP_LT
+#undef VBLEND
+#undef MAND
+#undef MOR
+#undef MANDNOT
+#undef MBITS
@@ -0,0 +1,413 @@
+#include "simd_kernels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <immintrin.h>
+
+namespace {
+	const double triangle_epsilon = 1e-5;	// same as triangle::solve
+}
+
+/* Tests the ray against every sphere. Same arithmetic as sphere::solve.
+*	@s: the sphere arrays
+*	@o: ray origin
+*	@d: ray direction
+*	@t_min: min value of t
+*	@t_max: max value of t, lowered to every hit found
+*	@any_hit: stop at the first hit
+*	returns the index of the closest sphere hit, -1 if none.
+*/
+template<class T>
+static int scalar_spheres(const sphere_arrays_t<T>& s, const T* o, const T* d,
+	T t_min, T& t_max, bool any_hit) {
+	const T ox = o[0], oy = o[1], oz = o[2];
+	const T dx = d[0], dy = d[1], dz = d[2];
+	const T a = dx*dx + dy*dy + dz*dz;
+
+	int best = -1;
+	for (int i = 0; i < s.count; i++) {
+		T ocx = ox - s.cx[i];
+		T ocy = oy - s.cy[i];
+		T ocz = oz - s.cz[i];
+		T h = ocx*dx + ocy*dy + ocz*dz;
+		T k = h/a;
+		T n1x = ocx - k*dx;
+		T n1y = ocy - k*dy;
+		T n1z = ocz - k*dz;
+		T discriminant = a * (s.r2[i] - (n1x*n1x + n1y*n1y + n1z*n1z));
+		if (discriminant < 0) continue;
+
+		T root;
+		if (discriminant == 0) {
+			root = -h / a;
+			if (root < t_min || t_max < root) continue;
+		} else {
+			T sq = sqrt(discriminant);
+			root = (-h - sq)/a;
+			if (root < t_min || t_max < root) {
+				root = (-h + sq)/a;
+				if (root < t_min || t_max < root) continue;
+			}
+		}
+		t_max = root;
+		best = i;
+		if (any_hit) break;
+	}
+	return best;
+}
+
+/* Tests the ray against every triangle. Same arithmetic as
+*	triangle::solve.
+*	@tri: the triangle arrays
+*	@o: ray origin
+*	@d: ray direction
+*	@t_min: min value of t
+*	@t_max: max value of t, lowered to every hit found
+*	@any_hit: stop at the first hit
+*	returns the index of the closest triangle hit, -1 if none.
+*/
+template<class T>
+static int scalar_triangles(const triangle_arrays_t<T>& tri, const T* o, const T* d,
+	T t_min, T& t_max, bool any_hit) {
+	const T epsilon = T(triangle_epsilon);
+	const T ox = o[0], oy = o[1], oz = o[2];
+	const T dx = d[0], dy = d[1], dz = d[2];
+
+	int best = -1;
+	for (int i = 0; i < tri.count; i++) {
+		T e1x = tri.e1x[i], e1y = tri.e1y[i], e1z = tri.e1z[i];
+		T e2x = tri.e2x[i], e2y = tri.e2y[i], e2z = tri.e2z[i];
+
+		// h = d x e2
+		T hx = dy*e2z - dz*e2y;
+		T hy = dz*e2x - dx*e2z;
+		T hz = dx*e2y - dy*e2x;
+		T a = e1x*hx + e1y*hy + e1z*hz;
+		if (a > -epsilon && a < epsilon) continue;	// parallel
+
+		T f = 1.0/a;
+		T sx = ox - tri.v0x[i];
+		T sy = oy - tri.v0y[i];
+		T sz = oz - tri.v0z[i];
+		T u = f * (sx*hx + sy*hy + sz*hz);
+		if (u < 0 || u > 1) continue;
+
+		// q = s x e1
+		T qx = sy*e1z - sz*e1y;
+		T qy = sz*e1x - sx*e1z;
+		T qz = sx*e1y - sy*e1x;
+		T v = f * (dx*qx + dy*qy + dz*qz);
+		if (v < 0 || u + v > 1) continue;
+
+		T t = f * (e2x*qx + e2y*qy + e2z*qz);
+		if (t < 0 || t < t_min || t_max < t) continue;
+		if (t > epsilon) {
+			t_max = t;
+			best = i;
+			if (any_hit) break;
+		}
+	}
+	return best;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS 1
+
+// FMA contraction would change the rounding compared to the scalar code
+#pragma GCC push_options
+#pragma GCC optimize ("fp-contract=off")
+
+// SSE4.2: 2 doubles or 4 floats per vector
+#pragma GCC push_options
+#pragma GCC target ("sse4.2")
+#define KERNEL_SUFFIX sse42
+#define SCALAR double
+#define WIDTH 2
+#define VD __m128d
+#define VM __m128d
+#define VSET1(x) _mm_set1_pd(x)
+#define VLOAD(p) _mm_loadu_pd(p)
+#define VSTORE(p,v) _mm_storeu_pd(p,v)
+#define VADD(a,b) _mm_add_pd(a,b)
+#define VSUB(a,b) _mm_sub_pd(a,b)
+#define VMUL(a,b) _mm_mul_pd(a,b)
+#define VDIV(a,b) _mm_div_pd(a,b)
+#define VSQRT(a) _mm_sqrt_pd(a)
+#define VMAX(a,b) _mm_max_pd(a,b)
+#define VNEG(a) _mm_xor_pd(a, _mm_set1_pd(-0.0))
+#define VCMP_GE(a,b) _mm_cmpge_pd(a,b)
+#define VCMP_LE(a,b) _mm_cmple_pd(a,b)
+#define VCMP_GT(a,b) _mm_cmpgt_pd(a,b)
+#define VCMP_LT(a,b) _mm_cmplt_pd(a,b)
+#define VBLEND(m,a,b) _mm_blendv_pd(a,b,m)
+#define MAND(a,b) _mm_and_pd(a,b)
+#define MOR(a,b) _mm_or_pd(a,b)
+#define MANDNOT(a,b) _mm_andnot_pd(a,b)
+#define MBITS(m) _mm_movemask_pd(m)
+#include "simd_kernel_body.h"
+
+#define KERNEL_SUFFIX sse42f
+#define SCALAR float
+#define WIDTH 4
+#define VD __m128
+#define VM __m128
+#define VSET1(x) _mm_set1_ps(x)
+#define VLOAD(p) _mm_loadu_ps(p)
+#define VSTORE(p,v) _mm_storeu_ps(p,v)
+#define VADD(a,b) _mm_add_ps(a,b)
+#define VSUB(a,b) _mm_sub_ps(a,b)
+#define VMUL(a,b) _mm_mul_ps(a,b)
+#define VDIV(a,b) _mm_div_ps(a,b)
+#define VSQRT(a) _mm_sqrt_ps(a)
+#define VMAX(a,b) _mm_max_ps(a,b)
+#define VNEG(a) _mm_xor_ps(a, _mm_set1_ps(-0.0f))
+#define VCMP_GE(a,b) _mm_cmpge_ps(a,b)
+#define VCMP_LE(a,b) _mm_cmple_ps(a,b)
+#define VCMP_GT(a,b) _mm_cmpgt_ps(a,b)
+#define VCMP_LT(a,b) _mm_cmplt_ps(a,b)
+#define VBLEND(m,a,b) _mm_blendv_ps(a,b,m)
+#define MAND(a,b) _mm_and_ps(a,b)
+#define MOR(a,b) _mm_or_ps(a,b)
+#define MANDNOT(a,b) _mm_andnot_ps(a,b)
+#define MBITS(m) _mm_movemask_ps(m)
+#include "simd_kernel_body.h"
+#pragma GCC pop_options
+
+// AVX2: 4 doubles or 8 floats per vector
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+#define KERNEL_SUFFIX avx2
+#define SCALAR double
+#define WIDTH 4
+#define VD __m256d
+#define VM __m256d
+#define VSET1(x) _mm256_set1_pd(x)
+#define VLOAD(p) _mm256_loadu_pd(p)
+#define VSTORE(p,v) _mm256_storeu_pd(p,v)
+#define VADD(a,b) _mm256_add_pd(a,b)
+#define VSUB(a,b) _mm256_sub_pd(a,b)
+#define VMUL(a,b) _mm256_mul_pd(a,b)
+#define VDIV(a,b) _mm256_div_pd(a,b)
+#define VSQRT(a) _mm256_sqrt_pd(a)
+#define VMAX(a,b) _mm256_max_pd(a,b)
+#define VNEG(a) _mm256_xor_pd(a, _mm256_set1_pd(-0.0))
+#define VCMP_GE(a,b) _mm256_cmp_pd(a,b,_CMP_GE_OQ)
+#define VCMP_LE(a,b) _mm256_cmp_pd(a,b,_CMP_LE_OQ)
+#define VCMP_GT(a,b) _mm256_cmp_pd(a,b,_CMP_GT_OQ)
+#define VCMP_LT(a,b) _mm256_cmp_pd(a,b,_CMP_LT_OQ)
+#define VBLEND(m,a,b) _mm256_blendv_pd(a,b,m)
+#define MAND(a,b) _mm256_and_pd(a,b)
+#define MOR(a,b) _mm256_or_pd(a,b)
+#define MANDNOT(a,b) _mm256_andnot_pd(a,b)
+#define MBITS(m) _mm256_movemask_pd(m)
+#include "simd_kernel_body.h"
+
+#define KERNEL_SUFFIX avx2f
+#define SCALAR float
+#define WIDTH 8
+#define VD __m256
+#define VM __m256
+#define VSET1(x) _mm256_set1_ps(x)
+#define VLOAD(p) _mm256_loadu_ps(p)
+#define VSTORE(p,v) _mm256_storeu_ps(p,v)
+#define VADD(a,b) _mm256_add_ps(a,b)
+#define VSUB(a,b) _mm256_sub_ps(a,b)
+#define VMUL(a,b) _mm256_mul_ps(a,b)
+#define VDIV(a,b) _mm256_div_ps(a,b)
+#define VSQRT(a) _mm256_sqrt_ps(a)
+#define VMAX(a,b) _mm256_max_ps(a,b)
+#define VNEG(a) _mm256_xor_ps(a, _mm256_set1_ps(-0.0f))
+#define VCMP_GE(a,b) _mm256_cmp_ps(a,b,_CMP_GE_OQ)
+#define VCMP_LE(a,b) _mm256_cmp_ps(a,b,_CMP_LE_OQ)
+#define VCMP_GT(a,b) _mm256_cmp_ps(a,b,_CMP_GT_OQ)
+#define VCMP_LT(a,b) _mm256_cmp_ps(a,b,_CMP_LT_OQ)
+#define VBLEND(m,a,b) _mm256_blendv_ps(a,b,m)
+#define MAND(a,b) _mm256_and_ps(a,b)
+#define MOR(a,b) _mm256_or_ps(a,b)
+#define MANDNOT(a,b) _mm256_andnot_ps(a,b)
+#define MBITS(m) _mm256_movemask_ps(m)
+#include "simd_kernel_body.h"
+#pragma GCC pop_options
+
+// AVX-512: 8 doubles or 16 floats per vector, comparisons produce bit masks
+#pragma GCC push_options
+#pragma GCC target ("avx512f")
+// GCC 12's avx512fintrin.h trips this on its own undefined-vector operands
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#define KERNEL_SUFFIX avx512
+#define SCALAR double
+#define WIDTH 8
+#define VD __m512d
+#define VM __mmask8
+#define VSET1(x) _mm512_set1_pd(x)
+#define VLOAD(p) _mm512_loadu_pd(p)
+#define VSTORE(p,v) _mm512_storeu_pd(p,v)
+#define VADD(a,b) _mm512_add_pd(a,b)
+#define VSUB(a,b) _mm512_sub_pd(a,b)
+#define VMUL(a,b) _mm512_mul_pd(a,b)
+#define VDIV(a,b) _mm512_div_pd(a,b)
+#define VSQRT(a) _mm512_sqrt_pd(a)
+#define VMAX(a,b) _mm512_max_pd(a,b)
+#define VNEG(a) _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi64((long long)0x8000000000000000ULL)))
+#define VCMP_GE(a,b) _mm512_cmp_pd_mask(a,b,_CMP_GE_OQ)
+#define VCMP_LE(a,b) _mm512_cmp_pd_mask(a,b,_CMP_LE_OQ)
+#define VCMP_GT(a,b) _mm512_cmp_pd_mask(a,b,_CMP_GT_OQ)
+#define VCMP_LT(a,b) _mm512_cmp_pd_mask(a,b,_CMP_LT_OQ)
+#define VBLEND(m,a,b) _mm512_mask_blend_pd(m,a,b)
+#define MAND(a,b) ((__mmask8)((a) & (b)))
+#define MOR(a,b) ((__mmask8)((a) | (b)))
+#define MANDNOT(a,b) ((__mmask8)(~(a) & (b)))
+#define MBITS(m) (int)(m)
+#include "simd_kernel_body.h"
+
+#define KERNEL_SUFFIX avx512f
+#define SCALAR float
+#define WIDTH 16
+#define VD __m512
+#define VM __mmask16
+#define VSET1(x) _mm512_set1_ps(x)
+#define VLOAD(p) _mm512_loadu_ps(p)
+#define VSTORE(p,v) _mm512_storeu_ps(p,v)
+#define VADD(a,b) _mm512_add_ps(a,b)
+#define VSUB(a,b) _mm512_sub_ps(a,b)
+#define VMUL(a,b) _mm512_mul_ps(a,b)
+#define VDIV(a,b) _mm512_div_ps(a,b)
+#define VSQRT(a) _mm512_sqrt_ps(a)
+#define VMAX(a,b) _mm512_max_ps(a,b)
+#define VNEG(a) _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32((int)0x80000000U)))
+#define VCMP_GE(a,b) _mm512_cmp_ps_mask(a,b,_CMP_GE_OQ)
+#define VCMP_LE(a,b) _mm512_cmp_ps_mask(a,b,_CMP_LE_OQ)
+#define VCMP_GT(a,b) _mm512_cmp_ps_mask(a,b,_CMP_GT_OQ)
+#define VCMP_LT(a,b) _mm512_cmp_ps_mask(a,b,_CMP_LT_OQ)
+#define VBLEND(m,a,b) _mm512_mask_blend_ps(m,a,b)
+#define MAND(a,b) ((__mmask16)((a) & (b)))
+#define MOR(a,b) ((__mmask16)((a) | (b)))
+#define MANDNOT(a,b) ((__mmask16)(~(a) & (b)))
+#define MBITS(m) (int)(m)
+#include "simd_kernel_body.h"
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+#pragma GCC pop_options
+#endif
+
+namespace {
+	const simd_kernels scalar_set = { "scalar", 1, scalar_spheres<double>, scalar_triangles<double> };
+	const simd_kernels_f scalar_set_f = { "scalar", 1, scalar_spheres<float>, scalar_triangles<float> };
+#ifdef HAVE_X86_KERNELS
+	const simd_kernels sse42_set = { "sse4.2", 2, spheres_sse42, triangles_sse42 };
+	const simd_kernels avx2_set = { "avx2", 4, spheres_avx2, triangles_avx2 };
+	const simd_kernels avx512_set = { "avx512", 8, spheres_avx512, triangles_avx512 };
+	const simd_kernels_f sse42_set_f = { "sse4.2", 4, spheres_sse42f, triangles_sse42f };
+	const simd_kernels_f avx2_set_f = { "avx2", 8, spheres_avx2f, triangles_avx2f };
+	const simd_kernels_f avx512_set_f = { "avx512", 16, spheres_avx512f, triangles_avx512f };
+#endif
+
+	/* Picks the widest kernels of a precision the CPU supports.
+	*	@scalar, sse42, avx2, avx512: the kernel sets of that precision
+	*/
+	template<class T>
+	const simd_kernels_t<T>* detect_kernels(const simd_kernels_t<T>* scalar, const simd_kernels_t<T>* sse42,
+		const simd_kernels_t<T>* avx2, const simd_kernels_t<T>* avx512) {
+#ifdef HAVE_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return avx512;
+		if (__builtin_cpu_supports("avx2")) return avx2;
+		if (__builtin_cpu_supports("sse4.2")) return sse42;
+#endif
+		return scalar;
+	}
+
+	/* Looks up kernels of a precision by instruction set name.
+	*	@isa: "auto", "scalar", "sse4.2", "avx2" or "avx512"
+	*	@scalar, sse42, avx2, avx512: the kernel sets of that precision
+	*	returns the kernels, or null if the name is unknown or the CPU
+	*	can't run them.
+	*/
+	template<class T>
+	const simd_kernels_t<T>* lookup_kernels(const std::string& isa, const simd_kernels_t<T>* scalar,
+		const simd_kernels_t<T>* sse42, const simd_kernels_t<T>* avx2, const simd_kernels_t<T>* avx512) {
+		if (isa == "auto") return detect_kernels(scalar, sse42, avx2, avx512);
+		if (isa == "scalar") return scalar;
+#ifdef HAVE_X86_KERNELS
+		__builtin_cpu_init();
+		if (isa == "sse4.2" && __builtin_cpu_supports("sse4.2")) return sse42;
+		if (isa == "avx2" && __builtin_cpu_supports("avx2")) return avx2;
+		if (isa == "avx512" && __builtin_cpu_supports("avx512f")) return avx512;
+#endif
+		return 0;
+	}
+
+#ifdef HAVE_X86_KERNELS
+	const simd_kernels* find_double(const std::string& isa) {
+		return lookup_kernels(isa, &scalar_set, &sse42_set, &avx2_set, &avx512_set);
+	}
+	const simd_kernels_f* find_float(const std::string& isa) {
+		return lookup_kernels(isa, &scalar_set_f, &sse42_set_f, &avx2_set_f, &avx512_set_f);
+	}
+#else
+	const simd_kernels* find_double(const std::string& isa) {
+		return lookup_kernels(isa, &scalar_set, &scalar_set, &scalar_set, &scalar_set);
+	}
+	const simd_kernels_f* find_float(const std::string& isa) {
+		return lookup_kernels(isa, &scalar_set_f, &scalar_set_f, &scalar_set_f, &scalar_set_f);
+	}
+#endif
+
+	const simd_kernels* active = find_double("auto");
+	const simd_kernels_f* active_f = find_float("auto");
+}
+
+/* Returns the portable scalar kernels.
+*/
+const simd_kernels& scalar_kernels() {
+	return scalar_set;
+}
+
+/* Looks up kernels by instruction set name.
+*	@isa: "auto", "scalar", "sse4.2", "avx2" or "avx512"
+*	@out: receives the kernels
+*	returns false if the name is unknown or the CPU can't run them.
+*/
+bool find_kernels(const std::string& isa, simd_kernels& out) {
+	const simd_kernels* k = find_double(isa);
+	if (!k) return false;
+	out = *k;
+	return true;
+}
+
+bool find_kernels(const std::string& isa, simd_kernels_f& out) {
+	const simd_kernels_f* k = find_float(isa);
+	if (!k) return false;
+	out = *k;
+	return true;
+}
+
+/* Returns the kernels used by the primitive pools, chosen at startup
+*	from the CPU features.
+*/
+template<>
+const simd_kernels& active_kernels<double>() {
+	return *active;
+}
+
+template<>
+const simd_kernels_f& active_kernels<float>() {
+	return *active_f;
+}
+
+/* Overrides the startup choice. Call before rendering starts.
+*	@k: the kernels to use
+*/
+void set_active_kernels(const simd_kernels& k) {
+	static simd_kernels chosen;
+	chosen = k;
+	active = &chosen;
+}
+
+void set_active_kernels(const simd_kernels_f& k) {
+	static simd_kernels_f chosen;
+	chosen = k;
+	active_f = &chosen;
+}
@@ -0,0 +1,74 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <string>
+
+/* Read-only views of the primitive pools handed to the kernels, in the
+*	pool's precision.
+*/
+template<class T>
+struct sphere_arrays_t {
+	const T* cx;
+	const T* cy;
+	const T* cz;
+	const T* r2;
+	int count;
+};
+
+template<class T>
+struct triangle_arrays_t {
+	const T* v0x;
+	const T* v0y;
+	const T* v0z;
+	const T* e1x;
+	const T* e1y;
+	const T* e1z;
+	const T* e2x;
+	const T* e2y;
+	const T* e2z;
+	int count;
+};
+
+typedef sphere_arrays_t<double> sphere_arrays;
+typedef triangle_arrays_t<double> triangle_arrays;
+
+/* One set of kernels for an instruction set and a precision. A kernel
+*	tests one ray (origin o, direction d) against every primitive in the
+*	arrays. t_max is lowered to each hit found and the index of the
+*	closest primitive is returned, -1 if nothing was hit. With any_hit set
+*	the kernel returns the first hit it finds.
+*	A vector holds twice as many floats as doubles: SSE4.2 tests 2
+*	doubles or 4 floats at once, AVX2 4 or 8 and AVX-512 8 or 16.
+*	The vector kernels do the same IEEE operations in the same order as
+*	the scalar kernels of their precision (no fused multiply-add), so t
+*	and the chosen primitive match the scalar path bit for bit for finite
+*	inputs.
+*/
+template<class T>
+struct simd_kernels_t {
+	typedef int (*sphere_kernel)(const sphere_arrays_t<T>& s, const T* o, const T* d,
+		T t_min, T& t_max, bool any_hit);
+	typedef int (*triangle_kernel)(const triangle_arrays_t<T>& tri, const T* o, const T* d,
+		T t_min, T& t_max, bool any_hit);
+
+	const char* isa;
+	int width;
+	sphere_kernel spheres;
+	triangle_kernel triangles;
+};
+
+typedef simd_kernels_t<double> simd_kernels;
+typedef simd_kernels_t<float> simd_kernels_f;
+typedef simd_kernels::sphere_kernel sphere_kernel;
+typedef simd_kernels::triangle_kernel triangle_kernel;
+
+const simd_kernels& scalar_kernels();
+bool find_kernels(const std::string& isa, simd_kernels& out);
+bool find_kernels(const std::string& isa, simd_kernels_f& out);
+void set_active_kernels(const simd_kernels& k);
+void set_active_kernels(const simd_kernels_f& k);
+
+// kernels used by the pools of precision T, double or float
+template<class T> const simd_kernels_t<T>& active_kernels();
+
+#endif
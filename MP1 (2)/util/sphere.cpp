@@ -1,50 +1,125 @@
 #include "sphere.h"
+#include "render_stats.h"
 
-/* Determines if a ray hits a point
+/* Finds the nearest intersection of a ray with the sphere
 *	@r: Ray to cast
 *	@t_min: min value of t
 *	@t_max: max value of t
-*	@rec: The hit record to store the info
+*	@root: receives the t of the intersection
 *	returns true if the ray intersects the spheres, and false otherwise.
 */
-bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-	double root = -1000000000000;
-    vec3 oc = r.origin() - center;
-	double a = dot(r.direction(),r.direction());
-	double b = 2* dot(oc, r.direction());
-	double c = dot(oc,oc) - radius*radius;
-
-	vec3 d = r.direction();
-	double m = 4 * dot(d,d); // 4d^2
-	vec3 n1 = oc - (dot(oc,d) * d);
-	double n2 = dot(n1,n1);
-	double discriminant = m * (radius*radius - n2); 
-	//double discriminant = (b*b) - (4*a*c);	// can lead to loss of accuracy
+template<class T>
+bool sphere_t<T>::solve(const ray_t<T>& r, T t_min, T t_max, T& root) const {
+	return intersect(cen, rad2, r, t_min, t_max, root);
+}
+
+/* The intersection test of solve() on baked sphere data, for code that
+*	keeps spheres in its own arrays.
+*	@center: the center
+*	@radius2: the radius squared
+*	@r, t_min, t_max, root: as for solve()
+*/
+template<class T>
+bool sphere_t<T>::intersect(const vec3_t<T>& center, T radius2, const ray_t<T>& r, T t_min, T t_max, T& root) {
+	COUNT_STAT(tests[render_counters::sphere_tests], 1);
+	// a*t^2 + 2*h*t + c = 0 with the quarter discriminant h^2 - a*c
+	// rewritten as a*(r^2 - |oc - (h/a)d|^2), which doesn't cancel
+	// when oc is large compared to the radius.
+	vec3_t<T> d = r.direction();
+    vec3_t<T> oc = r.origin() - center;
+	T a = dot(d,d);
+	T h = dot(oc,d);
+	vec3_t<T> n1 = oc - ((h/a) * d);
+	T discriminant = a * (radius2 - dot(n1,n1));
 
 	if (discriminant < 0) {
 		return false;
 	} else if (discriminant == 0) {
 		// one unique solution
-		root = -b / (2*a);
+		root = -h / a;
 		if (root < t_min || t_max < root)
             return false;
 	} else {
 		// two unique solutions
-		root = (-b - sqrt(discriminant))/(2*a);
+		T sq = sqrt(discriminant);
+		root = (-h - sq)/a;
 	
 		if (root < t_min || t_max < root) {
-			root = (-b + sqrt(discriminant))/(2*a);
+			root = (-h + sq)/a;
 			if (root < t_min || t_max < root) {
 				return false;
 			}
 		}
 	}
 
+	return true;
+}
+
+/* Determines if a ray hits a point
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: The hit record to store the info
+*	returns true if the ray intersects the spheres, and false otherwise.
+*/
+template<class T>
+bool sphere_t<T>::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	T root;
+	if (!solve(ray_t<T>(r), T(t_min), T(t_max), root)) return false;
+	// the limits may have rounded outwards on their way to T
+	if (root < t_min || t_max < root) return false;
+
 	//std::cout << "root = " << root << std::endl;
     rec.t = root;
-    rec.p = r.at(rec.t);
-    rec.n = (rec.p - center) / radius;
-	rec.kd = kd;
-	rec.ld = ld;
+	rec.object = this;
+	rec.prim = 0;
     return true;
 }
+
+/* Fills in the hit point, normal and material of a hit on the sphere
+*	@r: the ray that hit
+*	@rec: a record filled in by hit()
+*/
+template<class T>
+void sphere_t<T>::resolve(const ray& r, hit_record& rec) const {
+    rec.p = r.at(rec.t);
+    rec.n = double(inv_rad) * (rec.p - vec3(cen));
+	rec.kd = vec3(kd);
+	rec.ld = vec3(ld);
+}
+
+/* Determines if a ray hits the sphere anywhere in [t_min,t_max]
+*	without filling in a hit record.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	returns true if the ray intersects the sphere.
+*/
+template<class T>
+bool sphere_t<T>::occluded(const ray& r, double t_min, double t_max) const {
+	T root;
+	return solve(ray_t<T>(r), T(t_min), T(t_max), root) && t_min <= root && root <= t_max;
+}
+
+/* Bakes r^2 and 1/r.
+*/
+template<class T>
+void sphere_t<T>::compile() {
+	rad2 = rad*rad;
+	inv_rad = T(1.0)/rad;
+}
+
+/* Computes the bounding box of the sphere
+*	@output_box: receives the box
+*	returns true
+*/
+template<class T>
+bool sphere_t<T>::bounding_box(aabb& output_box) const {
+	vec3 c = vec3(cen);
+	vec3 r = vec3(rad, rad, rad);
+	output_box = aabb(c - r, c + r);
+	return true;
+}
+
+template class sphere_t<double>;
+template class sphere_t<float>;
@@ -4,18 +4,51 @@
 #include "hittable.h"
 #include "vec3.h"
 
-class sphere : public hittable {
+/* Sphere stored and intersected in precision T. Hits are reported
+*	through the double precision hittable interface. The geometry is
+*	private so it can't change without the baked data following it.
+*/
+template<class T>
+class sphere_t : public hittable {
     public:
-        sphere() : kd(vec3(0,0,0)), ld(vec3(0,0,0)) {}
-        sphere(vec3 cen, double r, vec3 kdu, vec3 ldu) : center(cen), radius(r), kd(kdu), ld(ldu) {};
+        sphere_t() : kd(vec3_t<T>(0,0,0)), ld(vec3_t<T>(0,0,0)), cen(vec3_t<T>(0,0,0)), rad(0) { compile(); }
+        sphere_t(vec3_t<T> cen, T r, vec3_t<T> kdu, vec3_t<T> ldu) : kd(kdu), ld(ldu), cen(cen), rad(r) { compile(); };
 
         virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual void resolve(const ray& r, hit_record& rec) const override;
+        virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void compile() override;
+
+        vec3_t<T> center() const { return cen; }
+        T radius() const { return rad; }
+        T radius2() const { return rad2; }
+        T inv_radius() const { return inv_rad; }
+
+        // change the geometry and bake it again
+        void set_center(const vec3_t<T>& c) { cen = c; }
+        void set_radius(T r) { rad = r; compile(); }
+
+    private:
+        bool solve(const ray_t<T>& r, T t_min, T t_max, T& root) const;
+
+    public:
+        static bool intersect(const vec3_t<T>& center, T radius2, const ray_t<T>& r, T t_min, T t_max, T& root);
 
     public:
-        vec3 center;
-        double radius;
-		vec3 kd;
-		vec3 ld;
+		vec3_t<T> kd;
+		vec3_t<T> ld;
+
+    private:
+        vec3_t<T> cen;
+        T rad;
+
+        // baked by compile()
+        T rad2;
+        T inv_rad;
 };
 
+typedef sphere_t<double> sphere;
+typedef sphere_t<float> spheref;
+
 #endif
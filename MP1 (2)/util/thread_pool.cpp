@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+
+/* Constructor
+*	@num_threads: number of workers. Values < 1 use the hardware
+*	concurrency.
+*/
+thread_pool::thread_pool(int num_threads) : next_queue(0), pending(0), stopping(false) {
+	if (num_threads < 1) num_threads = hardware_threads();
+	for (int i = 0; i < num_threads; i++) {
+		queues.push_back(new task_queue());
+	}
+	for (int i = 0; i < num_threads; i++) {
+		workers.push_back(std::thread(&thread_pool::run, this, i));
+	}
+}
+
+/* Destructor. Waits for outstanding work then joins the workers.
+*/
+thread_pool::~thread_pool() {
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(state_lock);
+		stopping = true;
+	}
+	work_ready.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	for (size_t i = 0; i < queues.size(); i++) {
+		delete queues[i];
+	}
+}
+
+/* Returns the number of hardware threads, at least 1.
+*/
+int thread_pool::hardware_threads() {
+	int n = int(std::thread::hardware_concurrency());
+	return (n < 1) ? 1 : n;
+}
+
+/* Queues a task on the next worker in round-robin order.
+*	@task: The work to run
+*/
+void thread_pool::submit(std::function<void()> task) {
+	int q = next_queue.fetch_add(1) % int(queues.size());
+	pending.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> guard(queues[q]->lock);
+		queues[q]->tasks.push_back(task);
+	}
+	{
+		// taking the lock orders the push against a worker going to sleep
+		std::lock_guard<std::mutex> guard(state_lock);
+	}
+	work_ready.notify_one();
+}
+
+/* Blocks until every submitted task has finished.
+*/
+void thread_pool::wait() {
+	std::unique_lock<std::mutex> guard(state_lock);
+	while (pending.load() != 0) {
+		work_done.wait(guard);
+	}
+}
+
+/* Pops the newest task from a worker's own deque.
+*	@index: the worker index
+*	@task: receives the task
+*	returns true if a task was found.
+*/
+bool thread_pool::pop_local(int index, std::function<void()>& task) {
+	task_queue* q = queues[index];
+	std::lock_guard<std::mutex> guard(q->lock);
+	if (q->tasks.empty()) return false;
+	task = q->tasks.back();
+	q->tasks.pop_back();
+	return true;
+}
+
+/* Steals the oldest task from another worker's deque.
+*	@index: the stealing worker's index
+*	@task: receives the task
+*	returns true if a task was stolen.
+*/
+bool thread_pool::steal(int index, std::function<void()>& task) {
+	int n = int(queues.size());
+	for (int i = 1; i < n; i++) {
+		task_queue* q = queues[(index + i) % n];
+		std::lock_guard<std::mutex> guard(q->lock);
+		if (!q->tasks.empty()) {
+			task = q->tasks.front();
+			q->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Worker loop: run local work, then steal, then sleep until more
+*	work is submitted.
+*	@index: the worker index
+*/
+void thread_pool::run(int index) {
+	std::function<void()> task;
+	while (true) {
+		if (pop_local(index, task) || steal(index, task)) {
+			task();
+			task = nullptr;
+			if (pending.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> guard(state_lock);
+				work_done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(state_lock);
+		if (stopping) return;
+		// pending counts queued and running tasks, so only sleep once
+		// nothing is left that could be stolen.
+		bool queued = false;
+		for (size_t i = 0; i < queues.size() && !queued; i++) {
+			std::lock_guard<std::mutex> qguard(queues[i]->lock);
+			queued = !queues[i]->tasks.empty();
+		}
+		if (!queued) work_ready.wait(guard);
+	}
+}
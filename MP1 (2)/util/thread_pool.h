@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed size pool of worker threads. Every worker owns a deque of tasks;
+*	it pops work from the back of its own deque and, once that runs dry,
+*	steals from the front of the other workers' deques. Tasks are handed
+*	out round-robin so the deques start out balanced.
+*/
+class thread_pool {
+	public:
+		thread_pool(int num_threads);
+		~thread_pool();
+
+		void submit(std::function<void()> task);
+		void wait();
+		int size() const { return int(workers.size()); }
+
+		static int hardware_threads();
+
+	private:
+		struct task_queue {
+			std::mutex lock;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		void run(int index);
+		bool pop_local(int index, std::function<void()>& task);
+		bool steal(int index, std::function<void()>& task);
+
+	private:
+		std::vector<std::thread> workers;
+		std::vector<task_queue*> queues;
+		std::atomic<int> next_queue;
+		std::atomic<int> pending;	// submitted but not yet finished
+		std::mutex state_lock;
+		std::condition_variable work_ready;
+		std::condition_variable work_done;
+		bool stopping;
+};
+
+#endif
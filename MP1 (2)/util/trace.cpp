@@ -0,0 +1,135 @@
+#include "trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+	struct trace_event {
+		const char* name;
+		long long begin;
+		long long end;
+		int x, y;			// -1 when the span has no position
+	};
+
+	/* The events of one thread, oldest overwritten first.
+	*/
+	struct trace_buffer {
+		std::vector<trace_event> ring;
+		size_t recorded;	// events ever recorded, ring holds the last ring.size()
+		int tid;
+		std::string name;
+	};
+
+	struct trace_registry {
+		std::mutex lock;
+		std::vector<std::unique_ptr<trace_buffer> > buffers;
+		size_t capacity;
+		long long origin;	// trace_now() at trace_start, time 0 in the file
+	};
+
+	trace_registry& registry() {
+		static trace_registry r;
+		return r;
+	}
+
+	/* The calling thread's buffer, made on its first event.
+	*/
+	trace_buffer* thread_buffer() {
+		static thread_local trace_buffer* buffer = 0;
+		if (!buffer) {
+			trace_registry& r = registry();
+			std::lock_guard<std::mutex> guard(r.lock);
+			r.buffers.push_back(std::unique_ptr<trace_buffer>(new trace_buffer()));
+			buffer = r.buffers.back().get();
+			buffer->ring.resize(r.capacity);
+			buffer->recorded = 0;
+			buffer->tid = int(r.buffers.size());
+			buffer->name = "thread " + std::to_string(buffer->tid);
+		}
+		return buffer;
+	}
+
+	void write_string(std::ostream& out, const std::string& s) {
+		out << '"';
+		for (size_t i = 0; i < s.size(); i++) {
+			if (s[i] == '"' || s[i] == '\\') out << '\\';
+			out << s[i];
+		}
+		out << '"';
+	}
+}
+
+/* Turns tracing on. Call before the threads to be traced start.
+*	@events_per_thread: size of each thread's ring buffer
+*/
+void trace_start(size_t events_per_thread) {
+	trace_registry& r = registry();
+	r.capacity = events_per_thread ? events_per_thread : 1;
+	r.origin = trace_now();
+	trace_enabled() = true;
+}
+
+/* Names the calling thread on the timeline.
+*	@name: the name, e.g. "main"
+*/
+void trace_name_thread(const char* name) {
+	thread_buffer()->name = name;
+}
+
+/* Adds a finished span to the calling thread's buffer.
+*	@name: the span's name; must outlive the trace (a string literal)
+*	@begin, end: trace_now() at its start and end
+*	@x, y: position of the tile or band, -1 for none
+*/
+void trace_record(const char* name, long long begin, long long end, int x, int y) {
+	trace_buffer* b = thread_buffer();
+	trace_event& e = b->ring[b->recorded % b->ring.size()];
+	e.name = name;
+	e.begin = begin;
+	e.end = end;
+	e.x = x;
+	e.y = y;
+	b->recorded++;
+}
+
+/* Writes every thread's events as Chrome Trace Event JSON: one complete
+*	("X") event per span, in microseconds since trace_start(), and a
+*	thread_name record per thread. Only call once the traced threads
+*	have stopped recording.
+*	@path: file to write
+*	@dropped: receives the number of events lost to full buffers
+*	returns false if the file couldn't be written.
+*/
+bool trace_write(const std::string& path, long long& dropped) {
+	trace_registry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	std::ofstream out(path.c_str());
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	dropped = 0;
+	bool first = true;
+	for (size_t t = 0; t < r.buffers.size(); t++) {
+		const trace_buffer& b = *r.buffers[t];
+		out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b.tid
+			<< ", \"args\": {\"name\": ";
+		write_string(out, b.name);
+		out << "}}";
+		first = false;
+		size_t kept = (b.recorded < b.ring.size()) ? b.recorded : b.ring.size();
+		dropped += (long long)(b.recorded - kept);
+		for (size_t i = b.recorded - kept; i < b.recorded; i++) {
+			const trace_event& e = b.ring[i % b.ring.size()];
+			out << ",\n{\"name\": ";
+			write_string(out, e.name);
+			out << ", \"cat\": \"mp1\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b.tid
+				<< ", \"ts\": " << (e.begin - r.origin) / 1000.0 << ", \"dur\": " << (e.end - e.begin) / 1000.0;
+			if (e.x >= 0) out << ", \"args\": {\"x\": " << e.x << ", \"y\": " << e.y << "}";
+			out << "}";
+		}
+	}
+	out << "\n], \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+	return bool(out);
+}
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <string>
+
+/* Timeline tracing. Code marks the spans it wants on the timeline with
+*	TRACE_SCOPE("name") (or TRACE_SCOPE_AT("name", x, y) to tag a tile
+*	or band with its position); with tracing on, each span becomes one
+*	event in a ring buffer owned by the thread that ran it, so recording
+*	takes no lock. A full buffer overwrites its oldest events. Once the
+*	threads are done, trace_write() dumps every buffer as Chrome Trace
+*	Event JSON, which chrome://tracing and Perfetto load.
+*	With tracing off a span costs a test of one flag. Building with
+*	-DMP1_NO_TRACE removes the spans altogether.
+*/
+
+/* Whether spans are being recorded. Set once by trace_start(), before
+*	any thread records.
+*/
+inline bool& trace_enabled() {
+	static bool enabled = false;
+	return enabled;
+}
+
+inline long long trace_now() {
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_start(size_t events_per_thread);
+void trace_name_thread(const char* name);
+void trace_record(const char* name, long long begin, long long end, int x, int y);
+bool trace_write(const std::string& path, long long& dropped);
+
+/* Records the span from its construction to its destruction.
+*/
+class trace_scope {
+	public:
+		trace_scope(const char* name, int x = -1, int y = -1) : name(trace_enabled() ? name : 0), x(x), y(y), begin(0) {
+			if (this->name) begin = trace_now();
+		}
+
+		~trace_scope() {
+			if (name) trace_record(name, begin, trace_now(), x, y);
+		}
+
+	private:
+		const char* name;	// null when not recording
+		int x, y;
+		long long begin;
+};
+
+#ifndef MP1_NO_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_AT(name, x, y) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name, x, y)
+#define TRACE_THREAD_NAME(name) do { if (trace_enabled()) trace_name_thread(name); } while (0)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_AT(name, x, y) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "aabb.h"
+#include "util.h"
+
+/* An affine transform p -> A p + b, stored as the 3x4 matrix [A|b]
+*	together with its inverse. Transforms are only built from
+*	translations, rotations and non-zero scales and their products, so
+*	the inverse is composed alongside and never has to be solved for.
+*/
+class transform {
+	public:
+		/* The identity.
+		*/
+		transform() {
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 4; c++) m[r][c] = inv[r][c] = (r == c) ? 1 : 0;
+			}
+		}
+
+		/* Moves points by t.
+		*/
+		static transform translate(const vec3& t) {
+			transform x;
+			for (int r = 0; r < 3; r++) {
+				x.m[r][3] = t[r];
+				x.inv[r][3] = -t[r];
+			}
+			return x;
+		}
+
+		/* Scales each axis by the matching component of s, which must be
+		*	non-zero.
+		*/
+		static transform scale(const vec3& s) {
+			transform x;
+			for (int r = 0; r < 3; r++) {
+				x.m[r][r] = s[r];
+				x.inv[r][r] = 1 / s[r];
+			}
+			return x;
+		}
+
+		/* Rotates counter-clockwise about an axis through the origin.
+		*	@axis: the axis, any length but zero
+		*	@degrees: the angle
+		*/
+		static transform rotate(const vec3& axis, double degrees) {
+			vec3 a = normalize(axis);
+			double radians = degrees_to_radians(degrees);
+			double c = cos(radians), s = sin(radians), k = 1 - c;
+			double rot[3][3] = {
+				{ c + a[0]*a[0]*k,		a[0]*a[1]*k - a[2]*s,	a[0]*a[2]*k + a[1]*s },
+				{ a[1]*a[0]*k + a[2]*s,	c + a[1]*a[1]*k,		a[1]*a[2]*k - a[0]*s },
+				{ a[2]*a[0]*k - a[1]*s,	a[2]*a[1]*k + a[0]*s,	c + a[2]*a[2]*k }
+			};
+			transform x;
+			for (int r = 0; r < 3; r++) {
+				for (int col = 0; col < 3; col++) {
+					x.m[r][col] = rot[r][col];
+					x.inv[col][r] = rot[r][col];	// rotations invert by transposing
+				}
+			}
+			return x;
+		}
+
+		/* Places an object: scales it, rotates it about x, then y, then z
+		*	and moves it.
+		*	@position: where its origin goes
+		*	@degrees: the rotations about x, y and z
+		*	@size: the scale of each axis, non-zero
+		*/
+		static transform place(const vec3& position, const vec3& degrees, const vec3& size) {
+			return translate(position) * rotate(vec3(0,0,1), degrees[2]) * rotate(vec3(0,1,0), degrees[1])
+				* rotate(vec3(1,0,0), degrees[0]) * scale(size);
+		}
+
+		/* The transform that applies o first and then this one.
+		*/
+		transform operator*(const transform& o) const {
+			transform x;
+			multiply(m, o.m, x.m);
+			multiply(o.inv, inv, x.inv);
+			return x;
+		}
+
+		transform inverse() const {
+			transform x;
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 4; c++) {
+					x.m[r][c] = inv[r][c];
+					x.inv[r][c] = m[r][c];
+				}
+			}
+			return x;
+		}
+
+		vec3 point(const vec3& p) const { return apply(m, p, 1); }
+		vec3 vector(const vec3& v) const { return apply(m, v, 0); }
+		vec3 inverse_point(const vec3& p) const { return apply(inv, p, 1); }
+		vec3 inverse_vector(const vec3& v) const { return apply(inv, v, 0); }
+
+		/* Takes a normal through the transform: normals go by the inverse
+		*	transpose so they stay perpendicular to a scaled surface. The
+		*	result is not unit length.
+		*/
+		vec3 normal(const vec3& n) const {
+			return vec3(inv[0][0]*n[0] + inv[1][0]*n[1] + inv[2][0]*n[2],
+						inv[0][1]*n[0] + inv[1][1]*n[1] + inv[2][1]*n[2],
+						inv[0][2]*n[0] + inv[1][2]*n[1] + inv[2][2]*n[2]);
+		}
+
+		/* The ray in the space this transform maps from. The direction is
+		*	not renormalized, so a hit at t is at t on both rays.
+		*/
+		ray inverse_ray(const ray& r) const {
+			return ray(inverse_point(r.origin()), inverse_vector(r.direction()));
+		}
+
+		/* The box around a transformed box: the box of its 8 corners.
+		*/
+		aabb box(const aabb& b) const {
+			aabb out;
+			for (int corner = 0; corner < 8; corner++) {
+				vec3 p = vec3((corner & 1) ? b.max()[0] : b.min()[0],
+							  (corner & 2) ? b.max()[1] : b.min()[1],
+							  (corner & 4) ? b.max()[2] : b.min()[2]);
+				out.expand(point(p));
+			}
+			return out;
+		}
+
+	private:
+		static vec3 apply(const double x[3][4], const vec3& v, double w) {
+			return vec3(x[0][0]*v[0] + x[0][1]*v[1] + x[0][2]*v[2] + x[0][3]*w,
+						x[1][0]*v[0] + x[1][1]*v[1] + x[1][2]*v[2] + x[1][3]*w,
+						x[2][0]*v[0] + x[2][1]*v[1] + x[2][2]*v[2] + x[2][3]*w);
+		}
+
+		// out = a b, with the implied bottom row (0 0 0 1)
+		static void multiply(const double a[3][4], const double b[3][4], double out[3][4]) {
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 4; c++) {
+					out[r][c] = a[r][0]*b[0][c] + a[r][1]*b[1][c] + a[r][2]*b[2][c] + ((c == 3) ? a[r][3] : 0);
+				}
+			}
+		}
+
+	private:
+		double m[3][4];
+		double inv[3][4];
+};
+
+#endif
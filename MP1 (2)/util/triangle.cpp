@@ -1,50 +1,128 @@
 #include "triangle.h"
+#include "render_stats.h"
 
-/* Determines if a ray intersects a triangle using Moeller-Trumbore
+/* Finds the intersection of a ray with the triangle using Moeller-Trumbore
 *	intersection algorithm.  v1,v2,v3 must be defined in a CCW order
 *	@r: Ray to cast
 *	@t_min: min value of t
 *	@t_max: max value of t
-*	@rec: The hit record to store the info
+*	@t: receives the t of the intersection
+*	@u, v: receive the barycentric coordinates of the intersection
 *	returns true if ray intersects the triangle, false otherwise
 */
-bool triangle::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-	double epsilon = 1e-5;
-	vec3 edge1 = v2 - v1;
-	vec3 edge2 = v3 - v1;
-	vec3 n = cross(edge1,edge2);
-	vec3 h = cross(r.direction(),edge2);
-	double a = dot(edge1,h);
+template<class T>
+bool triangle_t<T>::solve(const ray_t<T>& r, T t_min, T t_max, T& t, T& u, T& v) const {
+	return intersect(a, e1, e2, r, t_min, t_max, t, u, v);
+}
+
+/* The intersection test of solve() on baked triangle data, for code
+*	that keeps triangles in its own arrays.
+*	@v1: the first vertex
+*	@edge1, edge2: v2 - v1 and v3 - v1
+*	@r, t_min, t_max, t, u, v: as for solve()
+*/
+template<class T>
+bool triangle_t<T>::intersect(const vec3_t<T>& v1, const vec3_t<T>& edge1, const vec3_t<T>& edge2,
+	const ray_t<T>& r, T t_min, T t_max, T& t, T& u, T& v) {
+	COUNT_STAT(tests[render_counters::triangle_tests], 1);
+	T epsilon = T(1e-5);
+	vec3_t<T> h = cross(r.direction(),edge2);
+	T a = dot(edge1,h);
 	if (a > -epsilon && a < epsilon) {
 		// ray is parallel to triangle
 		return false;
 	}
 
-	double f = 1.0/a;
-	vec3 s = r.origin() - v1;
-	double u = f * dot(s,h);
+	T f = T(1.0)/a;
+	vec3_t<T> s = r.origin() - v1;
+	u = f * dot(s,h);
 	if (u < 0 || u > 1) {
 		return false;
 	}
 
-	vec3 q = cross(s,edge1);
-	double v = f * dot(r.direction(),q);
+	vec3_t<T> q = cross(s,edge1);
+	v = f * dot(r.direction(),q);
 	if (v < 0 || u + v > 1) {
 		return false;
 	}
 
-	double t = f * dot(edge2,q);
+	t = f * dot(edge2,q);
 	if (t < 0 || t < t_min || t_max < t) {
 		return false;
 	}
-	if (t > epsilon) {
-		rec.t = t;
-    	rec.p = r.at(rec.t);
-    	rec.n = normalize(n);
-		rec.kd = kd;
-		rec.ld = ld;
-		return true;
-	}
+	return t > epsilon;
+}
+
+/* Determines if a ray intersects a triangle
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: The hit record to store the info
+*	returns true if ray intersects the triangle, false otherwise
+*/
+template<class T>
+bool triangle_t<T>::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	T t, u, v;
+	if (!solve(ray_t<T>(r), T(t_min), T(t_max), t, u, v)) return false;
+	// the limits may have rounded outwards on their way to T
+	if (t < t_min || t_max < t) return false;
+
+	rec.t = t;
+	rec.object = this;
+	rec.prim = 0;
+	rec.u = u;
+	rec.v = v;
+	return true;
+}
 
-	return false;
+/* Fills in the hit point, normal and material of a hit on the triangle
+*	@r: the ray that hit
+*	@rec: a record filled in by hit()
+*/
+template<class T>
+void triangle_t<T>::resolve(const ray& r, hit_record& rec) const {
+	rec.p = r.at(rec.t);
+	rec.n = vec3(normal);
+	rec.kd = vec3(kd);
+	rec.ld = vec3(ld);
+}
+
+/* Determines if a ray hits the triangle anywhere in [t_min,t_max]
+*	without filling in a hit record.
+*	@r: Ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	returns true if ray intersects the triangle, false otherwise
+*/
+template<class T>
+bool triangle_t<T>::occluded(const ray& r, double t_min, double t_max) const {
+	T t, u, v;
+	return solve(ray_t<T>(r), T(t_min), T(t_max), t, u, v) && t_min <= t && t <= t_max;
 }
+
+/* Bakes the edges and the unit face normal.
+*/
+template<class T>
+void triangle_t<T>::compile() {
+	e1 = b - a;
+	e2 = c - a;
+	vec3_t<T> n = cross(e1,e2);
+	T len = n.length();
+	normal = (len > 0) ? n / len : n;
+}
+
+/* Computes the bounding box of the triangle
+*	@output_box: receives the box
+*	returns true
+*/
+template<class T>
+bool triangle_t<T>::bounding_box(aabb& output_box) const {
+	output_box = aabb();
+	output_box.expand(vec3(a));
+	output_box.expand(vec3(b));
+	output_box.expand(vec3(c));
+	return true;
+}
+
+template class triangle_t<double>;
+template class triangle_t<float>;
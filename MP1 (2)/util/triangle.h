@@ -4,20 +4,59 @@
 #include "hittable.h"
 #include "vec3.h"
 
-class triangle : public hittable {
+/* Triangle stored and intersected in precision T. Hits are reported
+*	through the double precision hittable interface. The vertices are
+*	private so they can't change without the baked data following them.
+*/
+template<class T>
+class triangle_t : public hittable {
     public:
-        triangle() : kd(vec3(0,0,0)), ld(vec3(0,0,0)) {}
-        triangle(vec3 v1u, vec3 v2u, vec3 v3u, vec3 kdu, vec3 ldu) : v1(v1u), v2(v2u), v3(v3u), kd(kdu), ld(ldu) {};
+        triangle_t() : kd(vec3_t<T>(0,0,0)), ld(vec3_t<T>(0,0,0)) { compile(); }
+        triangle_t(vec3_t<T> v1u, vec3_t<T> v2u, vec3_t<T> v3u, vec3_t<T> kdu, vec3_t<T> ldu) : kd(kdu), ld(ldu), a(v1u), b(v2u), c(v3u) { compile(); };
 
         virtual bool hit(
             const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual void resolve(const ray& r, hit_record& rec) const override;
+        virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void compile() override;
+
+        vec3_t<T> v1() const { return a; }
+        vec3_t<T> v2() const { return b; }
+        vec3_t<T> v3() const { return c; }
+        vec3_t<T> edge1() const { return e1; }
+        vec3_t<T> edge2() const { return e2; }
+        vec3_t<T> unit_n() const { return normal; }
+
+        // change the vertices and bake them again
+        void set_vertices(const vec3_t<T>& v1u, const vec3_t<T>& v2u, const vec3_t<T>& v3u) {
+            a = v1u; b = v2u; c = v3u;
+            compile();
+        }
+
+    private:
+        bool solve(const ray_t<T>& r, T t_min, T t_max, T& t, T& u, T& v) const;
+
+    public:
+        static bool intersect(const vec3_t<T>& v1, const vec3_t<T>& edge1, const vec3_t<T>& edge2,
+            const ray_t<T>& r, T t_min, T t_max, T& t, T& u, T& v);
 
     public:
-        vec3 v1;
-		vec3 v2;
-		vec3 v3;
-		vec3 kd;
-		vec3 ld;
+		vec3_t<T> kd;
+		vec3_t<T> ld;
+
+    private:
+        vec3_t<T> a;
+		vec3_t<T> b;
+		vec3_t<T> c;
+
+		// baked by compile()
+		vec3_t<T> e1;
+		vec3_t<T> e2;
+		vec3_t<T> normal;
 };
 
+typedef triangle_t<double> triangle;
+typedef triangle_t<float> trianglef;
+
 #endif
@@ -0,0 +1,112 @@
+#include "triangle_mesh.h"
+#include "triangle.h"
+
+/* Intersects triangle i of the mesh.
+*	@i: the triangle, in leaf order once compiled
+*	@r, t_min, t_max, t, u, v: as for triangle::intersect
+*/
+bool triangle_mesh::hit_triangle(size_t i, const ray& r, double t_min, double t_max, double& t, double& u, double& v) const {
+	const vec3& v1 = corner(i, 0);
+	return triangle::intersect(v1, corner(i, 1) - v1, corner(i, 2) - v1, r, t_min, t_max, t, u, v);
+}
+
+/* Determines if a ray hits the mesh, walking its BVH front to back.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*	@rec: hit record to store the info
+*/
+bool triangle_mesh::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	double closest_so_far = t_max;
+	return bvh_traverse(nodes, r, t_min, closest_so_far, false,
+		[&](int first, int count, double& t_limit) {
+			bool hit_leaf = false;
+			double t, u, v;
+			for (int i = first; i < first + count; i++) {
+				if (hit_triangle(i, r, t_min, t_limit, t, u, v)) {
+					hit_leaf = true;
+					t_limit = t;
+					rec.t = t;
+					rec.object = this;
+					rec.prim = i;
+					rec.u = u;
+					rec.v = v;
+				}
+			}
+			return hit_leaf;
+		});
+}
+
+/* Fills in the hit point, normal and material of a hit on the mesh
+*	@r: the ray that hit
+*	@rec: a record filled in by hit(), prim being the triangle
+*/
+void triangle_mesh::resolve(const ray& r, hit_record& rec) const {
+	const vec3& v1 = corner(rec.prim, 0);
+	vec3 n = cross(corner(rec.prim, 1) - v1, corner(rec.prim, 2) - v1);
+	double len = n.length();
+	rec.p = r.at(rec.t);
+	rec.n = (len > 0) ? n / len : n;
+	rec.kd = kd;
+	rec.ld = ld;
+}
+
+/* Determines if a ray hits the mesh anywhere in [t_min,t_max], leaving
+*	the tree at the first triangle found.
+*	@r: ray to cast
+*	@t_min: min value of t
+*	@t_max: max value of t
+*/
+bool triangle_mesh::occluded(const ray& r, double t_min, double t_max) const {
+	return bvh_traverse(nodes, r, t_min, t_max, true,
+		[&](int first, int count, double& t_limit) {
+			double t, u, v;
+			for (int i = first; i < first + count; i++) {
+				if (hit_triangle(i, r, t_min, t_limit, t, u, v)) return true;
+			}
+			return false;
+		});
+}
+
+/* The box of the BVH's root.
+*	@output_box: receives the box
+*	returns false if the mesh is empty or not compiled.
+*/
+bool triangle_mesh::bounding_box(aabb& output_box) const {
+	if (nodes.empty()) return false;
+	output_box = nodes[0].box;
+	return true;
+}
+
+/* Builds the BVH over the triangles and puts the index buffer in its
+*	leaf order. The boxes and the reordered copy only live while this
+*	runs.
+*/
+void triangle_mesh::compile() {
+	size_t count = triangle_count();
+	std::vector<int> order;
+	{
+		std::vector<aabb> boxes(count);
+		for (size_t i = 0; i < count; i++) {
+			boxes[i].expand(corner(i, 0));
+			boxes[i].expand(corner(i, 1));
+			boxes[i].expand(corner(i, 2));
+		}
+		bvh_builder::build(boxes, nodes, order);
+	}
+	// the builder reserves for small leaves; big meshes shouldn't keep the slack
+	std::vector<bvh_node>(nodes).swap(nodes);
+
+	std::vector<int32_t> sorted(indices.size());
+	for (size_t i = 0; i < count; i++) {
+		for (int k = 0; k < 3; k++) sorted[3*i + k] = indices[3*size_t(order[i]) + k];
+	}
+	indices.swap(sorted);
+}
+
+/* returns the bytes held by the vertex and index buffers and the BVH.
+*/
+size_t triangle_mesh::memory_bytes() const {
+	return vertices.capacity() * sizeof(vec3) + indices.capacity() * sizeof(int32_t)
+		+ nodes.capacity() * sizeof(bvh_node);
+}
@@ -0,0 +1,50 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <stdint.h>
+#include <vector>
+#include "hittable.h"
+#include "bvh.h"
+
+/* An indexed triangle mesh: one shared vertex buffer, three indices per
+*	triangle and one material for the whole mesh. A vertex shared by six
+*	triangles is stored once instead of six times, and no triangle is an
+*	object of its own. compile() builds a BVH over the triangles and
+*	reorders the index buffer into its leaf order, so leaves are runs of
+*	the index buffer. The intersection arithmetic is triangle's, so a
+*	mesh renders like the same triangles added one by one.
+*/
+class triangle_mesh : public hittable {
+	public:
+		triangle_mesh() : kd(vec3(0,0,0)), ld(vec3(0,0,0)) {}
+		triangle_mesh(vec3 kdu, vec3 ldu) : kd(kdu), ld(ldu) {}
+
+		virtual bool hit(
+			const ray& r, double t_min, double t_max, hit_record& rec) const override;
+		virtual void resolve(const ray& r, hit_record& rec) const override;
+		virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+		virtual bool bounding_box(aabb& output_box) const override;
+		virtual void compile() override;
+
+		size_t triangle_count() const { return indices.size() / 3; }
+		size_t node_count() const { return nodes.size(); }
+		size_t memory_bytes() const;
+
+		// the corners of triangle i
+		const vec3& corner(size_t i, int k) const { return vertices[indices[3*i + k]]; }
+
+	private:
+		bool hit_triangle(size_t i, const ray& r, double t_min, double t_max, double& t, double& u, double& v) const;
+
+	public:
+		std::vector<vec3> vertices;
+		std::vector<int32_t> indices;	// counter-clockwise triples into vertices
+		vec3 kd;
+		vec3 ld;
+
+	private:
+		// built by compile()
+		std::vector<bvh_node> nodes;
+};
+
+#endif
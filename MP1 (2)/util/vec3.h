@@ -1,41 +1,222 @@
 #ifndef VEC3_H
 #define VEC3_H
-class vec3 {
+
+#include <cmath>
+#include <ostream>
+
+using std::sqrt;
+
+/* Three component vector, templated on the scalar type. vec3 (double)
+*	is the reference precision used by the renderer; vec3f halves the
+*	storage of whatever holds it. Everything is inline in this header so
+*	the arithmetic can be inlined and constant folded at the call site.
+*/
+template<class T>
+class vec3_t {
 	private:
-		double v[3];
+		T v[3];
 
 	public:
-		vec3();
-		vec3(double v1, double v2, double v3);
-		//vec3(vec3& v2);
-		double x();
-		double y();
-		double z();
-		double length();
-		double length_squared();
-		
-		vec3 operator-() const;
-        double operator[](int i) const;
-        double& operator[](int i);
-
-        vec3& operator+=(const vec3 &v1);
-        vec3& operator*=(const double t);
-        vec3& operator/=(const double t);
+		typedef T scalar;
+
+		/* Empty Constructor for vec3
+		*/
+		constexpr vec3_t() : v{0, 0, 0} {}
+
+		/* Constructor for vec3
+			@v1: x component
+			@v2: y component
+			@v3: z component
+		*/
+		constexpr vec3_t(T v1, T v2, T v3) : v{v1, v2, v3} {}
+
+		/* Converts from a vector of another precision.
+			@u: the vector to convert
+		*/
+		template<class U>
+		constexpr explicit vec3_t(const vec3_t<U>& u) : v{T(u[0]), T(u[1]), T(u[2])} {}
+
+		/* Returns the x, y or z component of the vector.
+		*/
+		constexpr T x() const { return v[0]; }
+		constexpr T y() const { return v[1]; }
+		constexpr T z() const { return v[2]; }
+
+		/* Returns the length of the vector (equlidian 2-norm).
+		*/
+		T length() const {
+			return sqrt((v[0]*v[0]) + (v[1]*v[1]) + (v[2]*v[2]));
+		}
+
+		/* Returns the square of the length of the vector (euclidian 2-norm).
+		*/
+		T length_squared() const {
+			return length()*length();
+		}
+
+		/* Returns a vector with all its components negated.
+		*/
+		constexpr vec3_t operator-() const {
+			return vec3_t(-v[0],-v[1],-v[2]);
+		}
+
+		/* Used to return the ith element of v.
+		*/
+		constexpr T operator[](int i) const { return v[i]; }
+		T& operator[](int i) { return v[i]; }
+
+		/* This operator does a component wise addition
+		*	of v and v1.
+		*	@v1: the vector whose components will be added to v
+		*	returns: A reference to itself.
+		*/
+		vec3_t& operator+=(const vec3_t &v1) {
+			v[0] += v1.v[0];
+			v[1] += v1.v[1];
+			v[2] += v1.v[2];
+			return *this;
+		}
+
+		/* This operator does a scalar multiplication
+		*	of v and t.
+		*	@t: the scalar value.
+		*	returns: A reference to itself.
+		*/
+		vec3_t& operator*=(const T t) {
+			v[0] *= t;
+			v[1] *= t;
+			v[2] *= t;
+			return *this;
+		}
+
+		/* This operator does a scalar multiplication withv and
+		*	the reciprocal of t.
+		*	@v1: the scalar value.
+		*	returns: A reference to itself.
+		*/
+		vec3_t& operator/=(const T t) {
+			v[0] /= t;
+			v[1] /= t;
+			v[2] /= t;
+			return *this;
+		}
 };
 
-std::ostream& operator<<(std::ostream &out, const vec3 &v1);
-vec3 operator+(const vec3 &u1, const vec3 &u2);
-vec3 operator-(const vec3 &u1, const vec3 &u2);
-vec3 operator*(const vec3 &u1, const vec3 &u2);
-vec3 operator*(double t, const vec3 &v1);
-vec3 operator*(const vec3 &v, double t);
-vec3 operator/(vec3 v, double t);
-double dot(const vec3 &u1, const vec3 &u2);
-vec3 cross(const vec3 &u1, const vec3 &u2);
-vec3 normalize(vec3 v);
+typedef vec3_t<double> vec3;
+typedef vec3_t<float> vec3f;
 
 // Aliases for vec3
 //using point3 = vec3;   // 3D point
 //using color = vec3;    // RGB color
 
+/* Allows us to easily print out the contents of a vec3.
+*	@out: The ouput stream to write to.
+*	@v1: the vector to print
+*	returns: the stream.
+*/
+template<class T>
+inline std::ostream& operator<<(std::ostream &out, const vec3_t<T> &v1) {
+    return out << v1[0] << ' ' << v1[1] << ' ' << v1[2];
+}
+
+/* Performs a component-wise addition ofS two vectors.
+*	@u1: the first vector
+*	@u2: the second vector
+*	returns: A new vec3 whose components are the sum of
+*	the components of u1 and u2.
+*/
+template<class T>
+constexpr vec3_t<T> operator+(const vec3_t<T> &u1, const vec3_t<T> &u2) {
+    return vec3_t<T>(u1[0] + u2[0], u1[1] + u2[1], u1[2] + u2[2]);
+}
+
+/* Performs a component-wise subtraction of two vectors.
+*	@u1: the first vector
+*	@u2: the second vector
+*	returns: A new vec3 whose components are the difference of
+*	the components of u1 and u2.
+*/
+template<class T>
+constexpr vec3_t<T> operator-(const vec3_t<T> &u1, const vec3_t<T> &u2) {
+    return vec3_t<T>(u1[0] - u2[0], u1[1] - u2[1], u1[2] - u2[2]);
+}
+
+/* Performs a component-wise multiplication of two vec3 objects.
+*	@u1: the first vector
+*	@u2: the second vector
+*	returns: A new vec3 whose components are the product of
+*	the components of u1 and u2.
+*/
+template<class T>
+constexpr vec3_t<T> operator*(const vec3_t<T> &u1, const vec3_t<T> &u2) {
+    return vec3_t<T>(u1[0] * u2[0], u1[1] * u2[1], u1[2] * u2[2]);
+}
+
+/* Performs a scalar multplication. The scalar takes the vector's type,
+*	so 2*v works for either precision.
+*	@t: scalar value
+*	@v1: the vec3 to multiply with
+*	returns: A new vec3 whose components are multiplied
+*	by t
+*/
+template<class T>
+constexpr vec3_t<T> operator*(typename vec3_t<T>::scalar t, const vec3_t<T> &v1) {
+    return vec3_t<T>(t*v1[0], t*v1[1], t*v1[2]);
+}
+
+/* Performs a scalar multplication.
+*	@v: the vec3 to multiply with
+*	@t: scalar value
+*	returns: A new vec3 whose components are multiplied
+*	by t.
+*/
+template<class T>
+constexpr vec3_t<T> operator*(const vec3_t<T> &v, typename vec3_t<T>::scalar t) {
+    return t * v;
+}
+
+/* Performs a scalar multplication.
+*	@v: the vec3 to multiply with
+*	@t: reciprocal of scalar value
+*	returns: A new vec3 whose components are multiplied
+*	by 1/t.
+*/
+template<class T>
+constexpr vec3_t<T> operator/(const vec3_t<T> &v, typename vec3_t<T>::scalar t) {
+    return (1/t) * v;
+}
+
+/* Performs a dot product
+*	@u1: First vec3
+*	@u2: Second vec3
+*	returns the dot product of u1 and u2.
+*/
+template<class T>
+constexpr T dot(const vec3_t<T> &u1, const vec3_t<T> &u2) {
+    return u1[0] * u2[0]
+         + u1[1] * u2[1]
+         + u1[2] * u2[2];
+}
+
+/* Performs a cross product
+*	@u1: First vec3
+*	@u2: Second vec3
+*	returns the cross product of u1 and u2.
+*/
+template<class T>
+constexpr vec3_t<T> cross(const vec3_t<T> &u1, const vec3_t<T> &u2) {
+    return vec3_t<T>(u1[1] * u2[2] - u1[2] * u2[1],
+                     u1[2] * u2[0] - u1[0] * u2[2],
+                     u1[0] * u2[1] - u1[1] * u2[0]);
+}
+
+/* normalizes the vec3 v
+*	@v: Vec3 to normalize.
+*	returns the normalized vec3.
+*/
+template<class T>
+inline vec3_t<T> normalize(const vec3_t<T>& v) {
+    return v / v.length();
+}
+
 #endif